@@ -0,0 +1,201 @@
+#include "bench_clips.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+#include "audio_conversion.h"
+#include "audio_input.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace soundboard
+{
+
+    static constexpr int kSynthRate = 44100;
+    static constexpr double kSynthSeconds = 10.0;
+
+    // Temporary directory for the synthetic clips, removed with its files at exit
+    struct SynthDir
+    {
+        std::string path;
+        std::vector<std::string> files;
+
+        SynthDir()
+        {
+            char tmpl[] = "/tmp/audio_bench.XXXXXX";
+            if (mkdtemp(tmpl))
+                path = tmpl;
+        }
+
+        ~SynthDir()
+        {
+            for (const std::string &f : files)
+                unlink(f.c_str());
+            if (!path.empty())
+                rmdir(path.c_str());
+        }
+    };
+
+    static SynthDir &synth_dir()
+    {
+        static SynthDir dir;
+        return dir;
+    }
+
+    static void put_le(std::ofstream &out, uint32_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            out.put(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+
+    // Same signal as the effects stage bench: a chord, a 2 Hz envelope and a little noise
+    static bool write_synth_wav(const std::string &path, std::string &error_out)
+    {
+        const uint32_t samples = static_cast<uint32_t>(kSynthRate * kSynthSeconds);
+        const uint32_t data_bytes = samples * 2 * 2;
+
+        std::ofstream out(path, std::ios::binary);
+        out.write("RIFF", 4);
+        put_le(out, 36 + data_bytes, 4);
+        out.write("WAVEfmt ", 8);
+        put_le(out, 16, 4);
+        put_le(out, 1, 2); // PCM
+        put_le(out, 2, 2);
+        put_le(out, kSynthRate, 4);
+        put_le(out, kSynthRate * 4, 4);
+        put_le(out, 4, 2);
+        put_le(out, 16, 2);
+        out.write("data", 4);
+        put_le(out, data_bytes, 4);
+
+        uint32_t seed = 12345;
+        for (uint32_t i = 0; i < samples; ++i)
+        {
+            double t = double(i) / kSynthRate;
+            double env = 0.5 + 0.5 * std::cos(2.0 * M_PI * 2.0 * t);
+            double tone = std::sin(2.0 * M_PI * 220.0 * t) + 0.6 * std::sin(2.0 * M_PI * 277.2 * t) +
+                          0.4 * std::sin(2.0 * M_PI * 329.6 * t);
+            seed = seed * 1664525u + 1013904223u;
+            double noise = (double(seed >> 8) / double(1 << 24) - 0.5) * 0.05;
+            put_le(out, static_cast<uint16_t>(static_cast<int16_t>((0.25 * env * tone + noise) * 32767.0)), 2);
+            put_le(out, static_cast<uint16_t>(static_cast<int16_t>((0.25 * env * tone - noise) * 32767.0)), 2);
+        }
+        if (!out)
+        {
+            error_out = "failed to write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    static std::vector<std::string> fixture_paths()
+    {
+        std::vector<std::string> paths;
+        if (const char *list = std::getenv("AUDIO_BENCH_FIXTURES"))
+        {
+            std::string s = list;
+            size_t at = 0;
+            while (at <= s.size())
+            {
+                size_t end = s.find(':', at);
+                if (end == std::string::npos)
+                    end = s.size();
+                if (end > at)
+                    paths.push_back(s.substr(at, end - at));
+                at = end + 1;
+            }
+        }
+        if (const char *input = std::getenv("AUDIO_BENCH_INPUT"); input && *input)
+            paths.push_back(input);
+        return paths;
+    }
+
+    static std::string base_name(const std::string &path)
+    {
+        size_t slash = path.rfind('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    const std::vector<std::string> &bench_clip_names()
+    {
+        static const std::vector<std::string> names = []()
+        {
+            std::vector<std::string> n = {"synth_wav", "synth_mp3"};
+            for (const std::string &path : fixture_paths())
+                n.push_back(base_name(path));
+            return n;
+        }();
+        return names;
+    }
+
+    static bool make_clip(const std::string &name, BenchClip &out, std::string &error_out)
+    {
+        out.name = name;
+        if (name == "synth_wav" || name == "synth_mp3")
+        {
+            SynthDir &dir = synth_dir();
+            if (dir.path.empty())
+            {
+                error_out = "cannot create a temporary directory";
+                return false;
+            }
+            out.seconds = kSynthSeconds;
+            std::string wav = dir.path + "/synth.wav";
+            if (name == "synth_wav")
+            {
+                out.path = wav;
+                dir.files.push_back(wav);
+                return write_synth_wav(wav, error_out);
+            }
+            BenchClip source;
+            if (!bench_clip("synth_wav", source, error_out))
+                return false;
+            out.path = dir.path + "/synth.mp3";
+            dir.files.push_back(out.path);
+            return convert_to_mp3_libav(source.path, out.path, 192, error_out);
+        }
+
+        for (const std::string &path : fixture_paths())
+        {
+            if (base_name(path) != name)
+                continue;
+            AudioInput input;
+            if (!open_audio_input(path, AudioInputOptions{}, input, error_out))
+                return false;
+            out.path = path;
+            out.seconds = input.fmt->duration > 0 ? double(input.fmt->duration) / AV_TIME_BASE : 0.0;
+            close_audio_input(input);
+            if (out.seconds <= 0.0)
+            {
+                error_out = path + ": unknown duration";
+                return false;
+            }
+            return true;
+        }
+        error_out = "no clip named " + name;
+        return false;
+    }
+
+    bool bench_clip(const std::string &name, BenchClip &out, std::string &error_out)
+    {
+        // Benchmarks run one at a time, so no locking
+        static std::map<std::string, BenchClip> made;
+        auto it = made.find(name);
+        if (it != made.end())
+        {
+            out = it->second;
+            return true;
+        }
+        if (!make_clip(name, out, error_out))
+            return false;
+        made.emplace(name, out);
+        return true;
+    }
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace soundboard
+{
+
+    /**
+     * An input file for the pipeline benchmarks.
+     */
+    struct BenchClip
+    {
+        std::string name; // benchmark label: synthetic name or fixture file name
+        std::string path;
+        double seconds = 0.0; // audio duration
+    };
+
+    /**
+     * Names of every clip the benchmarks run over, known without generating or
+     * opening anything (so benchmarks can be registered from them at startup):
+     *
+     *   synth_wav     10 s 44.1kHz stereo 16-bit WAV (a chord with a pulsing envelope)
+     *   synth_mp3     the same encoded to MP3 192k
+     *   <file name>   each fixture in AUDIO_BENCH_FIXTURES (colon-separated paths),
+     *                 and AUDIO_BENCH_INPUT if set
+     */
+    const std::vector<std::string> &bench_clip_names();
+
+    /**
+     * The clip called name. Synthetic clips are written to a temporary directory on
+     * first use (removed at exit); fixtures are probed for their duration.
+     * @return false if it can't be generated or opened (error_out says why)
+     */
+    bool bench_clip(const std::string &name, BenchClip &out, std::string &error_out);
+
+}
@@ -0,0 +1,254 @@
+// Speed + pitch in one stage vs. the previous atempo -> pitch chain, for both
+// engines, over a synthetic 10 s 44.1kHz stereo clip:
+//
+//   mode 0  atempo=S,rubberband=pitch=P        (old libavfilter chain)
+//   mode 1  rubberband=tempo=S:pitch=P         (combined, what the graph builds now)
+//   mode 2  atempo=S -> NativeStretch(1, P)    (old native chain)
+//   mode 3  NativeStretch(S, P)                (combined native)
+//
+//   ./build/audio_bench --benchmark_filter=EffectsStage
+//
+// Besides time, each run checks the output duration against input / speed;
+// duration_err_ms above kMaxDurationErrorMs fails the benchmark.
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "native_stretch.h"
+
+extern "C"
+{
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/mem.h>
+#include <libavutil/samplefmt.h>
+}
+
+using namespace soundboard;
+
+static constexpr int kRate = 44100;
+static constexpr int kFrameSamples = 1152;
+static constexpr double kClipSeconds = 10.0;
+static constexpr double kMaxDurationErrorMs = 25.0;
+
+// A chord with a pulsing envelope plus a little noise: tonal content and
+// onsets, so neither engine gets an easy ride
+struct Clip
+{
+    std::vector<float> planes[2];
+    std::vector<AVFrame *> frames; // the same audio as FLTP frames, for the graphs
+
+    Clip()
+    {
+        const int n = static_cast<int>(kRate * kClipSeconds);
+        uint32_t seed = 12345;
+        for (auto &p : planes)
+            p.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+            double t = double(i) / kRate;
+            double env = 0.5 + 0.5 * std::cos(2.0 * M_PI * 2.0 * t);
+            double tone = std::sin(2.0 * M_PI * 220.0 * t) + 0.6 * std::sin(2.0 * M_PI * 277.2 * t) +
+                          0.4 * std::sin(2.0 * M_PI * 329.6 * t);
+            seed = seed * 1664525u + 1013904223u;
+            double noise = (double(seed >> 8) / double(1 << 24) - 0.5) * 0.05;
+            planes[0][i] = static_cast<float>(0.25 * env * tone + noise);
+            planes[1][i] = static_cast<float>(0.25 * env * tone - noise);
+        }
+
+        for (int at = 0; at < n; at += kFrameSamples)
+        {
+            AVFrame *f = av_frame_alloc();
+            f->format = AV_SAMPLE_FMT_FLTP;
+            f->sample_rate = kRate;
+            f->channel_layout = AV_CH_LAYOUT_STEREO;
+            f->channels = 2;
+            f->nb_samples = std::min(kFrameSamples, n - at);
+            f->pts = at;
+            av_frame_get_buffer(f, 0);
+            for (int ch = 0; ch < 2; ++ch)
+                std::copy_n(planes[ch].data() + at, f->nb_samples, reinterpret_cast<float *>(f->data[ch]));
+            frames.push_back(f);
+        }
+    }
+
+    ~Clip()
+    {
+        for (AVFrame *f : frames)
+            av_frame_free(&f);
+    }
+
+    int64_t samples() const { return static_cast<int64_t>(planes[0].size()); }
+};
+
+static const Clip &clip()
+{
+    static const Clip c;
+    return c;
+}
+
+// abuffer -> desc -> abuffersink for the clip's format
+struct Chain
+{
+    AVFilterGraph *graph = nullptr;
+    AVFilterContext *src = nullptr;
+    AVFilterContext *sink = nullptr;
+
+    ~Chain() { avfilter_graph_free(&graph); }
+
+    bool open(const char *desc, std::string &error_out)
+    {
+        graph = avfilter_graph_alloc();
+        char args[128];
+        snprintf(args, sizeof(args), "time_base=1/%d:sample_rate=%d:sample_fmt=fltp:channel_layout=stereo", kRate, kRate);
+        if (avfilter_graph_create_filter(&src, avfilter_get_by_name("abuffer"), "in", args, nullptr, graph) < 0 ||
+            avfilter_graph_create_filter(&sink, avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr, graph) < 0)
+        {
+            error_out = "failed to create abuffer/abuffersink";
+            return false;
+        }
+
+        AVFilterInOut *outputs = avfilter_inout_alloc();
+        AVFilterInOut *inputs = avfilter_inout_alloc();
+        outputs->name = av_strdup("in");
+        outputs->filter_ctx = src;
+        inputs->name = av_strdup("out");
+        inputs->filter_ctx = sink;
+        int ret = avfilter_graph_parse_ptr(graph, desc, &inputs, &outputs, nullptr);
+        avfilter_inout_free(&inputs);
+        avfilter_inout_free(&outputs);
+        if (ret < 0 || avfilter_graph_config(graph, nullptr) < 0)
+        {
+            error_out = std::string("cannot build \"") + desc + "\" (rubberband missing?)";
+            return false;
+        }
+        return true;
+    }
+};
+
+// Push the whole clip through a chain; each output frame goes to on_frame, then EOF
+template <typename OnFrame>
+static void run_chain(Chain &chain, OnFrame on_frame)
+{
+    AVFrame *out = av_frame_alloc();
+    auto drain = [&]()
+    {
+        while (av_buffersink_get_frame(chain.sink, out) >= 0)
+        {
+            on_frame(out);
+            av_frame_unref(out);
+        }
+    };
+    for (AVFrame *f : clip().frames)
+    {
+        av_buffersrc_add_frame_flags(chain.src, f, AV_BUFFERSRC_FLAG_KEEP_REF);
+        drain();
+    }
+    av_buffersrc_add_frame_flags(chain.src, nullptr, 0);
+    drain();
+    av_frame_free(&out);
+}
+
+// Pull whatever the engine has, counting samples
+static int64_t drain_native(NativeStretch &stretch, std::vector<float> (&scratch)[2])
+{
+    float *planes[2] = {scratch[0].data(), scratch[1].data()};
+    int64_t total = 0;
+    while (int n = stretch.pull(planes, kFrameSamples))
+        total += n;
+    return total;
+}
+
+// Output samples for one pass over the clip, or -1 (with error_out)
+static int64_t process_clip(int mode, float speed, float pitch, std::string &error_out)
+{
+    char desc[96];
+    int64_t out_samples = 0;
+    std::vector<float> scratch[2] = {std::vector<float>(kFrameSamples), std::vector<float>(kFrameSamples)};
+
+    if (mode == 0 || mode == 1)
+    {
+        if (mode == 0)
+            snprintf(desc, sizeof(desc), "atempo=%.2f,rubberband=pitch=%.2f", speed, pitch);
+        else
+            snprintf(desc, sizeof(desc), "rubberband=tempo=%.2f:pitch=%.2f", speed, pitch);
+        Chain chain;
+        if (!chain.open(desc, error_out))
+            return -1;
+        run_chain(chain, [&](AVFrame *f)
+                  { out_samples += f->nb_samples; });
+        return out_samples;
+    }
+
+    if (mode == 2)
+    {
+        snprintf(desc, sizeof(desc), "atempo=%.2f", speed);
+        Chain chain;
+        if (!chain.open(desc, error_out))
+            return -1;
+        NativeStretch stretch(kRate, 2, 1.0, pitch);
+        run_chain(chain, [&](AVFrame *f)
+                  {
+                      stretch.push(reinterpret_cast<const float *const *>(f->extended_data), f->nb_samples);
+                      out_samples += drain_native(stretch, scratch); });
+        stretch.finish();
+        return out_samples + drain_native(stretch, scratch);
+    }
+
+    NativeStretch stretch(kRate, 2, speed, pitch);
+    const int64_t n = clip().samples();
+    for (int64_t at = 0; at < n; at += kFrameSamples)
+    {
+        const float *planes[2] = {clip().planes[0].data() + at, clip().planes[1].data() + at};
+        stretch.push(planes, static_cast<int>(std::min<int64_t>(kFrameSamples, n - at)));
+        out_samples += drain_native(stretch, scratch);
+    }
+    stretch.finish();
+    return out_samples + drain_native(stretch, scratch);
+}
+
+// Args: mode, speed and pitch in hundredths
+static void BM_EffectsStage(benchmark::State &state)
+{
+    const int mode = static_cast<int>(state.range(0));
+    const float speed = state.range(1) / 100.0f;
+    const float pitch = state.range(2) / 100.0f;
+    clip(); // build outside the timed loop
+
+    int64_t out_samples = 0;
+    for (auto _ : state)
+    {
+        std::string err;
+        out_samples = process_clip(mode, speed, pitch, err);
+        if (out_samples < 0)
+        {
+            state.SkipWithError(err.c_str());
+            return;
+        }
+    }
+
+    const double expected = double(clip().samples()) / speed;
+    const double err_ms = std::abs(double(out_samples) - expected) * 1000.0 / kRate;
+    state.counters["duration_err_ms"] = err_ms;
+    state.counters["x_realtime"] = benchmark::Counter(kClipSeconds * double(state.iterations()),
+                                                      benchmark::Counter::kIsRate);
+    if (err_ms > kMaxDurationErrorMs)
+    {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "output duration off by %.1f ms", err_ms);
+        state.SkipWithError(msg);
+    }
+}
+
+BENCHMARK(BM_EffectsStage)
+    ->ArgNames({"mode", "speed", "pitch"})
+    ->ArgsProduct({{0, 1, 2, 3}, {150}, {120}})
+    ->ArgsProduct({{0, 1, 2, 3}, {75}, {80}})
+    ->Unit(benchmark::kMillisecond);
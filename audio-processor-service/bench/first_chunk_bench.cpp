@@ -0,0 +1,160 @@
+// Time to first chunk for ApplyEffectsStream's pipeline, default vs. low-latency mode:
+// open + probe the input, set up encoder and effects graph, then demux/decode/filter/
+// encode until the first chunk's worth of MP3 bytes exists. Network and gRPC are not
+// included; this is the server-side part of time-to-first-sound.
+//
+//   AUDIO_BENCH_INPUT=clip.mp3 ./build/audio_bench --benchmark_filter=FirstChunk
+//
+// Without AUDIO_BENCH_INPUT it runs over the synthetic MP3 from bench_clips.h.
+//
+// Target: low-latency mode produces its first chunk within kTargetFirstChunkMs for a
+// 44.1kHz stereo MP3 at 1.5x speed and 1.2x pitch. meets_target reports 1 when the
+// slowest measured iteration was within it.
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include "audio_input.h"
+#include "bench_clips.h"
+#include "mp3_probe.h"
+#include "pipeline_pool.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavfilter/buffersink.h>
+#include <libavformat/avformat.h>
+}
+
+using namespace soundboard;
+
+static constexpr double kTargetFirstChunkMs = 50.0;
+
+// Server defaults for the first chunk (Options::firstChunkBytes / lowLatencyFirstChunkBytes)
+static constexpr size_t kDefaultFirstChunkBytes = 8 * 1024;
+static constexpr size_t kLowLatencyFirstChunkBytes = 1024;
+
+// Run one stream until first_chunk_bytes are encoded; false (with error_out) on failure
+static bool produce_first_chunk(const std::string &path, float speed, float pitch, bool low_latency,
+                                size_t first_chunk_bytes, std::string &error_out)
+{
+    AudioInputOptions input_options;
+    if (low_latency)
+    {
+        Mp3StreamInfo mp3;
+        std::string probe_err;
+        input_options.fast_probe = probe_mp3_file(path, mp3, probe_err);
+    }
+    AudioInput input;
+    if (!open_audio_input(path, input_options, input, error_out))
+        return false;
+
+    EffectsOptions effects;
+    effects.low_latency = low_latency;
+    StreamPipeline pipeline;
+    if (!open_stream_pipeline(AudioFormat::of(input.dec_ctx), speed, pitch, effects, pipeline, error_out))
+    {
+        close_audio_input(input);
+        return false;
+    }
+
+    AVPacket *pkt = av_packet_alloc();
+    AVPacket *out = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVFrame *filtered = av_frame_alloc();
+    size_t bytes = 0;
+    int64_t in_pts = 0;
+    int64_t out_pts = 0;
+    bool eof = false;
+
+    while (bytes < first_chunk_bytes && !eof)
+    {
+        if (av_read_frame(input.fmt, pkt) < 0)
+        {
+            eof = true;
+            avcodec_send_packet(input.dec_ctx, nullptr);
+        }
+        else if (pkt->stream_index == input.stream_index)
+            avcodec_send_packet(input.dec_ctx, pkt);
+        av_packet_unref(pkt);
+
+        while (avcodec_receive_frame(input.dec_ctx, frame) == 0)
+        {
+            frame->pts = in_pts;
+            in_pts += frame->nb_samples;
+            push_effects_frame(pipeline.graph, frame);
+            av_frame_unref(frame);
+        }
+        if (eof)
+            push_effects_frame(pipeline.graph, nullptr);
+
+        while (av_buffersink_get_frame(pipeline.graph.sink, filtered) >= 0)
+        {
+            filtered->pts = out_pts;
+            out_pts += filtered->nb_samples;
+            avcodec_send_frame(pipeline.enc_ctx, filtered);
+            av_frame_unref(filtered);
+            while (avcodec_receive_packet(pipeline.enc_ctx, out) >= 0)
+            {
+                bytes += static_cast<size_t>(out->size);
+                av_packet_unref(out);
+            }
+        }
+    }
+
+    av_frame_free(&filtered);
+    av_frame_free(&frame);
+    av_packet_free(&out);
+    av_packet_free(&pkt);
+    free_stream_pipeline(pipeline);
+    close_audio_input(input);
+    if (bytes == 0)
+    {
+        error_out = "input produced no audio";
+        return false;
+    }
+    return true;
+}
+
+// Args: low_latency (0/1)
+static void BM_FirstChunk(benchmark::State &state)
+{
+    std::string path;
+    if (const char *input = std::getenv("AUDIO_BENCH_INPUT"); input && *input)
+        path = input;
+    else
+    {
+        BenchClip clip;
+        std::string err;
+        if (!bench_clip("synth_mp3", clip, err))
+        {
+            state.SkipWithError(err.c_str());
+            return;
+        }
+        path = clip.path;
+    }
+    bool low_latency = state.range(0) != 0;
+    size_t first_chunk_bytes = low_latency ? kLowLatencyFirstChunkBytes : kDefaultFirstChunkBytes;
+
+    double worst_ms = 0.0;
+    for (auto _ : state)
+    {
+        auto started = std::chrono::steady_clock::now();
+        std::string err;
+        if (!produce_first_chunk(path, 1.5f, 1.2f, low_latency, first_chunk_bytes, err))
+        {
+            state.SkipWithError(err.c_str());
+            return;
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        state.SetIterationTime(elapsed);
+        worst_ms = std::max(worst_ms, elapsed * 1000.0);
+    }
+    state.counters["worst_ms"] = worst_ms;
+    state.counters["target_ms"] = kTargetFirstChunkMs;
+    state.counters["meets_target"] = worst_ms <= kTargetFirstChunkMs ? 1 : 0;
+}
+
+BENCHMARK(BM_FirstChunk)->ArgName("low_latency")->Arg(0)->Arg(1)->UseManualTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,368 @@
+// End-to-end cost of the server's audio paths, without gRPC, per clip (see
+// bench_clips.h: two synthetic clips plus any fixtures):
+//
+//   Convert/<clip>                      convert_to_mp3_libav, as for uploads
+//   Passthrough/<clip>                  ApplyEffectsStream's no-effects path: Mp3FrameReader's
+//                                       paged reads cut on frame boundaries
+//   Effects/<clip>/speed/pitch/native   ApplyEffectsStream's pipeline: demux, decode,
+//                                       effects graph, MP3 encode, for the whole clip
+//   SteadyAllocs/<clip>                 the same pipeline (speed 1.5, pitch 1.2), counting
+//                                       heap allocations per steady-state chunk
+//
+//   AUDIO_BENCH_FIXTURES=a.mp3:b.flac ./build/audio_bench --benchmark_filter='^(Convert|Passthrough|Effects|SteadyAllocs)/'
+//
+// Counters:
+//   x_realtime            seconds of audio processed per second (the realtime factor)
+//   first_chunk_ms        Effects: time to the first 8 KiB of MP3, as a stream's first chunk
+//   decode/effects/encode_ms
+//                         Effects: time per stage for the whole clip
+//   allocs                heap allocations per iteration on the benchmark thread; needs
+//                         -DAUDIO_COUNT_ALLOCS=ON (Convert counts only its decode thread)
+//   allocs_per_chunk      SteadyAllocs: mean and worst allocations made by next_chunk() for
+//   max_allocs_per_chunk  one 32 KiB chunk, from the third chunk up to (not including) the
+//                         final flush, as audio_stream_steady_allocations_total counts them.
+//                         What is left is FFmpeg's own: demuxed packet payloads and frame
+//                         refs in the decoder, graph and encoder, roughly a dozen per input
+//                         frame. A chunk over kMaxSteadyAllocsPerChunk fails the benchmark;
+//                         without -DAUDIO_COUNT_ALLOCS=ON it is skipped.
+//
+// For run-over-run tracking, `cmake --build build --target bench_json` writes every
+// benchmark's results to build/audio_bench.json.
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "alloc_counter.h"
+#include "audio_conversion.h"
+#include "audio_input.h"
+#include "audio_pipeline.h"
+#include "bench_clips.h"
+#include "mp3_probe.h"
+#include "pipeline_pool.h"
+
+using namespace soundboard;
+
+// Server defaults (Options::firstChunkBytes / chunkBytes)
+static constexpr size_t kFirstChunkBytes = 8 * 1024;
+static constexpr size_t kChunkBytes = 32 * 1024;
+// Allowance for one steady-state chunk (~1.4 s of 192 kbps MP3; ~80 input frames at speed 1.5)
+static constexpr uint64_t kMaxSteadyAllocsPerChunk = 1024;
+// Server default (Options::pumpPacketBudget); a chunk needing more packets spans YIELDs
+static constexpr int kPumpPacketBudget = 64;
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point t)
+{
+    return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+static void set_common_counters(benchmark::State &state, const BenchClip &clip, uint64_t allocs)
+{
+    state.counters["x_realtime"] = benchmark::Counter(clip.seconds * double(state.iterations()),
+                                                      benchmark::Counter::kIsRate);
+    if (allocation_counting_enabled())
+        state.counters["allocs"] = benchmark::Counter(double(allocs), benchmark::Counter::kAvgIterations);
+}
+
+static void BM_Convert(benchmark::State &state, const std::string &clip_name)
+{
+    BenchClip clip;
+    std::string err;
+    if (!bench_clip(clip_name, clip, err))
+    {
+        state.SkipWithError(err.c_str());
+        return;
+    }
+    const std::string out_path = clip.path + ".bench_out.mp3";
+
+    uint64_t allocs = 0;
+    for (auto _ : state)
+    {
+        uint64_t before = thread_allocations();
+        if (!convert_to_mp3_libav(clip.path, out_path, 192, err))
+        {
+            state.SkipWithError(err.c_str());
+            break;
+        }
+        allocs += thread_allocations() - before;
+    }
+    unlink(out_path.c_str());
+    set_common_counters(state, clip, allocs);
+}
+
+static void BM_Passthrough(benchmark::State &state, const std::string &clip_name)
+{
+    BenchClip clip;
+    Mp3StreamInfo info;
+    std::string err;
+    if (!bench_clip(clip_name, clip, err) || !probe_mp3_file(clip.path, info, err) ||
+        !is_passthrough_compatible(info))
+    {
+        state.SkipWithError(err.empty() ? "not passthrough-compatible" : err.c_str());
+        return;
+    }
+
+    // Reused across iterations, as a stream reuses its chunk buffer
+    std::string chunk;
+    chunk.reserve(Mp3FrameReader::buffer_bytes(kChunkBytes));
+    int64_t bytes = 0;
+    uint64_t allocs = 0;
+    for (auto _ : state)
+    {
+        uint64_t before = thread_allocations();
+        Mp3FrameReader reader;
+        if (!reader.open(clip.path, info, err))
+        {
+            state.SkipWithError(err.c_str());
+            return;
+        }
+        Mp3FrameReader::Result result;
+        int64_t duration_us = 0;
+        for (size_t want = kFirstChunkBytes;
+             (result = reader.read(chunk, want, duration_us, err)) == Mp3FrameReader::Result::CHUNK;
+             want = kChunkBytes)
+        {
+            benchmark::DoNotOptimize(chunk.data());
+            bytes += static_cast<int64_t>(chunk.size());
+        }
+        if (result == Mp3FrameReader::Result::FAILED)
+        {
+            state.SkipWithError(err.c_str());
+            return;
+        }
+        allocs += thread_allocations() - before;
+    }
+    state.SetBytesProcessed(bytes);
+    set_common_counters(state, clip, allocs);
+}
+
+struct StageTimes
+{
+    double first_chunk = 0.0;
+    double decode = 0.0;
+    double effects = 0.0;
+    double encode = 0.0;
+};
+
+// The server's AudioPipeline for one stream over the whole clip, or null (with error_out)
+static std::unique_ptr<AudioPipeline> open_effects(const BenchClip &clip, float speed, float pitch, bool native,
+                                                   std::string &error_out)
+{
+    Demuxer demuxer;
+    Decoder decoder;
+    if (!open_decoder_input(clip.path, AudioInputOptions{}, demuxer, decoder, error_out))
+        return nullptr;
+    EffectsOptions effects;
+    effects.native_pitch = native;
+    StreamPipeline stages;
+    if (!open_stream_pipeline(decoder.format(), speed, pitch, effects, stages, error_out))
+        return nullptr;
+    FilterChain filters;
+    Encoder encoder;
+    adopt_stream_pipeline(stages, filters, encoder);
+
+    ChunkSink::Options chunking;
+    chunking.first_chunk_bytes = kFirstChunkBytes;
+    chunking.chunk_bytes = kChunkBytes;
+    return std::make_unique<AudioPipeline>(std::move(demuxer), std::move(decoder), std::move(filters),
+                                           std::move(encoder), chunking, AudioPipeline::InputRange{});
+}
+
+// One stream over the whole clip through the server's AudioPipeline, adding its stage
+// times into times
+static bool run_effects(const BenchClip &clip, float speed, float pitch, bool native, StageTimes &times,
+                        std::string &error_out)
+{
+    const Clock::time_point started = Clock::now();
+
+    std::unique_ptr<AudioPipeline> opened = open_effects(clip, speed, pitch, native, error_out);
+    if (!opened)
+        return false;
+    AudioPipeline &pipeline = *opened;
+    // Opening the input, encoder and graph is counted as decode
+    const double open_seconds = seconds_since(started);
+
+    std::string chunk;
+    chunk.reserve(kChunkBytes + 4096);
+    size_t bytes = 0;
+    int64_t samples = 0;
+    while (pipeline.next_chunk(chunk, samples, AudioPipeline::Budget{}) == AudioPipeline::Result::CHUNK)
+    {
+        if (bytes == 0)
+            times.first_chunk += seconds_since(started);
+        bytes += chunk.size();
+        chunk.clear();
+    }
+
+    const auto &stage_ns = pipeline.stage_ns();
+    times.decode += open_seconds + (stage_ns[static_cast<size_t>(PipelineStage::DEMUX)] +
+                                    stage_ns[static_cast<size_t>(PipelineStage::DECODE)]) / 1e9;
+    times.effects += stage_ns[static_cast<size_t>(PipelineStage::FILTER)] / 1e9;
+    times.encode += stage_ns[static_cast<size_t>(PipelineStage::ENCODE)] / 1e9;
+    if (bytes == 0)
+    {
+        error_out = "input produced no audio";
+        return false;
+    }
+    return true;
+}
+
+// Args: speed and pitch in hundredths, native pitch engine (0/1)
+static void BM_Effects(benchmark::State &state, const std::string &clip_name)
+{
+    BenchClip clip;
+    std::string err;
+    if (!bench_clip(clip_name, clip, err))
+    {
+        state.SkipWithError(err.c_str());
+        return;
+    }
+    const float speed = state.range(0) / 100.0f;
+    const float pitch = state.range(1) / 100.0f;
+    const bool native = state.range(2) != 0;
+
+    StageTimes times;
+    uint64_t allocs = 0;
+    for (auto _ : state)
+    {
+        uint64_t before = thread_allocations();
+        if (!run_effects(clip, speed, pitch, native, times, err))
+        {
+            state.SkipWithError(err.c_str());
+            return;
+        }
+        allocs += thread_allocations() - before;
+    }
+
+    // Encoded audio runs 1/speed as long, but x_realtime is per second of input like the others
+    set_common_counters(state, clip, allocs);
+    const auto avg = benchmark::Counter::kAvgIterations;
+    state.counters["first_chunk_ms"] = benchmark::Counter(times.first_chunk * 1000.0, avg);
+    state.counters["decode_ms"] = benchmark::Counter(times.decode * 1000.0, avg);
+    state.counters["effects_ms"] = benchmark::Counter(times.effects * 1000.0, avg);
+    state.counters["encode_ms"] = benchmark::Counter(times.encode * 1000.0, avg);
+}
+
+// Allocations made by next_chunk() for each steady-state chunk of one stream (none for a
+// clip too short to have one); false with error_out if the stream fails
+static bool count_steady_allocations(const BenchClip &clip, std::vector<uint64_t> &per_chunk,
+                                     std::string &error_out)
+{
+    std::unique_ptr<AudioPipeline> pipeline = open_effects(clip, 1.5f, 1.2f, false, error_out);
+    if (!pipeline)
+        return false;
+
+    AudioPipeline::Budget budget;
+    budget.max_packets = kPumpPacketBudget;
+    std::string chunk;
+    chunk.reserve(kChunkBytes + 4096);
+    int64_t samples = 0;
+    uint64_t pending = 0; // across the YIELDs of the chunk being filled
+    per_chunk.clear();
+    for (size_t chunks = 0;;)
+    {
+        uint64_t before = thread_allocations();
+        AudioPipeline::Result result = pipeline->next_chunk(chunk, samples, budget);
+        pending += thread_allocations() - before;
+
+        if (result == AudioPipeline::Result::YIELD)
+            continue;
+        if (result == AudioPipeline::Result::FAILED)
+        {
+            error_out = pipeline->error();
+            return false;
+        }
+        if (result == AudioPipeline::Result::DONE)
+            break;
+        // As on the server, the first two chunks (the short first one, then the first
+        // full-size one) size the buffers and are not steady state
+        if (chunks++ >= 2)
+            per_chunk.push_back(pending);
+        pending = 0;
+        chunk.clear();
+    }
+    // The last chunk carries the encoder flush
+    if (!per_chunk.empty())
+        per_chunk.pop_back();
+    return true;
+}
+
+static void BM_SteadyAllocs(benchmark::State &state, const std::string &clip_name)
+{
+    if (!allocation_counting_enabled())
+    {
+        state.SkipWithError("needs -DAUDIO_COUNT_ALLOCS=ON");
+        return;
+    }
+    BenchClip clip;
+    std::string err;
+    if (!bench_clip(clip_name, clip, err))
+    {
+        state.SkipWithError(err.c_str());
+        return;
+    }
+
+    std::vector<uint64_t> per_chunk;
+    per_chunk.reserve(256);
+    uint64_t allocs = 0;
+    uint64_t worst = 0;
+    size_t chunks = 0;
+    for (auto _ : state)
+    {
+        if (!count_steady_allocations(clip, per_chunk, err))
+        {
+            state.SkipWithError(err.c_str());
+            return;
+        }
+        for (uint64_t n : per_chunk)
+            allocs += n;
+        if (!per_chunk.empty())
+            worst = std::max(worst, *std::max_element(per_chunk.begin(), per_chunk.end()));
+        chunks += per_chunk.size();
+    }
+
+    set_common_counters(state, clip, allocs);
+    state.counters["allocs_per_chunk"] = chunks > 0 ? double(allocs) / double(chunks) : 0.0;
+    state.counters["max_allocs_per_chunk"] = double(worst);
+    if (chunks == 0)
+    {
+        state.SkipWithError("clip too short for a steady-state chunk");
+    }
+    else if (worst > kMaxSteadyAllocsPerChunk)
+    {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "%llu allocations in one steady-state chunk (allowance %llu)",
+                 static_cast<unsigned long long>(worst), static_cast<unsigned long long>(kMaxSteadyAllocsPerChunk));
+        state.SkipWithError(msg);
+    }
+}
+
+// One set per clip, registered by name so results read e.g. Effects/synth_mp3/speed:150/...
+static int register_pipeline_benchmarks()
+{
+    for (const std::string &name : bench_clip_names())
+    {
+        benchmark::RegisterBenchmark(("Convert/" + name).c_str(), BM_Convert, name)
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("Passthrough/" + name).c_str(), BM_Passthrough, name)
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Effects/" + name).c_str(), BM_Effects, name)
+            ->ArgNames({"speed", "pitch", "native"})
+            ->ArgsProduct({{75, 100, 150}, {80, 100, 120}, {0}})
+            ->Args({150, 120, 1})
+            ->Args({75, 80, 1})
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("SteadyAllocs/" + name).c_str(), BM_SteadyAllocs, name)
+            ->Unit(benchmark::kMillisecond);
+    }
+    benchmark::AddCustomContext("alloc_counting", allocation_counting_enabled() ? "on" : "off");
+    return 0;
+}
+
+static const int pipeline_benchmarks_registered = register_pipeline_benchmarks();
@@ -0,0 +1,87 @@
+// Per-request stream setup cost: opening the MP3 encoder and configuring the
+// effects graph from scratch vs. taking a pre-built pipeline from PipelinePool.
+//
+//   cmake -S . -B build -DAUDIO_BUILD_BENCH=ON && cmake --build build --target audio_bench
+//   ./build/audio_bench --benchmark_filter=PipelineSetup
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include "pipeline_pool.h"
+
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+}
+
+using namespace soundboard;
+
+// What a 44.1kHz stereo MP3 decodes to
+static AudioFormat mp3_input()
+{
+    return AudioFormat{44100, AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_STEREO, 2};
+}
+
+// Args: speed and pitch in hundredths
+static void BM_PipelineSetupFresh(benchmark::State &state)
+{
+    float speed = state.range(0) / 100.0f;
+    float pitch = state.range(1) / 100.0f;
+    for (auto _ : state)
+    {
+        StreamPipeline p;
+        std::string err;
+        if (!open_stream_pipeline(mp3_input(), speed, pitch, {}, p, err))
+        {
+            state.SkipWithError(err.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(p.graph.sink);
+        free_stream_pipeline(p);
+    }
+}
+
+static void BM_PipelineSetupPooled(benchmark::State &state)
+{
+    // Scheduled refills are run between iterations, outside the timed region,
+    // standing in for the DSP executor
+    std::vector<std::function<void()>> pending;
+    auto run_pending = [&pending]()
+    {
+        auto tasks = std::move(pending);
+        pending.clear();
+        for (auto &t : tasks)
+            t();
+    };
+    PipelinePool pool(PipelinePool::Options{}, [&pending](std::function<void()> task)
+                      { pending.push_back(std::move(task)); });
+    PipelineKey key = PipelineKey::of(mp3_input(), state.range(0) / 100.0f, state.range(1) / 100.0f);
+    pool.prewarm({key});
+    run_pending();
+
+    for (auto _ : state)
+    {
+        StreamPipeline p;
+        bool hit = false;
+        std::string err;
+        if (!pool.acquire(key, p, hit, err))
+        {
+            state.SkipWithError(err.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(p.graph.sink);
+
+        state.PauseTiming();
+        free_stream_pipeline(p);
+        run_pending();
+        state.ResumeTiming();
+    }
+    auto stats = pool.stats();
+    state.counters["hit_rate"] = double(stats.hits) / double(std::max<uint64_t>(stats.hits + stats.misses, 1));
+}
+
+BENCHMARK(BM_PipelineSetupFresh)->Args({100, 100})->Args({150, 100})->Args({100, 120})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PipelineSetupPooled)->Args({100, 100})->Args({150, 100})->Args({100, 120})->Unit(benchmark::kMicrosecond);
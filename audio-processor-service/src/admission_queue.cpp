@@ -0,0 +1,137 @@
+#include "admission_queue.h"
+#include <algorithm>
+
+namespace soundboard
+{
+
+    AdmissionQueue::AdmissionQueue(const Limits &limits)
+        : limits_(limits)
+    {
+        limits_.total = std::max(1, limits_.total);
+        for (auto &limit : limits_.per_method)
+        {
+            if (limit <= 0 || limit > limits_.total)
+                limit = limits_.total;
+        }
+    }
+
+    const char *AdmissionQueue::method_name(Method method)
+    {
+        switch (method)
+        {
+        case Method::EXTRACT_AUDIO:
+            return "ExtractAudio";
+        case Method::APPLY_EFFECTS:
+            return "ApplyEffectsStream";
+        default:
+            return "unknown";
+        }
+    }
+
+    bool AdmissionQueue::can_admit_locked(Method method) const
+    {
+        size_t m = static_cast<size_t>(method);
+        return stats_.in_use < limits_.total &&
+               stats_.in_use_by_method[m] < limits_.per_method[m];
+    }
+
+    void AdmissionQueue::take_permit_locked(Method method)
+    {
+        stats_.in_use++;
+        stats_.in_use_by_method[static_cast<size_t>(method)]++;
+        stats_.admitted++;
+    }
+
+    void AdmissionQueue::record_wait_locked(const Ticket &ticket)
+    {
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - ticket.enqueued_at)
+                          .count();
+        uint64_t us = static_cast<uint64_t>(std::max<int64_t>(0, waited));
+        stats_.wait_count++;
+        stats_.wait_us_total += us;
+        stats_.wait_us_max = std::max(stats_.wait_us_max, us);
+    }
+
+    AdmissionQueue::Result AdmissionQueue::try_acquire(Ticket &ticket)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+
+        // Waiters left in the queue are all blocked by their own method limit,
+        // so taking a free permit here does not jump an eligible waiter.
+        if (can_admit_locked(ticket.method))
+        {
+            take_permit_locked(ticket.method);
+            ticket.state = Ticket::State::GRANTED;
+            return Result::ADMITTED;
+        }
+
+        if (waiters_.size() >= limits_.max_queued || limits_.max_wait.count() <= 0)
+        {
+            stats_.rejected_full++;
+            return Result::REJECTED;
+        }
+
+        ticket.state = Ticket::State::WAITING;
+        ticket.enqueued_at = std::chrono::steady_clock::now();
+        waiters_.push_back(&ticket);
+        stats_.queued++;
+        stats_.queue_depth = waiters_.size();
+        stats_.max_queue_depth = std::max(stats_.max_queue_depth, waiters_.size());
+        if (ticket.on_park)
+            ticket.on_park();
+        return Result::QUEUED;
+    }
+
+    bool AdmissionQueue::resolve(Ticket &ticket)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (ticket.state == Ticket::State::GRANTED)
+            return true;
+
+        auto it = std::find(waiters_.begin(), waiters_.end(), &ticket);
+        if (it != waiters_.end())
+            waiters_.erase(it);
+        ticket.state = Ticket::State::IDLE;
+        stats_.queue_depth = waiters_.size();
+        stats_.timed_out++;
+        record_wait_locked(ticket);
+        return false;
+    }
+
+    void AdmissionQueue::release(Method method)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stats_.in_use = std::max(0, stats_.in_use - 1);
+        auto &by_method = stats_.in_use_by_method[static_cast<size_t>(method)];
+        by_method = std::max(0, by_method - 1);
+
+        // Grant the oldest waiter(s) that fit; on_grant runs under the lock so the
+        // waiter cannot observe GRANTED (and move on) before its wake-up is issued.
+        for (auto it = waiters_.begin(); it != waiters_.end();)
+        {
+            Ticket *t = *it;
+            if (!can_admit_locked(t->method))
+            {
+                ++it;
+                continue;
+            }
+            it = waiters_.erase(it);
+            take_permit_locked(t->method);
+            t->state = Ticket::State::GRANTED;
+            record_wait_locked(*t);
+            if (t->on_grant)
+                t->on_grant();
+            if (stats_.in_use >= limits_.total)
+                break;
+        }
+        stats_.queue_depth = waiters_.size();
+    }
+
+    AdmissionQueue::Stats AdmissionQueue::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return stats_;
+    }
+
+}
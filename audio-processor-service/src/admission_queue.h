@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace soundboard
+{
+
+    /**
+     * Non-blocking admission control for RPC handlers.
+     *
+     * A call either gets a permit immediately, is parked in a bounded FIFO, or is
+     * rejected when the FIFO is full. Parked calls never block a thread: the
+     * handler arms a deadline alarm and returns to its completion queue. When a
+     * permit frees, release() grants the oldest eligible waiter and invokes its
+     * on_grant callback (typically cancelling the alarm so the tag fires early).
+     *
+     * Limits apply both globally and per method, so a burst of uploads cannot
+     * starve playback streams or vice versa.
+     */
+    class AdmissionQueue
+    {
+    public:
+        enum class Method
+        {
+            EXTRACT_AUDIO,
+            APPLY_EFFECTS,
+            COUNT
+        };
+        static constexpr size_t kMethodCount = static_cast<size_t>(Method::COUNT);
+
+        struct Limits
+        {
+            int total = 1;                                  // permits across all methods
+            std::array<int, kMethodCount> per_method{};     // 0 = same as total
+            size_t max_queued = 0;                          // 0 = never queue, reject immediately
+            std::chrono::milliseconds max_wait{0};          // queue-time deadline
+        };
+
+        struct Ticket
+        {
+            Method method = Method::EXTRACT_AUDIO;
+            // Both callbacks run with the queue lock held and must not re-enter the queue.
+            // on_park fires when the ticket is queued (arm the deadline alarm here, so a
+            // grant can never race ahead of it); on_grant fires when a parked ticket wins a permit.
+            std::function<void()> on_park;
+            std::function<void()> on_grant;
+
+        private:
+            friend class AdmissionQueue;
+            enum class State { IDLE, WAITING, GRANTED } state = State::IDLE;
+            std::chrono::steady_clock::time_point enqueued_at;
+        };
+
+        enum class Result
+        {
+            ADMITTED,
+            QUEUED,
+            REJECTED
+        };
+
+        struct Stats
+        {
+            int in_use = 0;
+            std::array<int, kMethodCount> in_use_by_method{};
+            size_t queue_depth = 0;
+            size_t max_queue_depth = 0;
+            uint64_t admitted = 0;      // immediately or after queueing
+            uint64_t queued = 0;        // calls that had to wait
+            uint64_t rejected_full = 0; // queue was full on arrival
+            uint64_t timed_out = 0;     // deadline passed while queued
+            uint64_t wait_count = 0;
+            uint64_t wait_us_total = 0;
+            uint64_t wait_us_max = 0;
+        };
+
+        explicit AdmissionQueue(const Limits &limits);
+
+        /**
+         * Try to take a permit for ticket.method.
+         * @return ADMITTED (permit held), QUEUED (on_park has run; wait for on_grant or the
+         *         deadline, then call resolve()), or REJECTED (queue full)
+         */
+        Result try_acquire(Ticket &ticket);
+
+        /**
+         * Resolve a parked ticket after its deadline alarm fired.
+         * @return true if the ticket now holds a permit (it was granted), false if it was
+         *         still waiting and has been removed from the queue (timed out)
+         */
+        bool resolve(Ticket &ticket);
+
+        // Return a permit and hand it to the oldest eligible waiter, if any
+        void release(Method method);
+
+        std::chrono::milliseconds max_wait() const { return limits_.max_wait; }
+        Stats stats() const;
+
+        static const char *method_name(Method method);
+
+    private:
+        bool can_admit_locked(Method method) const;
+        void take_permit_locked(Method method);
+        void record_wait_locked(const Ticket &ticket);
+
+        Limits limits_;
+        mutable std::mutex mu_;
+        std::deque<Ticket *> waiters_;
+        Stats stats_;
+    };
+
+}
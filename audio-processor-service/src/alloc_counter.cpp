@@ -0,0 +1,87 @@
+#include "alloc_counter.h"
+
+#ifdef AUDIO_COUNT_ALLOCS
+#include <cerrno>
+#include <cstddef>
+
+// glibc's real allocator entry points; the executable's definitions below take
+// precedence over libc's for every caller, including the FFmpeg shared libraries
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t n, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *ptr);
+}
+
+// Plain zero-initialised TLS: touching it never allocates
+static thread_local uint64_t tls_allocations = 0;
+
+extern "C"
+{
+    void *malloc(size_t size)
+    {
+        ++tls_allocations;
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t n, size_t size)
+    {
+        ++tls_allocations;
+        return __libc_calloc(n, size);
+    }
+
+    void *realloc(void *ptr, size_t size)
+    {
+        ++tls_allocations;
+        return __libc_realloc(ptr, size);
+    }
+
+    void *memalign(size_t alignment, size_t size)
+    {
+        ++tls_allocations;
+        return __libc_memalign(alignment, size);
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size)
+    {
+        ++tls_allocations;
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void **out, size_t alignment, size_t size)
+    {
+        ++tls_allocations;
+        void *p = __libc_memalign(alignment, size);
+        if (!p)
+            return ENOMEM;
+        *out = p;
+        return 0;
+    }
+
+    void free(void *ptr)
+    {
+        __libc_free(ptr);
+    }
+}
+
+namespace soundboard
+{
+    uint64_t thread_allocations()
+    {
+        return tls_allocations;
+    }
+}
+
+#else
+
+namespace soundboard
+{
+    uint64_t thread_allocations()
+    {
+        return 0;
+    }
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace soundboard
+{
+
+    /**
+     * Heap allocations made so far by the calling thread: the whole malloc family,
+     * which also covers operator new and FFmpeg's av_malloc. Counting is a build
+     * option (-DAUDIO_COUNT_ALLOCS=ON interposes malloc); otherwise this is always 0.
+     *
+     * Take the difference around a unit of work to see what it allocated.
+     */
+    uint64_t thread_allocations();
+
+    constexpr bool allocation_counting_enabled()
+    {
+#ifdef AUDIO_COUNT_ALLOCS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+}
@@ -0,0 +1,218 @@
+#include "audio_info.h"
+#include "av_error.h"
+#include "mapped_input.h"
+#include "mp3_probe.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <mutex>
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavutil/error.h>
+}
+
+namespace soundboard
+{
+
+    // Budget for avformat_find_stream_info when the headers alone aren't enough
+    static constexpr int64_t kProbeSizeBytes = 256 * 1024;
+    static constexpr int64_t kAnalyzeDurationUs = 1000000;
+
+    // Everything we report, taken from whatever the demuxer has filled in so far
+    static void fill_from_format(const AVFormatContext *fmt, const AVStream *st, AudioInfo &info)
+    {
+        info.sample_rate = st->codecpar->sample_rate;
+        info.channels = st->codecpar->channels;
+
+        int64_t bit_rate = st->codecpar->bit_rate > 0 ? st->codecpar->bit_rate : fmt->bit_rate;
+        info.bitrate_kbps = static_cast<int>(std::max<int64_t>(bit_rate, 0) / 1000);
+
+        if (fmt->duration != AV_NOPTS_VALUE && fmt->duration > 0)
+            info.duration_seconds = double(fmt->duration) / AV_TIME_BASE;
+        else if (st->duration != AV_NOPTS_VALUE && st->duration > 0)
+            info.duration_seconds = double(st->duration) * av_q2d(st->time_base);
+        else
+            info.duration_seconds = 0.0;
+
+        // "mov,mp4,m4a,3gp,3g2,mj2" -> "mov"
+        std::string name = fmt->iformat && fmt->iformat->name ? fmt->iformat->name : "";
+        info.format = name.substr(0, name.find(','));
+    }
+
+    static bool probe_with_libav(const std::string &path, AudioInfo &info, std::string &error_out)
+    {
+        AVFormatContext *fmt = avformat_alloc_context();
+        if (!fmt)
+        {
+            error_out = "failed to alloc format context";
+            return false;
+        }
+        fmt->probesize = kProbeSizeBytes;
+        fmt->max_analyze_duration = kAnalyzeDurationUs;
+
+        // On failure open_format_input frees fmt
+        if (int ret = open_format_input(&fmt, path))
+        {
+            error_out = "open_format_input: " + av_err_to_string(ret);
+            return false;
+        }
+
+        // Most containers describe their streams in the header; only analyze packets if they don't
+        int idx = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        bool complete = idx >= 0 && fmt->streams[idx]->codecpar->sample_rate > 0 &&
+                        fmt->streams[idx]->codecpar->channels > 0 && fmt->duration != AV_NOPTS_VALUE;
+        if (!complete)
+        {
+            if (int ret = avformat_find_stream_info(fmt, nullptr))
+            {
+                error_out = "avformat_find_stream_info: " + av_err_to_string(ret);
+                close_format_input(&fmt);
+                return false;
+            }
+            idx = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        }
+        if (idx < 0)
+        {
+            error_out = "no audio stream";
+            close_format_input(&fmt);
+            return false;
+        }
+
+        fill_from_format(fmt, fmt->streams[idx], info);
+        close_format_input(&fmt);
+        return true;
+    }
+
+    // Name ends in ".mp3" (any case)
+    static bool has_mp3_extension(const std::string &path)
+    {
+        static constexpr char kExt[] = ".mp3";
+        constexpr size_t n = sizeof(kExt) - 1;
+        if (path.size() < n)
+            return false;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (std::tolower(static_cast<unsigned char>(path[path.size() - n + i])) != kExt[i])
+                return false;
+        }
+        return true;
+    }
+
+    bool probe_audio_info(const std::string &path, AudioInfo &info, std::string &error_out)
+    {
+        // Fast path: an MP3's first frame header (and Xing/VBRI tag) has everything.
+        // Only for .mp3 names: other containers (MP4, OGG) can hold bytes that look like
+        // MPEG frames, and are reported by libavformat as what they are.
+        Mp3StreamInfo mp3;
+        std::string mp3_err;
+        if (has_mp3_extension(path) && probe_mp3_file(path, mp3, mp3_err) && mp3.duration_seconds > 0.0)
+        {
+            info.duration_seconds = mp3.duration_seconds;
+            info.sample_rate = mp3.sample_rate;
+            info.channels = mp3.channels;
+            info.bitrate_kbps = mp3.bitrate_kbps;
+            info.format = "mp3";
+            return true;
+        }
+        return probe_with_libav(path, info, error_out);
+    }
+
+    // ============================================================================
+    // AudioInfoCache
+    // ============================================================================
+
+    AudioInfoCache::AudioInfoCache(size_t max_entries)
+        : max_per_shard_(std::max<size_t>(max_entries / kShards, 1)) {}
+
+    AudioInfoCache::Shard &AudioInfoCache::shard_for(const std::string &path)
+    {
+        return shards_[std::hash<std::string>{}(path) % kShards];
+    }
+
+    bool AudioInfoCache::find_stamped(const std::string &path, const FileStamp &stamp, AudioInfo &out)
+    {
+        Shard &shard = shard_for(path);
+        std::shared_lock<std::shared_mutex> lock(shard.mu);
+        auto it = shard.entries.find(path);
+        if (it == shard.entries.end() || !(it->second.stamp == stamp))
+            return false;
+        out = it->second.info;
+        return true;
+    }
+
+    void AudioInfoCache::insert(const std::string &path, const FileStamp &stamp, const AudioInfo &info)
+    {
+        Shard &shard = shard_for(path);
+        std::unique_lock<std::shared_mutex> lock(shard.mu);
+        auto it = shard.entries.find(path);
+        if (it != shard.entries.end())
+        {
+            it->second.stamp = stamp;
+            it->second.info = info;
+            return;
+        }
+
+        while (shard.entries.size() >= max_per_shard_ && !shard.order.empty())
+        {
+            shard.entries.erase(shard.order.front());
+            shard.order.pop_front();
+        }
+        shard.order.push_back(path);
+        shard.entries.emplace(path, Entry{stamp, info});
+    }
+
+    bool AudioInfoCache::find(const std::string &path, AudioInfo &out)
+    {
+        FileStamp stamp;
+        if (!FileIdentity::of(path, stamp) || !find_stamped(path, stamp, out))
+            return false;
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    AudioInfoCache::Result AudioInfoCache::get(const std::string &path, AudioInfo &out, std::string &error_out)
+    {
+        FileStamp stamp;
+        if (!FileIdentity::of(path, stamp))
+        {
+            error_out = "file not found";
+            return Result::NOT_FOUND;
+        }
+        if (find_stamped(path, stamp, out))
+        {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return Result::OK;
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        if (!probe_audio_info(path, out, error_out))
+            return Result::PROBE_FAILED;
+        // Stored under the pre-probe stamp: if the file changed meanwhile, the next lookup re-probes
+        insert(path, stamp, out);
+        return Result::OK;
+    }
+
+    void AudioInfoCache::put(const std::string &path, const AudioInfo &info)
+    {
+        FileStamp stamp;
+        if (FileIdentity::of(path, stamp))
+            insert(path, stamp, info);
+    }
+
+    AudioInfoCache::Stats AudioInfoCache::stats() const
+    {
+        Stats s;
+        s.hits = hits_.load(std::memory_order_relaxed);
+        s.misses = misses_.load(std::memory_order_relaxed);
+        for (const auto &shard : shards_)
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mu);
+            s.entries += shard.entries.size();
+        }
+        return s;
+    }
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include "file_identity.h"
+
+namespace soundboard
+{
+
+    /**
+     * Basic stream parameters of an audio (or audio+video) file, as returned by GetAudioInfo.
+     */
+    struct AudioInfo
+    {
+        double duration_seconds = 0.0;
+        int sample_rate = 0;
+        int channels = 0;
+        int bitrate_kbps = 0;
+        std::string format; // demuxer short name, e.g. "mp3", "ogg", "mov"
+    };
+
+    /**
+     * Cheap probe: .mp3 files are read from their frame/Xing headers alone (mp3_probe);
+     * anything else is opened with libavformat, and avformat_find_stream_info only
+     * runs (with a small probe budget) when the container headers leave gaps.
+     *
+     * @param path Path to the file
+     * @param info Filled in on success
+     * @param error_out Reason on failure
+     * @return true if the file has an audio stream that could be described
+     */
+    bool probe_audio_info(const std::string &path, AudioInfo &info, std::string &error_out);
+
+    /**
+     * Concurrent path -> AudioInfo cache. Entries are validated against the file's
+     * identity (dev, inode, size, mtime) on every lookup, so a replaced file is
+     * re-probed. Sharded with a shared lock per shard; each shard evicts its
+     * oldest entry when full.
+     */
+    class AudioInfoCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            size_t entries = 0;
+        };
+
+        explicit AudioInfoCache(size_t max_entries);
+
+        /**
+         * Cached info for path if the file is unchanged; never probes.
+         * @return false on a miss (or if the file can't be stat()ed)
+         */
+        bool find(const std::string &path, AudioInfo &out);
+
+        enum class Result
+        {
+            OK,
+            NOT_FOUND,   // file can't be stat()ed
+            PROBE_FAILED // see error_out
+        };
+
+        /**
+         * find(), else probe the file and remember the result.
+         */
+        Result get(const std::string &path, AudioInfo &out, std::string &error_out);
+
+        /**
+         * Record info for a file the caller just wrote (e.g. ExtractAudio output),
+         * so the first GetAudioInfo for it is already a hit.
+         */
+        void put(const std::string &path, const AudioInfo &info);
+
+        Stats stats() const;
+
+    private:
+        using FileStamp = FileIdentity;
+
+        struct Entry
+        {
+            FileStamp stamp;
+            AudioInfo info;
+        };
+
+        struct Shard
+        {
+            mutable std::shared_mutex mu;
+            std::unordered_map<std::string, Entry> entries;
+            std::list<std::string> order; // insertion order, oldest first
+        };
+
+        static constexpr size_t kShards = 16;
+
+        Shard &shard_for(const std::string &path);
+        bool find_stamped(const std::string &path, const FileStamp &stamp, AudioInfo &out);
+        void insert(const std::string &path, const FileStamp &stamp, const AudioInfo &info);
+
+        size_t max_per_shard_;
+        std::array<Shard, kShards> shards_;
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> misses_{0};
+    };
+
+}
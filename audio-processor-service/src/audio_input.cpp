@@ -0,0 +1,111 @@
+#include "audio_input.h"
+#include "av_error.h"
+#include "mapped_input.h"
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/error.h>
+}
+
+namespace soundboard
+{
+
+    // fast_probe budget: a few MP3 frames, plenty to sync on the first header
+    static constexpr int64_t kFastProbeBytes = 32 * 1024;
+    static constexpr int64_t kFastAnalyzeDurationUs = 100000;
+
+    static int find_audio_stream(const AVFormatContext *fmt)
+    {
+        for (unsigned i = 0; i < fmt->nb_streams; ++i)
+        {
+            if (fmt->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    bool open_audio_input(const std::string &path, const AudioInputOptions &options, AudioInput &out,
+                          std::string &error_out)
+    {
+        AVFormatContext *fmt = avformat_alloc_context();
+        if (!fmt)
+        {
+            error_out = "failed to alloc format context";
+            return false;
+        }
+        if (options.fast_probe)
+        {
+            fmt->probesize = kFastProbeBytes;
+            fmt->max_analyze_duration = kFastAnalyzeDurationUs;
+        }
+
+        // On failure open_format_input frees fmt
+        if (int ret = open_format_input(&fmt, path))
+        {
+            error_out = "open_format_input: " + av_err_to_string(ret);
+            return false;
+        }
+
+        int idx = find_audio_stream(fmt);
+        bool complete = idx >= 0 && fmt->streams[idx]->codecpar->codec_id != AV_CODEC_ID_NONE &&
+                        fmt->streams[idx]->codecpar->sample_rate > 0 && fmt->streams[idx]->codecpar->channels > 0;
+        if (!options.fast_probe || !complete)
+        {
+            if (int ret = avformat_find_stream_info(fmt, nullptr))
+            {
+                error_out = "avformat_find_stream_info: " + av_err_to_string(ret);
+                close_format_input(&fmt);
+                return false;
+            }
+            idx = find_audio_stream(fmt);
+        }
+        if (idx < 0)
+        {
+            error_out = "no audio stream";
+            close_format_input(&fmt);
+            return false;
+        }
+
+        const AVCodec *dec = avcodec_find_decoder(fmt->streams[idx]->codecpar->codec_id);
+        if (!dec)
+        {
+            error_out = "decoder not found";
+            close_format_input(&fmt);
+            return false;
+        }
+
+        AVCodecContext *dec_ctx = avcodec_alloc_context3(dec);
+        if (!dec_ctx)
+        {
+            error_out = "failed to alloc decoder";
+            close_format_input(&fmt);
+            return false;
+        }
+        avcodec_parameters_to_context(dec_ctx, fmt->streams[idx]->codecpar);
+        if (int ret = avcodec_open2(dec_ctx, dec, nullptr))
+        {
+            error_out = "avcodec_open2: " + av_err_to_string(ret);
+            avcodec_free_context(&dec_ctx);
+            close_format_input(&fmt);
+            return false;
+        }
+
+        out.fmt = fmt;
+        out.dec_ctx = dec_ctx;
+        out.stream_index = idx;
+        return true;
+    }
+
+    void close_audio_input(AudioInput &input)
+    {
+        if (input.dec_ctx)
+            avcodec_free_context(&input.dec_ctx);
+        if (input.fmt)
+            close_format_input(&input.fmt);
+        input.stream_index = -1;
+    }
+
+}
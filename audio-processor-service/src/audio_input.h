@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+struct AVFormatContext;
+struct AVCodecContext;
+
+namespace soundboard
+{
+
+    /**
+     * A demuxer positioned at the start of a file plus an opened decoder for its
+     * first audio stream.
+     */
+    struct AudioInput
+    {
+        AVFormatContext *fmt = nullptr;
+        AVCodecContext *dec_ctx = nullptr;
+        int stream_index = -1;
+    };
+
+    struct AudioInputOptions
+    {
+        // Small probe budget, and no avformat_find_stream_info when the container
+        // header already gives codec, rate and channels. Meant for inputs known to be
+        // plain MP3, where the default 5 MB / 5 s analysis only delays the first frame.
+        bool fast_probe = false;
+    };
+
+    /**
+     * Open path and its decoder.
+     * @return false on failure (error_out names the failing step; nothing to free)
+     */
+    bool open_audio_input(const std::string &path, const AudioInputOptions &options, AudioInput &out,
+                          std::string &error_out);
+
+    void close_audio_input(AudioInput &input);
+
+}
@@ -0,0 +1,563 @@
+#include "audio_pipeline.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "av_error.h"
+#include "mapped_input.h"
+#include "pcm_cache.h"
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavfilter/buffersink.h>
+#include <libavformat/avformat.h>
+#include <libavutil/buffer.h>
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/samplefmt.h>
+}
+
+namespace soundboard
+{
+
+    // Drop the first n samples of a decoded audio frame in place (pointer adjustment, no copy)
+    static void drop_leading_samples(AVFrame *frame, int n)
+    {
+        n = std::min(n, frame->nb_samples);
+        if (n <= 0)
+            return;
+        AVSampleFormat fmt = static_cast<AVSampleFormat>(frame->format);
+        int bytes = av_get_bytes_per_sample(fmt);
+        bool planar = av_sample_fmt_is_planar(fmt);
+        int planes = planar ? frame->channels : 1;
+        int offset = planar ? n * bytes : n * bytes * frame->channels;
+        for (int i = 0; i < planes; ++i)
+        {
+            frame->extended_data[i] += offset;
+            if (frame->extended_data != frame->data && i < AV_NUM_DATA_POINTERS)
+                frame->data[i] += offset;
+        }
+        frame->nb_samples -= n;
+    }
+
+    // ============================================================================
+    // Demuxer
+    // ============================================================================
+
+    Demuxer::Demuxer(AVFormatContext *fmt, int stream_index) : fmt_(fmt), stream_index_(stream_index) {}
+
+    Demuxer::~Demuxer()
+    {
+        reset();
+    }
+
+    Demuxer::Demuxer(Demuxer &&o) noexcept
+        : fmt_(std::exchange(o.fmt_, nullptr)), stream_index_(std::exchange(o.stream_index_, -1)) {}
+
+    Demuxer &Demuxer::operator=(Demuxer &&o) noexcept
+    {
+        if (this != &o)
+        {
+            reset();
+            fmt_ = std::exchange(o.fmt_, nullptr);
+            stream_index_ = std::exchange(o.stream_index_, -1);
+        }
+        return *this;
+    }
+
+    void Demuxer::reset()
+    {
+        if (fmt_)
+            close_format_input(&fmt_);
+        stream_index_ = -1;
+    }
+
+    int Demuxer::read(AVPacket *pkt)
+    {
+        while (true)
+        {
+            int ret = av_read_frame(fmt_, pkt);
+            if (ret < 0 || pkt->stream_index == stream_index_)
+                return ret;
+            av_packet_unref(pkt);
+        }
+    }
+
+    int Demuxer::seek(double seconds)
+    {
+        AVStream *st = fmt_->streams[stream_index_];
+        int64_t origin = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+        int64_t ts = origin + av_rescale_q(std::llround(seconds * AV_TIME_BASE), AV_TIME_BASE_Q, st->time_base);
+        return av_seek_frame(fmt_, stream_index_, ts, AVSEEK_FLAG_BACKWARD);
+    }
+
+    int64_t Demuxer::sample_position(const AVFrame *frame, int64_t fallback) const
+    {
+        if (frame->best_effort_timestamp == AV_NOPTS_VALUE)
+            return fallback;
+        AVStream *st = fmt_->streams[stream_index_];
+        int64_t origin = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+        return av_rescale_q(frame->best_effort_timestamp - origin, st->time_base, AVRational{1, frame->sample_rate});
+    }
+
+    // ============================================================================
+    // Decoder
+    // ============================================================================
+
+    Decoder::Decoder(AVCodecContext *ctx) : ctx_(ctx) {}
+
+    Decoder::~Decoder()
+    {
+        avcodec_free_context(&ctx_);
+    }
+
+    Decoder::Decoder(Decoder &&o) noexcept : ctx_(std::exchange(o.ctx_, nullptr)) {}
+
+    Decoder &Decoder::operator=(Decoder &&o) noexcept
+    {
+        if (this != &o)
+        {
+            avcodec_free_context(&ctx_);
+            ctx_ = std::exchange(o.ctx_, nullptr);
+        }
+        return *this;
+    }
+
+    int Decoder::send(const AVPacket *pkt)
+    {
+        return avcodec_send_packet(ctx_, pkt);
+    }
+
+    int Decoder::receive(AVFrame *frame)
+    {
+        return avcodec_receive_frame(ctx_, frame);
+    }
+
+    bool open_decoder_input(const std::string &path, const AudioInputOptions &options, Demuxer &demuxer,
+                            Decoder &decoder, std::string &error_out)
+    {
+        AudioInput input;
+        if (!open_audio_input(path, options, input, error_out))
+            return false;
+        demuxer = Demuxer(input.fmt, input.stream_index);
+        decoder = Decoder(input.dec_ctx);
+        return true;
+    }
+
+    // ============================================================================
+    // FilterChain
+    // ============================================================================
+
+    FilterChain::FilterChain(const EffectsGraph &graph) : graph_(graph) {}
+
+    FilterChain::~FilterChain()
+    {
+        free_effects_graph(graph_);
+    }
+
+    FilterChain::FilterChain(FilterChain &&o) noexcept : graph_(std::exchange(o.graph_, EffectsGraph{})) {}
+
+    FilterChain &FilterChain::operator=(FilterChain &&o) noexcept
+    {
+        if (this != &o)
+        {
+            free_effects_graph(graph_);
+            graph_ = std::exchange(o.graph_, EffectsGraph{});
+        }
+        return *this;
+    }
+
+    int FilterChain::push(AVFrame *frame)
+    {
+        return push_effects_frame(graph_, frame);
+    }
+
+    int FilterChain::pull(AVFrame *frame)
+    {
+        return av_buffersink_get_frame(graph_.sink, frame);
+    }
+
+    // ============================================================================
+    // Encoder
+    // ============================================================================
+
+    Encoder::Encoder(AVCodecContext *ctx, AVBufferPool *packet_pool) : ctx_(ctx), packet_pool_(packet_pool) {}
+
+    Encoder::~Encoder()
+    {
+        reset();
+    }
+
+    Encoder::Encoder(Encoder &&o) noexcept
+        : ctx_(std::exchange(o.ctx_, nullptr)), packet_pool_(std::exchange(o.packet_pool_, nullptr)) {}
+
+    Encoder &Encoder::operator=(Encoder &&o) noexcept
+    {
+        if (this != &o)
+        {
+            reset();
+            ctx_ = std::exchange(o.ctx_, nullptr);
+            packet_pool_ = std::exchange(o.packet_pool_, nullptr);
+        }
+        return *this;
+    }
+
+    void Encoder::reset()
+    {
+        avcodec_free_context(&ctx_);
+        if (packet_pool_)
+            av_buffer_pool_uninit(&packet_pool_);
+    }
+
+    int Encoder::sample_rate() const
+    {
+        return ctx_->sample_rate;
+    }
+
+    int Encoder::frame_size() const
+    {
+        return ctx_->frame_size;
+    }
+
+    int Encoder::send(const AVFrame *frame)
+    {
+        return avcodec_send_frame(ctx_, frame);
+    }
+
+    int Encoder::receive(AVPacket *pkt)
+    {
+        return avcodec_receive_packet(ctx_, pkt);
+    }
+
+    void adopt_stream_pipeline(StreamPipeline &pipeline, FilterChain &filters, Encoder &encoder)
+    {
+        filters = FilterChain(std::exchange(pipeline.graph, EffectsGraph{}));
+        encoder = Encoder(std::exchange(pipeline.enc_ctx, nullptr), std::exchange(pipeline.packet_pool, nullptr));
+    }
+
+    // ============================================================================
+    // ChunkSink
+    // ============================================================================
+
+    ChunkSink::ChunkSink(const Options &options) : options_(options)
+    {
+        options_.first_chunk_bytes = std::max<size_t>(options_.first_chunk_bytes, 1);
+        options_.chunk_bytes = std::max<size_t>(options_.chunk_bytes, 1);
+    }
+
+    void ChunkSink::append(std::string &chunk, const AVPacket *pkt, int64_t duration_samples)
+    {
+        if (chunk.empty())
+        {
+            batch_started_at_ = std::chrono::steady_clock::now();
+            batch_start_samples_ = encoded_samples_;
+        }
+        chunk.append(reinterpret_cast<const char *>(pkt->data), static_cast<size_t>(pkt->size));
+        encoded_samples_ += duration_samples;
+    }
+
+    // Ready once the batch reaches its target size or has waited out the latency budget
+    bool ChunkSink::ready(const std::string &chunk) const
+    {
+        if (chunk.empty())
+            return false;
+        size_t target = chunks_ > 0 ? options_.chunk_bytes : options_.first_chunk_bytes;
+        return chunk.size() >= target ||
+               std::chrono::steady_clock::now() - batch_started_at_ >= options_.max_latency;
+    }
+
+    int64_t ChunkSink::finish_chunk()
+    {
+        ++chunks_;
+        return encoded_samples_ - batch_start_samples_;
+    }
+
+    // ============================================================================
+    // AudioPipeline
+    // ============================================================================
+
+    // Attributes the wall time since the previous lap() to a stage
+    class AudioPipeline::Clock
+    {
+    public:
+        explicit Clock(std::array<int64_t, kPipelineStageCount> &stage_ns)
+            : stage_ns_(stage_ns), last_(std::chrono::steady_clock::now()) {}
+
+        void lap(PipelineStage stage)
+        {
+            auto now = std::chrono::steady_clock::now();
+            stage_ns_[static_cast<size_t>(stage)] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+            last_ = now;
+        }
+
+    private:
+        std::array<int64_t, kPipelineStageCount> &stage_ns_;
+        std::chrono::steady_clock::time_point last_;
+    };
+
+    AudioPipeline::AudioPipeline(Demuxer demuxer, Decoder decoder, FilterChain filters, Encoder encoder,
+                                 const ChunkSink::Options &chunking, const InputRange &range)
+        : demuxer_(std::move(demuxer)), decoder_(std::move(decoder)), filters_(std::move(filters)),
+          encoder_(std::move(encoder)), sink_(chunking), range_(range),
+          frame_(av_frame_alloc()), filtered_(av_frame_alloc()), in_pkt_(av_packet_alloc()), out_pkt_(av_packet_alloc())
+    {
+    }
+
+    AudioPipeline::AudioPipeline(std::shared_ptr<const DecodedClip> clip, FilterChain filters, Encoder encoder,
+                                 const ChunkSink::Options &chunking)
+        : clip_(std::move(clip)), filters_(std::move(filters)), encoder_(std::move(encoder)), sink_(chunking),
+          frame_(av_frame_alloc()), filtered_(av_frame_alloc()), in_pkt_(av_packet_alloc()), out_pkt_(av_packet_alloc())
+    {
+    }
+
+    AudioPipeline::~AudioPipeline()
+    {
+        av_frame_free(&frame_);
+        av_frame_free(&filtered_);
+        av_packet_free(&in_pkt_);
+        av_packet_free(&out_pkt_);
+    }
+
+    // Stamp a decoded frame for the graph (pts = samples pushed so far, in 1/sample_rate).
+    // For ranges, also cut the samples before the seek point and detect the end of the
+    // needed input. Returns false if the frame should not be pushed at all.
+    bool AudioPipeline::prepare_input(AVFrame *frame)
+    {
+        if (demuxer_ && (range_.start_sample > 0 || range_.stop_sample > 0))
+        {
+            int64_t pos = demuxer_.sample_position(frame, next_in_sample_);
+            next_in_sample_ = pos + frame->nb_samples;
+
+            if (range_.stop_sample > 0 && pos >= range_.stop_sample)
+            {
+                input_done_ = true;
+                return false;
+            }
+            if (next_in_sample_ <= range_.start_sample)
+                return false;
+            if (pos < range_.start_sample)
+                drop_leading_samples(frame, static_cast<int>(range_.start_sample - pos));
+        }
+
+        frame->pts = graph_in_samples_;
+        graph_in_samples_ += frame->nb_samples;
+        return true;
+    }
+
+    // Move every packet the encoder has ready into the chunk; true once it should be sent
+    bool AudioPipeline::drain_encoder(std::string &chunk, Clock &clock)
+    {
+        while (encoder_.receive(out_pkt_) >= 0)
+        {
+            sink_.append(chunk, out_pkt_, out_pkt_->duration > 0 ? out_pkt_->duration : encoder_.frame_size());
+            av_packet_unref(out_pkt_);
+        }
+        clock.lap(PipelineStage::ENCODE);
+        return sink_.ready(chunk);
+    }
+
+    // Record why the stream can't go on; next_chunk() then returns FAILED
+    bool AudioPipeline::fail(const char *step, int ret)
+    {
+        error_ = std::string(step) + ": " + av_err_to_string(ret);
+        return false;
+    }
+
+    // Encode whatever the graph has ready; true when a chunk was completed. The encoder
+    // is drained after every frame, so it always accepts the next one.
+    bool AudioPipeline::encode_filtered(std::string &chunk, Clock &clock)
+    {
+        while (filters_.pull(filtered_) >= 0)
+        {
+            clock.lap(PipelineStage::FILTER);
+            filtered_->pts = out_pts_;
+            out_pts_ += filtered_->nb_samples;
+
+            int ret = encoder_.send(filtered_);
+            av_frame_unref(filtered_);
+            if (ret < 0)
+                return fail("avcodec_send_frame", ret);
+            if (drain_encoder(chunk, clock))
+                return true;
+        }
+        clock.lap(PipelineStage::FILTER);
+        return false;
+    }
+
+    // Push one decoded frame through the graph and encoder; true when a chunk was completed
+    bool AudioPipeline::push_frame(AVFrame *frame, std::string &chunk, Clock &clock)
+    {
+        int ret = filters_.push(frame);
+        av_frame_unref(frame);
+        clock.lap(PipelineStage::FILTER);
+        if (ret < 0)
+            return fail("av_buffersrc_add_frame", ret);
+        return encode_filtered(chunk, clock);
+    }
+
+    // Push every frame the decoder has ready; true when a chunk was completed, in which
+    // case the rest stay in the decoder (decoder_has_frames_) for the next call
+    bool AudioPipeline::drain_decoder(std::string &chunk, Clock &clock)
+    {
+        decoder_has_frames_ = false;
+        while (decoder_.receive(frame_) == 0)
+        {
+            clock.lap(PipelineStage::DECODE);
+            if (!prepare_input(frame_))
+            {
+                av_frame_unref(frame_);
+                continue;
+            }
+            if (push_frame(frame_, chunk, clock))
+            {
+                decoder_has_frames_ = true;
+                return true;
+            }
+            if (failed())
+                return false;
+        }
+        return false;
+    }
+
+    // Hand the demuxed packet to the decoder; false if it must wait (the decoder is full)
+    // or the stream failed. A packet the decoder rejects as corrupt is skipped, as the
+    // ffmpeg CLI does, rather than ending the stream.
+    bool AudioPipeline::send_packet()
+    {
+        int ret = decoder_.send(in_pkt_);
+        if (ret == AVERROR(EAGAIN))
+        {
+            decoder_has_frames_ = true;
+            return false;
+        }
+        av_packet_unref(in_pkt_);
+        packet_pending_ = false;
+        if (ret < 0 && ret != AVERROR_INVALIDDATA)
+            return fail("avcodec_send_packet", ret);
+        return true;
+    }
+
+    AudioPipeline::Result AudioPipeline::next_chunk(std::string &chunk, int64_t &chunk_samples, const Budget &budget)
+    {
+        Clock clock(stage_ns_);
+
+        // Each pass demuxes at most one packet (or takes one cached frame) and pushes what
+        // it yields through the filters and encoder. Passes repeat until a chunk is ready or
+        // the stream ends, but a stretch with no output (atempo/rubberband priming, long
+        // silences trimmed away) is cut off at the budget and resumed on the next call.
+        for (int packets = 1;; ++packets)
+        {
+            bool got_output = false;
+
+            // Phase 1: read and decode one packet (for a hot clip, its next cached frame)
+            if (!decoder_flushed_ && clip_)
+            {
+                if (clip_->frame(clip_frame_, frame_))
+                {
+                    ++clip_frame_;
+                    prepare_input(frame_);
+                    got_output = push_frame(frame_, chunk, clock);
+                }
+                else
+                {
+                    decoder_flushed_ = true;
+                }
+            }
+            else if (!decoder_flushed_)
+            {
+                // Frames left over from a packet that completed the last chunk go first,
+                // or the decoder would refuse the next packet
+                if (decoder_has_frames_)
+                    got_output = drain_decoder(chunk, clock);
+
+                if (!got_output && !failed() && !packet_pending_)
+                {
+                    // A range stops reading once its input (plus tail margin) has been decoded
+                    int read_ret = input_done_ ? AVERROR_EOF : demuxer_.read(in_pkt_);
+                    clock.lap(PipelineStage::DEMUX);
+
+                    if (read_ret >= 0)
+                    {
+                        packet_pending_ = true;
+                    }
+                    else
+                    {
+                        // End of input: start draining the decoder
+                        decoder_flushed_ = true;
+                        decoder_.send(nullptr);
+                    }
+                }
+
+                // A packet the decoder wasn't ready for is retried after the next drain
+                if (!got_output && packet_pending_ && send_packet())
+                    got_output = drain_decoder(chunk, clock);
+            }
+            if (failed())
+                return Result::FAILED;
+
+            // Phase 2: drain the decoder, then flush the graph
+            if (!got_output && decoder_flushed_ && !filter_flushed_)
+            {
+                if (decoder_)
+                    got_output = drain_decoder(chunk, clock);
+                if (failed())
+                    return Result::FAILED;
+
+                if (!got_output)
+                {
+                    filter_flushed_ = true;
+                    if (int ret = filters_.push(nullptr); ret < 0)
+                    {
+                        fail("av_buffersrc_add_frame", ret);
+                        return Result::FAILED;
+                    }
+                }
+            }
+
+            // Phase 3: drain the graph, then flush the encoder
+            if (!got_output && filter_flushed_ && !encoder_flushed_)
+            {
+                if (encode_filtered(chunk, clock))
+                {
+                    got_output = true;
+                }
+                else if (failed())
+                {
+                    return Result::FAILED;
+                }
+                else
+                {
+                    encoder_flushed_ = true;
+                    if (int ret = encoder_.send(nullptr); ret < 0)
+                    {
+                        fail("avcodec_send_frame", ret);
+                        return Result::FAILED;
+                    }
+                }
+            }
+
+            // Phase 4: drain the encoder; whatever is left goes out as the final (possibly short) chunk
+            if (!got_output && encoder_flushed_)
+            {
+                drain_encoder(chunk, clock);
+                if (chunk.empty())
+                    return Result::DONE;
+                got_output = true;
+            }
+
+            if (got_output)
+            {
+                chunk_samples = sink_.finish_chunk();
+                return Result::CHUNK;
+            }
+
+            // Every phase from decoder flush on ends in a chunk or the end of the stream,
+            // so this only happens while reading
+            if (packets >= budget.max_packets || std::chrono::steady_clock::now() >= budget.deadline)
+                return Result::YIELD;
+        }
+    }
+
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "audio_input.h"
+#include "effects_graph.h"
+#include "pipeline_pool.h"
+
+struct AVBufferPool;
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+
+namespace soundboard
+{
+
+    class DecodedClip;
+
+    // ============================================================================
+    // Stages: each owns its FFmpeg state and frees it on destruction. Move-only.
+    // ============================================================================
+
+    /**
+     * Demuxer over one audio stream of a file.
+     */
+    class Demuxer
+    {
+    public:
+        Demuxer() = default;
+        Demuxer(AVFormatContext *fmt, int stream_index); // takes ownership
+        ~Demuxer();
+
+        Demuxer(Demuxer &&o) noexcept;
+        Demuxer &operator=(Demuxer &&o) noexcept;
+        Demuxer(const Demuxer &) = delete;
+        Demuxer &operator=(const Demuxer &) = delete;
+
+        explicit operator bool() const { return fmt_ != nullptr; }
+        AVFormatContext *get() const { return fmt_; }
+        int stream_index() const { return stream_index_; }
+
+        /**
+         * Next packet of the audio stream; packets of other streams are skipped.
+         * @return 0, AVERROR_EOF at the end, or another negative AVERROR
+         */
+        int read(AVPacket *pkt);
+
+        /**
+         * Seek to the packet at or before `seconds` into the stream.
+         * @return 0 or a negative AVERROR
+         */
+        int seek(double seconds);
+
+        /**
+         * Input sample position of a decoded frame, at the frame's rate, from its
+         * timestamp; `fallback` when it has none.
+         */
+        int64_t sample_position(const AVFrame *frame, int64_t fallback) const;
+
+    private:
+        void reset();
+
+        AVFormatContext *fmt_ = nullptr;
+        int stream_index_ = -1;
+    };
+
+    class Decoder
+    {
+    public:
+        Decoder() = default;
+        explicit Decoder(AVCodecContext *ctx); // takes ownership
+        ~Decoder();
+
+        Decoder(Decoder &&o) noexcept;
+        Decoder &operator=(Decoder &&o) noexcept;
+        Decoder(const Decoder &) = delete;
+        Decoder &operator=(const Decoder &) = delete;
+
+        explicit operator bool() const { return ctx_ != nullptr; }
+        AVCodecContext *get() const { return ctx_; }
+        AudioFormat format() const { return AudioFormat::of(ctx_); }
+
+        int send(const AVPacket *pkt); // nullptr starts draining
+        int receive(AVFrame *frame);
+
+    private:
+        AVCodecContext *ctx_ = nullptr;
+    };
+
+    /**
+     * Demuxer and decoder for path's first audio stream (see open_audio_input).
+     * @return false on failure (error_out names the failing step; both stay empty)
+     */
+    bool open_decoder_input(const std::string &path, const AudioInputOptions &options, Demuxer &demuxer,
+                            Decoder &decoder, std::string &error_out);
+
+    /**
+     * An effects graph (see build_effects_graph).
+     */
+    class FilterChain
+    {
+    public:
+        FilterChain() = default;
+        explicit FilterChain(const EffectsGraph &graph); // takes ownership
+        ~FilterChain();
+
+        FilterChain(FilterChain &&o) noexcept;
+        FilterChain &operator=(FilterChain &&o) noexcept;
+        FilterChain(const FilterChain &) = delete;
+        FilterChain &operator=(const FilterChain &) = delete;
+
+        const EffectsGraph &graph() const { return graph_; }
+
+        int push(AVFrame *frame); // nullptr flushes; the frame's buffers are moved in
+        int pull(AVFrame *frame);
+
+    private:
+        EffectsGraph graph_;
+    };
+
+    class Encoder
+    {
+    public:
+        Encoder() = default;
+        Encoder(AVCodecContext *ctx, AVBufferPool *packet_pool); // takes ownership of both
+        ~Encoder();
+
+        Encoder(Encoder &&o) noexcept;
+        Encoder &operator=(Encoder &&o) noexcept;
+        Encoder(const Encoder &) = delete;
+        Encoder &operator=(const Encoder &) = delete;
+
+        AVCodecContext *get() const { return ctx_; }
+        int sample_rate() const;
+        int frame_size() const;
+
+        int send(const AVFrame *frame); // nullptr starts draining
+        int receive(AVPacket *pkt);
+
+    private:
+        void reset();
+
+        AVCodecContext *ctx_ = nullptr;
+        AVBufferPool *packet_pool_ = nullptr;
+    };
+
+    /**
+     * Takes the encoder and graph out of an opened (or pooled) StreamPipeline.
+     */
+    void adopt_stream_pipeline(StreamPipeline &pipeline, FilterChain &filters, Encoder &encoder);
+
+    /**
+     * Coalesces encoded packets into chunks: first_chunk_bytes for the first one (so
+     * playback starts early), chunk_bytes after that, or whatever is pending once a
+     * batch has been open for max_latency.
+     */
+    class ChunkSink
+    {
+    public:
+        struct Options
+        {
+            size_t first_chunk_bytes = 8 * 1024;
+            size_t chunk_bytes = 32 * 1024;
+            std::chrono::nanoseconds max_latency = std::chrono::milliseconds(200); // 0 = every packet
+        };
+
+        explicit ChunkSink(const Options &options);
+
+        // Appends to chunk; duration_samples is the packet's (frame_size when unset)
+        void append(std::string &chunk, const AVPacket *pkt, int64_t duration_samples);
+        bool ready(const std::string &chunk) const;
+
+        // Closes the batch in chunk; returns the samples it carries
+        int64_t finish_chunk();
+
+    private:
+        Options options_;
+        std::chrono::steady_clock::time_point batch_started_at_;
+        int64_t batch_start_samples_ = 0;
+        int64_t encoded_samples_ = 0;
+        int64_t chunks_ = 0;
+    };
+
+    // Where AudioPipeline's wall time goes (see stage_ns())
+    enum class PipelineStage
+    {
+        DEMUX,
+        DECODE,
+        FILTER,
+        ENCODE,
+        COUNT
+    };
+    static constexpr size_t kPipelineStageCount = static_cast<size_t>(PipelineStage::COUNT);
+
+    /**
+     * Demux -> decode -> effects -> encode -> chunks, pulled one chunk at a time. Not
+     * tied to any caller: next_chunk() runs on whatever thread calls it, does bounded
+     * work per call, and leaves all state in the pipeline between calls, so it can be
+     * driven from an executor, a cache fill or a batch job alike.
+     *
+     * A hot clip's cached PCM can stand in for demuxer and decoder.
+     */
+    class AudioPipeline
+    {
+    public:
+        /**
+         * Input side of a range request, in decoder samples: decoded audio before
+         * start_sample is dropped (the demuxer was seeked near it), and reading stops
+         * once a frame begins at or after stop_sample (0 = read to the end).
+         * InputRange{} is the whole file.
+         */
+        struct InputRange
+        {
+            int64_t start_sample = 0;
+            int64_t stop_sample = 0;
+        };
+
+        /**
+         * Work one next_chunk() call may do without producing a chunk: demuxed
+         * packets (or cached frames) and wall time.
+         */
+        struct Budget
+        {
+            int max_packets = 64;
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        };
+
+        enum class Result
+        {
+            CHUNK, // a chunk is complete in the caller's buffer
+            YIELD, // budget spent first; call again with the same buffer
+            DONE,  // nothing left (the buffer is untouched)
+            FAILED // decoding or encoding failed; error() says where
+        };
+
+        AudioPipeline(Demuxer demuxer, Decoder decoder, FilterChain filters, Encoder encoder,
+                      const ChunkSink::Options &chunking, const InputRange &range);
+        AudioPipeline(std::shared_ptr<const DecodedClip> clip, FilterChain filters, Encoder encoder,
+                      const ChunkSink::Options &chunking);
+        ~AudioPipeline();
+
+        AudioPipeline(const AudioPipeline &) = delete;
+        AudioPipeline &operator=(const AudioPipeline &) = delete;
+
+        /**
+         * Append encoded packets to chunk until a chunk is complete, the stream ends
+         * or the budget is spent. The last chunk may be short.
+         * @param chunk_samples Set on CHUNK: audio samples (at output_sample_rate()) in it
+         */
+        Result next_chunk(std::string &chunk, int64_t &chunk_samples, const Budget &budget);
+
+        // Set once next_chunk() has returned FAILED
+        const std::string &error() const { return error_; }
+
+        int output_sample_rate() const { return encoder_.sample_rate(); }
+        const FilterChain &filters() const { return filters_; }
+
+        // Wall time per PipelineStage so far
+        const std::array<int64_t, kPipelineStageCount> &stage_ns() const { return stage_ns_; }
+
+    private:
+        class Clock;
+
+        bool prepare_input(AVFrame *frame);
+        bool push_frame(AVFrame *frame, std::string &chunk, Clock &clock);
+        bool encode_filtered(std::string &chunk, Clock &clock);
+        bool drain_encoder(std::string &chunk, Clock &clock);
+        bool drain_decoder(std::string &chunk, Clock &clock);
+        bool send_packet();
+        bool fail(const char *step, int ret);
+        bool failed() const { return !error_.empty(); }
+
+        Demuxer demuxer_;
+        Decoder decoder_;
+        std::shared_ptr<const DecodedClip> clip_;
+        size_t clip_frame_ = 0;
+        FilterChain filters_;
+        Encoder encoder_;
+        ChunkSink sink_;
+        InputRange range_;
+
+        // Reused for the whole stream
+        AVFrame *frame_ = nullptr;
+        AVFrame *filtered_ = nullptr;
+        AVPacket *in_pkt_ = nullptr;
+        AVPacket *out_pkt_ = nullptr;
+
+        bool input_done_ = false;   // range: past stop_sample
+        bool decoder_flushed_ = false;
+        bool filter_flushed_ = false;
+        bool encoder_flushed_ = false;
+        bool decoder_has_frames_ = false; // a chunk completed before the decoder was drained
+        bool packet_pending_ = false;     // in_pkt_ still waits to be sent to the decoder
+        std::string error_;
+        int64_t next_in_sample_ = 0; // input position of the next decoded sample
+        int64_t graph_in_samples_ = 0;
+        int64_t out_pts_ = 0;
+        std::array<int64_t, kPipelineStageCount> stage_ns_{};
+    };
+
+}
@@ -1,6 +1,11 @@
 #include "audio_processor_service_async.h"
-#include "audio_conversion.h"
-#include <iostream>
+#include "alloc_counter.h"
+#include "audio_input.h"
+#include "av_error.h"
+#include "dsp_kernels.h"
+#include "log.h"
+#include "mapped_input.h"
+#include "mp3_probe.h"
 #include <fstream>
 #include <cstdlib>
 #include <cstring>
@@ -8,6 +13,9 @@
 #include <algorithm>
 #include <functional>
 #include <cinttypes>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
 
 // FFmpeg is a C library
 extern "C"
@@ -17,33 +25,66 @@ extern "C"
 #include <libswresample/swresample.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersrc.h>
-#include <libavfilter/buffersink.h>
+#include <libavutil/buffer.h>
 #include <libavutil/opt.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/samplefmt.h>
 #include <libavutil/error.h>
 #include <libavutil/frame.h>
+#include <libavutil/mathematics.h>
 }
 
 #include <grpcpp/security/server_credentials.h>
 
 using namespace std::chrono_literals;
 
-// Helper to format FFmpeg error codes
-static std::string av_err_to_string(int errnum)
+// Speed/pitch factors are limited to 0.5x - 2.0x
+static float clamp_factor(float v)
 {
-    char buf[256];
-    av_strerror(errnum, buf, sizeof(buf));
-    return std::string(buf);
+    return std::clamp(v, 0.5f, 2.0f);
+}
+
+// Range streams seek this far (input time) before the requested start and decode
+// the gap, so time-stretching is warmed up by the time the range begins
+static constexpr double kRangePrerollSeconds = 0.5;
+
+static double seconds_since(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
 }
 
 // ============================================================================
 // AudioProcessorAsync Impl
 // ============================================================================
 
-AudioProcessorAsync::AudioProcessorAsync(int maxConcurrency)
-    : maxConcurrency_(std::clamp(maxConcurrency, 1, 1024)),
-      concurrencySem(std::clamp(maxConcurrency, 1, 1024)) {}
+AudioProcessorAsync::AudioProcessorAsync(const Options &options)
+    : maxConcurrency_(std::clamp(options.maxConcurrency, 1, 1024)),
+      admission_(options.admission),
+      pipelinePool_(options.pipelinePool, [this](std::function<void()> task)
+                    { dspExecutor_->submit(std::move(task)); }),
+      pcmCache_(options.pcmCache, [this](std::function<void()> task)
+                { dspExecutor_->submit(std::move(task)); }),
+      dspExecutor_(std::make_unique<soundboard::DspExecutor>(options.dspThreads)),
+      extractExecutor_(std::make_unique<soundboard::DspExecutor>(
+          options.extractThreads > 0 ? options.extractThreads : std::max(1, options.dspThreads / 2))),
+      effectsCache_(options.effectsCache),
+      firstChunkBytes_(std::max<size_t>(options.firstChunkBytes, 1)),
+      chunkBytes_(std::max<size_t>(options.chunkBytes, 1)),
+      chunkMaxLatency_(options.chunkMaxLatency),
+      pumpPacketBudget_(std::max(options.pumpPacketBudget, 1)),
+      pumpTimeBudget_(options.pumpTimeBudget),
+      readAheadChunks_(std::clamp(options.readAheadChunks, 1, 64)),
+      lowLatencyDefault_(options.lowLatencyDefault),
+      lowLatencyFirstChunkBytes_(std::max<size_t>(options.lowLatencyFirstChunkBytes, 1)),
+      nativePitch_(options.nativePitch),
+      prerenderPresets_(options.prerenderPresets),
+      batchParallelism_(std::clamp(options.batchParallelism > 0 ? options.batchParallelism
+                                                                 : extractExecutor_->size() / 2,
+                                   1, extractExecutor_->size())),
+      batchMaxItems_(std::max(options.batchMaxItems, 1)),
+      uploadMaxBytes_(std::max<size_t>(options.uploadMaxBytes, 1)),
+      audioInfoCache_(options.audioInfoCacheEntries),
+      metricsPort_(options.metricsPort) {}
 
 AudioProcessorAsync::~AudioProcessorAsync()
 {
@@ -67,7 +108,7 @@ void AudioProcessorAsync::Run(const std::string &server_address, int num_cq_thre
 
     if (certPath && keyPath)
     {
-        std::cout << "Loading SSL/TLS credentials for secure gRPC..." << std::endl;
+        LOG_INFO("tls.load").kv("cert", certPath).kv("key", keyPath);
         grpc::SslServerCredentialsOptions ssl_opts;
 
         // Load server certificate and private key
@@ -77,7 +118,7 @@ void AudioProcessorAsync::Run(const std::string &server_address, int num_cq_thre
 
         if (!cert_file || !key_file)
         {
-            std::cerr << "ERROR: Failed to open SSL certificate or key files" << std::endl;
+            LOG_ERROR("tls.open_failed").kv("cert", certPath).kv("key", keyPath);
             throw std::runtime_error("SSL configuration error");
         }
 
@@ -96,17 +137,16 @@ void AudioProcessorAsync::Run(const std::string &server_address, int num_cq_thre
                 ssl_opts.pem_root_certs = std::string((std::istreambuf_iterator<char>(root_cert_file)),
                                                       std::istreambuf_iterator<char>());
                 ssl_opts.client_certificate_request = GRPC_SSL_REQUEST_AND_REQUIRE_CLIENT_CERTIFICATE_AND_VERIFY;
-                std::cout << "Mutual TLS enabled (client cert verification required)" << std::endl;
+                LOG_INFO("tls.mutual").kv("root_cert", rootCertPath);
             }
         }
 
         creds = grpc::SslServerCredentials(ssl_opts);
-        std::cout << "SSL/TLS credentials configured" << std::endl;
+        LOG_INFO("tls.configured");
     }
     else
     {
-        std::cout << "WARNING: Using insecure credentials (dev mode)" << std::endl;
-        std::cout << "For production, set: GRPC_SERVER_CERT_PATH, GRPC_SERVER_KEY_PATH" << std::endl;
+        LOG_WARN("tls.insecure").kv("hint", "set GRPC_SERVER_CERT_PATH and GRPC_SERVER_KEY_PATH for production");
         creds = grpc::InsecureServerCredentials();
     }
 
@@ -125,17 +165,41 @@ void AudioProcessorAsync::Run(const std::string &server_address, int num_cq_thre
     builder.SetResourceQuota(rq);
 
     server_ = builder.BuildAndStart();
-    std::cout << "========================================" << std::endl;
-    std::cout << "Async Audio Processor Server listening on " << server_address << std::endl;
-    std::cout << "Max concurrency: " << maxConcurrency_ << std::endl;
-    std::cout << "Completion queues: " << num_cq_threads << std::endl;
-    std::cout << "========================================" << std::endl;
+    LOG_INFO("server.start")
+        .kv("addr", server_address)
+        .kv("max_concurrency", maxConcurrency_)
+        .kv("cq_threads", num_cq_threads)
+        .kv("dsp_threads", dspExecutor_->size())
+        .kv("extract_threads", extractExecutor_->size())
+        .kv("first_chunk_kb", firstChunkBytes_ / 1024)
+        .kv("chunk_kb", chunkBytes_ / 1024)
+        .kv("chunk_max_latency_ms", static_cast<int64_t>(chunkMaxLatency_.count()))
+        .kv("read_ahead_chunks", readAheadChunks_)
+        .kv("low_latency_default", lowLatencyDefault_)
+        .kv("native_pitch", nativePitch_)
+        .kv("batch_parallelism", batchParallelism_)
+        .kv("dsp_kernels", soundboard::dsp_kernels().name)
+        .kv("pump_packets", pumpPacketBudget_)
+        .kv("pump_budget_us", static_cast<int64_t>(pumpTimeBudget_.count()));
+
+    // Common stream shapes (44.1kHz stereo MP3 decodes to FLTP) ready before the first request
+    std::vector<soundboard::PipelineKey> warm;
+    soundboard::AudioFormat mp3_stereo{44100, AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_STEREO, 2};
+    soundboard::EffectsOptions warm_options;
+    warm_options.low_latency = lowLatencyDefault_;
+    warm_options.native_pitch = nativePitch_;
+    for (const auto &[speed, pitch] : prerenderPresets_)
+        warm.push_back(soundboard::PipelineKey::of(mp3_stereo, clamp_factor(speed), clamp_factor(pitch), warm_options));
+    pipelinePool_.prewarm(warm);
 
     // Spawn initial CallData for each method
     for (auto &cq : cqs_)
     {
         new ExtractAudioCallData(this, cq.get());
+        new GetAudioInfoCallData(this, cq.get());
         new ApplyEffectsStreamCallData(this, cq.get());
+        new BatchExtractAudioCallData(this, cq.get());
+        new ExtractAudioStreamCallData(this, cq.get());
     }
 
     // Run event loops in worker threads
@@ -150,15 +214,36 @@ void AudioProcessorAsync::Run(const std::string &server_address, int num_cq_thre
             
             while (cq.Next(&tag, &ok)) {
                 CallData* call = static_cast<CallData*>(tag);
-                call->Proceed();
+                call->handle_event(ok);
                 // If Proceed() deletes call (final state), that's expected
                 // New CallData instances will be spawned in FINISH state
             } });
     }
 
+    if (metricsPort_ > 0)
+    {
+        metricsServer_ = std::make_unique<soundboard::MetricsServer>(metricsPort_, [this]()
+                                                                     { return render_metrics(); });
+        std::string metrics_err;
+        if (metricsServer_->start(metrics_err))
+            LOG_INFO("metrics.listen").kv("port", metricsPort_);
+        else
+        {
+            LOG_WARN("metrics.disabled").kv("error", metrics_err);
+            metricsServer_.reset();
+        }
+    }
+
     // Wait for server shutdown
     server_->Wait();
 
+    if (metricsServer_)
+        metricsServer_->stop();
+
+    // Stop DSP work before the queues it posts alarms to go away
+    extractExecutor_->shutdown();
+    dspExecutor_->shutdown();
+
     for (auto &cq : cqs_)
     {
         cq->Shutdown();
@@ -171,12 +256,204 @@ void AudioProcessorAsync::Run(const std::string &server_address, int num_cq_thre
     }
 }
 
+// Scrape-time snapshot: hot-path metrics plus admission, cache and process stats
+std::string AudioProcessorAsync::render_metrics() const
+{
+    static const char *const rpc_names[kRpcCount] = {"ExtractAudio", "GetAudioInfo", "ApplyEffectsStream",
+                                                     "BatchExtractAudio", "ExtractAudioStream"};
+    static const char *const outcome_names[kOutcomeCount] = {"ok", "error", "rejected"};
+    static const char *const stage_names[STAGE_COUNT] = {"demux", "decode", "filter", "encode", "write"};
+    auto method_label = [](size_t rpc)
+    { return std::string("method=\"") + rpc_names[rpc] + "\""; };
+
+    soundboard::MetricsWriter w;
+    for (size_t r = 0; r < kRpcCount; ++r)
+        for (size_t o = 0; o < kOutcomeCount; ++o)
+            w.counter("audio_rpc_requests_total", "Completed RPCs by method and outcome.",
+                      double(metrics_.requests[r][o].value()),
+                      method_label(r) + ",outcome=\"" + outcome_names[o] + "\"");
+    for (size_t r = 0; r < kRpcCount; ++r)
+        w.gauge("audio_rpc_in_flight", "RPCs currently being handled.", double(metrics_.in_flight[r].value()),
+                method_label(r));
+    for (size_t r = 0; r < kRpcCount; ++r)
+        w.histogram("audio_rpc_duration_seconds", "RPC wall time from arrival to completion.",
+                    metrics_.duration[r], method_label(r));
+    for (size_t r = 0; r < kRpcCount; ++r)
+    {
+        if (static_cast<Rpc>(r) == Rpc::GET_AUDIO_INFO)
+            continue; // not admission-controlled
+        w.histogram("audio_admission_wait_seconds", "Time spent waiting for a concurrency permit.",
+                    metrics_.admission_wait[r], method_label(r));
+    }
+    w.histogram("audio_stream_first_chunk_seconds", "ApplyEffectsStream time from arrival to the first chunk.",
+                metrics_.first_chunk);
+    for (size_t st = 0; st < STAGE_COUNT; ++st)
+        w.histogram("audio_stream_stage_seconds", "Per-stream wall time spent in each pipeline stage.",
+                    metrics_.stage[st], std::string("stage=\"") + stage_names[st] + "\"");
+    w.counter("audio_stream_bytes_total", "Encoded bytes streamed to clients.", double(metrics_.stream_bytes.value()));
+    w.counter("audio_stream_chunks_total", "Chunks streamed to clients.", double(metrics_.stream_chunks.value()));
+    w.histogram("audio_stream_realtime_factor", "Seconds of audio streamed per second of wall time, per stream.",
+                metrics_.realtime);
+    w.counter("audio_batch_items_total", "BatchExtractAudio items converted, by result.",
+              double(metrics_.batch_items_ok.value()), "result=\"ok\"");
+    w.counter("audio_batch_items_total", "", double(metrics_.batch_items_failed.value()), "result=\"error\"");
+    w.counter("audio_upload_bytes_total", "ExtractAudioStream upload bytes received.",
+              double(metrics_.upload_bytes.value()));
+
+    auto adm = admission_.stats();
+    w.gauge("audio_admission_in_use", "Concurrency permits held.", adm.in_use);
+    w.gauge("audio_admission_limit", "Concurrency permits available.", maxConcurrency_);
+    w.gauge("audio_admission_queue_depth", "Calls waiting for a permit.", double(adm.queue_depth));
+    w.counter("audio_admission_admitted_total", "Calls granted a permit.", double(adm.admitted));
+    w.counter("audio_admission_queued_total", "Calls that had to wait for a permit.", double(adm.queued));
+    w.counter("audio_admission_rejected_total", "Calls rejected because the queue was full.", double(adm.rejected_full));
+    w.counter("audio_admission_timeouts_total", "Calls that timed out waiting for a permit.", double(adm.timed_out));
+
+    auto fx = effectsCache_.stats();
+    w.counter("audio_effects_cache_lookups_total", "Rendered-effects cache lookups by result.", double(fx.hits_memory),
+              "result=\"hit_memory\"");
+    w.counter("audio_effects_cache_lookups_total", "", double(fx.hits_disk), "result=\"hit_disk\"");
+    w.counter("audio_effects_cache_lookups_total", "", double(fx.shared_renders), "result=\"shared\"");
+    w.counter("audio_effects_cache_lookups_total", "", double(fx.misses), "result=\"miss\"");
+    w.counter("audio_effects_cache_evictions_total", "Rendered clips evicted from memory.", double(fx.evictions));
+    w.gauge("audio_effects_cache_memory_bytes", "Bytes of rendered clips held in memory.", double(fx.memory_bytes));
+    w.gauge("audio_effects_cache_entries", "Rendered clips held in memory.", double(fx.entries));
+
+    auto info = audioInfoCache_.stats();
+    w.counter("audio_info_cache_lookups_total", "GetAudioInfo cache lookups by result.", double(info.hits),
+              "result=\"hit\"");
+    w.counter("audio_info_cache_lookups_total", "", double(info.misses), "result=\"miss\"");
+    w.gauge("audio_info_cache_entries", "Files held in the audio info cache.", double(info.entries));
+
+    if (soundboard::allocation_counting_enabled())
+    {
+        w.counter("audio_stream_steady_allocations_total",
+                  "Heap allocations made while producing steady-state stream chunks.",
+                  double(metrics_.steady_allocations.value()));
+        w.counter("audio_stream_steady_chunks_total", "Steady-state stream chunks checked for allocations.",
+                  double(metrics_.steady_chunks.value()));
+    }
+
+    auto pool = pipelinePool_.stats();
+    w.counter("audio_pipeline_pool_acquires_total", "Stream pipelines taken from the pool by result.",
+              double(pool.hits), "result=\"hit\"");
+    w.counter("audio_pipeline_pool_acquires_total", "", double(pool.misses), "result=\"miss\"");
+    w.counter("audio_pipeline_pool_built_total", "Stream pipelines pre-built in the background.", double(pool.built));
+    w.gauge("audio_pipeline_pool_idle", "Pre-built stream pipelines waiting for a request.", double(pool.idle));
+
+    auto pcm = pcmCache_.stats();
+    w.counter("audio_pcm_cache_lookups_total", "Decoded-PCM cache lookups by result.", double(pcm.hits), "result=\"hit\"");
+    w.counter("audio_pcm_cache_lookups_total", "", double(pcm.misses), "result=\"miss\"");
+    w.counter("audio_pcm_cache_loads_total", "Clips decoded into the PCM cache by result.", double(pcm.loads), "result=\"ok\"");
+    w.counter("audio_pcm_cache_loads_total", "", double(pcm.load_failures), "result=\"failed\"");
+    w.counter("audio_pcm_cache_evictions_total", "Clips evicted from the PCM cache.", double(pcm.evictions));
+    w.gauge("audio_pcm_cache_bytes", "Decoded PCM held in memory.", double(pcm.bytes));
+    w.gauge("audio_pcm_cache_entries", "Clips in the PCM cache.", double(pcm.entries));
+
+    auto mapped = soundboard::mapped_file_stats();
+    w.counter("audio_mapped_file_opens_total", "Input opens by how the file was read.", double(mapped.hits), "result=\"shared\"");
+    w.counter("audio_mapped_file_opens_total", "", double(mapped.misses), "result=\"mapped\"");
+    w.counter("audio_mapped_file_opens_total", "", double(mapped.fallbacks), "result=\"fallback\"");
+    w.gauge("audio_mapped_files", "Input files held mapped.", double(mapped.mappings));
+    w.gauge("audio_mapped_file_bytes", "Bytes of input files held mapped.", double(mapped.mapped_bytes));
+
+    soundboard::write_process_metrics(w);
+    return w.text();
+}
+
 // ============================================================================
 // CallData Base Class
 // ============================================================================
 
 AudioProcessorAsync::CallData::CallData(AudioProcessorAsync *svc, grpc::ServerCompletionQueue *cq)
-    : svc_(svc), cq_(cq), status_(CREATE) {}
+    : svc_(svc), cq_(cq), status_(CREATE), event_ok_(true), holds_permit_(false),
+      rpc_started_(false), rpc_(Rpc::EXTRACT_AUDIO), outcome_(Outcome::OK) {}
+
+AudioProcessorAsync::CallData::~CallData()
+{
+    if (!rpc_started_)
+        return;
+    size_t rpc = static_cast<size_t>(rpc_);
+    svc_->metrics_.in_flight[rpc].sub();
+    svc_->metrics_.requests[rpc][static_cast<size_t>(outcome_)].add();
+    svc_->metrics_.duration[rpc].observe(seconds_since(started_at_));
+}
+
+void AudioProcessorAsync::CallData::handle_event(bool ok)
+{
+    event_ok_ = ok;
+    Proceed();
+}
+
+void AudioProcessorAsync::CallData::rpc_started(Rpc rpc)
+{
+    rpc_started_ = true;
+    rpc_ = rpc;
+    const auto &metadata = ctx_.client_metadata();
+    auto it = metadata.find("x-request-id");
+    if (it != metadata.end() && !it->second.empty())
+        request_id_.assign(it->second.data(), std::min<size_t>(it->second.size(), 64));
+    else
+        request_id_ = std::to_string(svc_->nextRequestId_.fetch_add(1, std::memory_order_relaxed));
+    started_at_ = std::chrono::steady_clock::now();
+    svc_->metrics_.in_flight[static_cast<size_t>(rpc)].add();
+}
+
+// Ask for a concurrency permit without blocking the CQ thread. On QUEUED the call
+// parks in QUEUED state; alarm_ fires at the queue deadline, or early when
+// release() grants the permit (Cancel() delivers the tag immediately).
+soundboard::AdmissionQueue::Result AudioProcessorAsync::CallData::request_permit(
+    soundboard::AdmissionQueue::Method method)
+{
+    ticket_.method = method;
+    ticket_.on_park = [this]()
+    {
+        status_ = QUEUED;
+        queued_at_ = std::chrono::steady_clock::now();
+        alarm_.Set(cq_, std::chrono::system_clock::now() + svc_->admission_.max_wait(), this);
+    };
+    ticket_.on_grant = [this]()
+    { alarm_.Cancel(); };
+
+    auto result = svc_->admission_.try_acquire(ticket_);
+    holds_permit_ = (result == soundboard::AdmissionQueue::Result::ADMITTED);
+    if (holds_permit_)
+        svc_->metrics_.admission_wait[static_cast<size_t>(rpc_)].observe(0.0);
+    return result;
+}
+
+// Called when alarm_ fires in QUEUED state: true if granted, false if the deadline passed
+bool AudioProcessorAsync::CallData::resolve_permit()
+{
+    holds_permit_ = svc_->admission_.resolve(ticket_);
+    if (holds_permit_)
+        svc_->metrics_.admission_wait[static_cast<size_t>(rpc_)].observe(seconds_since(queued_at_));
+    return holds_permit_;
+}
+
+void AudioProcessorAsync::CallData::release_permit()
+{
+    if (holds_permit_)
+    {
+        holds_permit_ = false;
+        svc_->admission_.release(ticket_.method);
+    }
+}
+
+void AudioProcessorAsync::CallData::log_busy(const char *reason)
+{
+    outcome_ = Outcome::REJECTED;
+    auto stats = svc_->admission_.stats();
+    uint64_t avg_wait_us = stats.wait_count ? stats.wait_us_total / stats.wait_count : 0;
+    LOG_WARN("rpc.busy")
+        .kv("req", request_id_)
+        .kv("method", soundboard::AdmissionQueue::method_name(ticket_.method))
+        .kv("reason", reason)
+        .kv("queued", stats.queue_depth)
+        .kv("in_use", stats.in_use)
+        .kv("avg_wait_ms", avg_wait_us / 1000)
+        .kv("max_wait_ms", stats.wait_us_max / 1000);
+}
 
 // ============================================================================
 // ExtractAudioCallData Implementation
@@ -202,776 +479,1396 @@ void AudioProcessorAsync::ExtractAudioCallData::Proceed()
     {
         // Spawn a new CallData immediately to handle the next incoming request
         new ExtractAudioCallData(svc_, cq_);
+        rpc_started(Rpc::EXTRACT_AUDIO);
 
-        status_ = FINISH;
-
-        // Try to acquire concurrency permit
-        if (!svc_->concurrencySem.try_acquire_for(100ms))
+        switch (request_permit(soundboard::AdmissionQueue::Method::EXTRACT_AUDIO))
         {
-            std::cerr << "  BUSY: Concurrency limit reached for ExtractAudio" << std::endl;
-            response_.set_success(false);
-            response_.set_error_message("Processor busy, please retry");
-            responder_.FinishWithError(
-                grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Processor busy"),
-                this);
-            return;
+        case soundboard::AdmissionQueue::Result::ADMITTED:
+            process();
+            break;
+        case soundboard::AdmissionQueue::Result::QUEUED:
+            // Parked; alarm_ brings us back in QUEUED state
+            break;
+        case soundboard::AdmissionQueue::Result::REJECTED:
+            reject_busy("Admission queue full");
+            break;
         }
+    }
+    else if (status_ == QUEUED)
+    {
+        if (resolve_permit())
+            process();
+        else
+            reject_busy("Admission queue timeout");
+    }
+    else
+    { // FINISH
+        delete this;
+    }
+}
+
+void AudioProcessorAsync::ExtractAudioCallData::reject_busy(const char *reason)
+{
+    log_busy(reason);
+    status_ = FINISH;
+    responder_.FinishWithError(
+        grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Processor busy"),
+        this);
+}
+
+void AudioProcessorAsync::ExtractAudioCallData::process()
+{
+    // Transcoding a whole file would hold this CQ thread for seconds
+    status_ = PRODUCING;
+    svc_->extractExecutor_->submit([this]()
+                                   { convert(); });
+}
+
+// Runs on the extract executor; Finish() completes on cq_ in FINISH state
+void AudioProcessorAsync::ExtractAudioCallData::convert()
+{
+    if (!svc_->extract_audio(request_, request_id_, response_))
+        outcome_ = Outcome::ERROR;
+    release_permit();
+    status_ = FINISH;
+    responder_.Finish(response_, grpc::Status::OK, this);
+}
+
+// ============================================================================
+// ExtractAudio processing (shared with BatchExtractAudio)
+// ============================================================================
+
+bool AudioProcessorAsync::extract_audio(const soundboard::ExtractAudioRequest &request, const std::string &request_id,
+                                        soundboard::ExtractAudioResponse &response,
+                                        std::shared_ptr<const std::string> upload)
+{
+    LOG_INFO("extract.start")
+        .kv("req", request_id)
+        .kv("video", request.video_path())
+        .kv("upload_bytes", upload ? upload->size() : 0)
+        .kv("output", request.output_path())
+        .kv("format", request.format())
+        .kv("bitrate_kbps", request.bitrate_kbps());
+    const auto started = std::chrono::steady_clock::now();
+
+    // One decode feeds the base MP3, any effect presets and any requested renditions
+    std::vector<soundboard::TranscodeOutput> outputs(1);
+    outputs[0].codec = "mp3";
+    outputs[0].bitrate_kbps = request.bitrate_kbps();
+    outputs[0].sample_rate = 44100;
+    outputs[0].channels = 2;
+    outputs[0].out_path = request.output_path();
+
+    size_t first_preset = outputs.size();
+    if (request.prerender_presets())
+        plan_prerender(outputs, request_id);
+    size_t first_rendition = outputs.size();
+    for (const auto &r : request.renditions())
+    {
+        soundboard::TranscodeOutput o;
+        o.codec = r.codec();
+        o.bitrate_kbps = r.bitrate_kbps() > 0 ? r.bitrate_kbps() : 128;
+        o.sample_rate = r.sample_rate();
+        o.channels = r.channels() == 1 ? 1 : 2;
+        o.out_path = r.output_path();
+        outputs.push_back(std::move(o));
+    }
 
-        auto release_guard = std::unique_ptr<void, std::function<void(void *)>>(
-            reinterpret_cast<void *>(1),
-            [this](void *)
-            { this->svc_->concurrencySem.release(); });
-
-        std::cout << "ExtractAudio called:" << std::endl;
-        std::cout << "  Video: " << request_.video_path() << std::endl;
-        std::cout << "  Output: " << request_.output_path() << std::endl;
-        std::cout << "  Format: " << request_.format() << std::endl;
-        std::cout << "  Bitrate: " << request_.bitrate_kbps() << "kbps" << std::endl;
-
-        // Use libav* APIs instead of spawning ffmpeg process
-        std::string libav_err;
-        std::cout << "  Converting using libav (in-process)" << std::endl;
-        if (!soundboard::convert_to_mp3_libav(request_.video_path(), request_.output_path(), request_.bitrate_kbps(), libav_err))
+    // Use libav* APIs instead of spawning ffmpeg process
+    std::string libav_err;
+    LOG_DEBUG("extract.transcode")
+        .kv("req", request_id)
+        .kv("presets", first_rendition - first_preset)
+        .kv("renditions", outputs.size() - first_rendition);
+    // Outputs are encoded on the extract executor too, whose size bounds them. They wait
+    // in temp files: without the base file nothing else is useful, so nothing is moved
+    // into place (and no previous file replaced) unless the base is
+    soundboard::DspExecutor *pool = extractExecutor_.get();
+    bool converted = (upload ? soundboard::transcode(std::move(upload), request.video_path(), outputs, libav_err, pool)
+                             : soundboard::transcode(request.video_path(), outputs, libav_err, pool)) &&
+                     soundboard::commit_transcode_output(outputs[0]);
+    if (!converted)
+    {
+        if (libav_err.empty())
+            libav_err = outputs[0].error;
+        for (auto &o : outputs)
+            soundboard::discard_transcode_output(o);
+        LOG_ERROR("extract.failed").kv("req", request_id).kv("error", libav_err);
+        response.set_success(false);
+        response.set_error_message(std::string("FFmpeg processing failed: ") + libav_err.substr(0, 200));
+        return false;
+    }
+
+    for (size_t i = 1; i < outputs.size(); ++i)
+        soundboard::commit_transcode_output(outputs[i]);
+    int64_t file_size = outputs[0].bytes;
+
+    // We know the new file's parameters; seed the info cache so GetAudioInfo needn't probe it
+    soundboard::AudioInfo info;
+    info.duration_seconds = outputs[0].duration_seconds;
+    info.sample_rate = outputs[0].sample_rate;
+    info.channels = outputs[0].channels;
+    info.bitrate_kbps = outputs[0].bitrate_kbps;
+    if (info.bitrate_kbps <= 0 && info.duration_seconds > 0.0)
+        info.bitrate_kbps = static_cast<int>(file_size * 8 / info.duration_seconds / 1000);
+    info.format = "mp3";
+    audioInfoCache_.put(request.output_path(), info);
+
+    response.set_success(true);
+    response.set_audio_path(request.output_path());
+    response.set_duration_seconds(static_cast<float>(outputs[0].duration_seconds));
+    response.set_file_size_bytes(file_size);
+    response.set_error_message("");
+    response.set_prerendered_variants(adopt_prerendered(request, outputs, first_preset, first_rendition, request_id));
+    for (size_t i = first_rendition; i < outputs.size(); ++i)
+    {
+        const auto &o = outputs[i];
+        auto *result = response.add_renditions();
+        result->set_output_path(o.out_path);
+        result->set_success(o.ok);
+        result->set_file_size_bytes(o.bytes);
+        result->set_error_message(o.error);
+        if (!o.ok)
+            LOG_WARN("extract.rendition_failed")
+                .kv("req", request_id)
+                .kv("codec", o.codec)
+                .kv("output", o.out_path)
+                .kv("error", o.error);
+    }
+
+    LOG_INFO("extract.done")
+        .kv("req", request_id)
+        .kv("bytes", file_size)
+        .kv("duration_s", outputs[0].duration_seconds)
+        .kv("elapsed_ms", static_cast<int64_t>(seconds_since(started) * 1000));
+    return true;
+}
+
+// Staged MP3 outputs for the configured presets; none if the effects cache has no disk tier
+void AudioProcessorAsync::plan_prerender(std::vector<soundboard::TranscodeOutput> &outputs,
+                                         const std::string &request_id) const
+{
+    for (const auto &[speed, pitch] : prerenderPresets_)
+    {
+        soundboard::TranscodeOutput o;
+        o.speed = clamp_factor(speed);
+        o.pitch = clamp_factor(pitch);
+        if (o.speed == 1.0f && o.pitch == 1.0f)
+            continue; // streamed without effects anyway
+        o.native_pitch = nativePitch_; // same engine ApplyEffectsStream renders with
+        o.sample_rate = 44100; // same format ApplyEffectsStream renders
+        o.out_path = effectsCache_.staging_path();
+        if (o.out_path.empty())
         {
-            std::cerr << "  ERROR: libav conversion failed: " << libav_err << std::endl;
-            response_.set_success(false);
-            response_.set_error_message(std::string("FFmpeg processing failed: ") + libav_err.substr(0, 200));
-            responder_.Finish(response_, grpc::Status::OK, this);
+            LOG_DEBUG("extract.prerender_skipped").kv("req", request_id).kv("reason", "no disk tier");
             return;
         }
+        outputs.push_back(std::move(o));
+    }
+}
 
-        // Get file size
-        std::ifstream file(request_.output_path(), std::ios::binary | std::ios::ate);
-        int64_t file_size = 0;
-        if (file.is_open())
+// Move rendered presets into the effects cache under the new file's identity, so
+// ApplyEffectsStream for the same (file, speed, pitch) is a disk hit. Returns the count.
+int AudioProcessorAsync::adopt_prerendered(const soundboard::ExtractAudioRequest &request,
+                                           const std::vector<soundboard::TranscodeOutput> &outputs, size_t begin,
+                                           size_t end, const std::string &request_id)
+{
+    int adopted = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+        const auto &v = outputs[i];
+        if (!v.ok)
         {
-            file_size = file.tellg();
-            file.close();
+            LOG_WARN("extract.prerender_failed")
+                .kv("req", request_id)
+                .kv("speed", v.speed)
+                .kv("pitch", v.pitch)
+                .kv("error", v.error);
+            continue;
         }
-
-        response_.set_success(true);
-        response_.set_audio_path(request_.output_path());
-        response_.set_duration_seconds(0.0f);
-        response_.set_file_size_bytes(file_size);
-        response_.set_error_message("");
-
-        std::cout << "  Result: SUCCESS" << std::endl;
-        std::cout << "  File size: " << file_size << " bytes" << std::endl;
-
-        responder_.Finish(response_, grpc::Status::OK, this);
-    }
-    else
-    { // FINISH
-        delete this;
+        soundboard::EffectsKey key;
+        bool keyed = soundboard::make_effects_key(request.output_path(), v.speed, v.pitch, key);
+        key.native_pitch = v.native_pitch;
+        if (keyed && effectsCache_.adopt_file(key, v.out_path))
+            adopted++;
+        else
+            std::remove(v.out_path.c_str());
     }
+    if (end > begin)
+        LOG_INFO("extract.prerendered").kv("req", request_id).kv("adopted", adopted).kv("planned", end - begin);
+    return adopted;
 }
 
 // ============================================================================
-// ApplyEffectsStreamCallData Impl
+// BatchExtractAudioCallData Implementation
 // ============================================================================
 
-AudioProcessorAsync::ApplyEffectsStreamCallData::ApplyEffectsStreamCallData(
+AudioProcessorAsync::BatchExtractAudioCallData::BatchExtractAudioCallData(
     AudioProcessorAsync *svc, grpc::ServerCompletionQueue *cq)
-    : CallData(svc, cq), writer_(&ctx_), streaming_started_(false), streaming_no_effects_(false),
-      ffmpeg_pipe_(nullptr), chunk_sequence_(0),
-      streaming_in_fmt_(nullptr), streaming_dec_ctx_(nullptr), streaming_enc_ctx_(nullptr),
-      streaming_graph_(nullptr), streaming_src_ctx_(nullptr), streaming_sink_ctx_(nullptr),
-      streaming_frame_(nullptr), streaming_filtered_frame_(nullptr), streaming_audio_stream_idx_(-1),
-      decoder_flushed_(false), filter_flushed_(false), encoder_flushed_(false), streaming_pts_(0)
+    : CallData(svc, cq), writer_(&ctx_), next_item_(0), completed_(0), failed_(0), writer_idle_(false),
+      stopped_(false)
 {
     Proceed();
 }
 
-void AudioProcessorAsync::ApplyEffectsStreamCallData::Proceed()
+void AudioProcessorAsync::BatchExtractAudioCallData::Proceed()
 {
     if (status_ == CREATE)
     {
         status_ = PROCESS;
-
-        // Request the RPC (enqueues a tag on the CQ)
-        svc_->service_->RequestApplyEffectsStream(&ctx_, &request_, &writer_, cq_, cq_, this);
+        svc_->service_->RequestBatchExtractAudio(&ctx_, &request_, &writer_, cq_, cq_, this);
     }
     else if (status_ == PROCESS)
     {
-        // This state runs once: when a new RPC arrives
-        // Spawn a new CallData immediately to handle the next incoming request
-        new ApplyEffectsStreamCallData(svc_, cq_);
+        new BatchExtractAudioCallData(svc_, cq_);
+        rpc_started(Rpc::BATCH_EXTRACT_AUDIO);
 
-        // Try to acquire concurrency permit
-        if (!svc_->concurrencySem.try_acquire_for(100ms))
+        if (request_.items_size() > svc_->batchMaxItems_)
         {
-            std::cerr << "  BUSY: Concurrency limit reached for ApplyEffectsStream" << std::endl;
+            LOG_WARN("batch.too_large").kv("req", request_id_).kv("items", request_.items_size()).kv("max", svc_->batchMaxItems_);
+            outcome_ = Outcome::ERROR;
             status_ = FINISH;
-            writer_.Finish(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Processor busy"), this);
+            writer_.Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                        "Too many items (max " + std::to_string(svc_->batchMaxItems_) + ")"),
+                           this);
             return;
         }
 
-        std::cout << "ApplyEffectsStream called:" << std::endl;
-        std::cout << "  Audio: " << request_.audio_path() << std::endl;
-        std::cout << "  Speed: " << request_.speed_factor() << "x" << std::endl;
-        std::cout << "  Pitch: " << request_.pitch_factor() << "x" << std::endl;
-
-        start_processing();
-
-        // Start streaming (transition to WRITING state)
-        send_next_chunk();
+        // The whole batch counts as one upload against the admission limits
+        switch (request_permit(soundboard::AdmissionQueue::Method::EXTRACT_AUDIO))
+        {
+        case soundboard::AdmissionQueue::Result::ADMITTED:
+            start_batch();
+            break;
+        case soundboard::AdmissionQueue::Result::QUEUED:
+            // Parked; alarm_ brings us back in QUEUED state
+            break;
+        case soundboard::AdmissionQueue::Result::REJECTED:
+            reject_busy("Admission queue full");
+            break;
+        }
+    }
+    else if (status_ == QUEUED)
+    {
+        if (resolve_permit())
+            start_batch();
+        else
+            reject_busy("Admission queue timeout");
     }
     else if (status_ == WRITING)
     {
-        // Previous Write() completed, send next chunk
-        send_next_chunk();
+        // A Write() completed, or the executor woke the idle writer
+        if (event_ok_)
+            write_next();
+        else
+            stop_batch();
     }
     else
     { // FINISH
-        svc_->concurrencySem.release();
-        if (ffmpeg_pipe_)
-        {
-            pclose(ffmpeg_pipe_);
-            ffmpeg_pipe_ = nullptr;
-        }
         delete this;
     }
 }
 
-void AudioProcessorAsync::ApplyEffectsStreamCallData::start_processing()
+void AudioProcessorAsync::BatchExtractAudioCallData::reject_busy(const char *reason)
 {
-    float speed = request_.speed_factor();
-    float pitch = request_.pitch_factor();
-
-    if (speed < 0.5f)
-        speed = 0.5f;
-    if (speed > 2.0f)
-        speed = 2.0f;
-    if (pitch < 0.5f)
-        pitch = 0.5f;
-    if (pitch > 2.0f)
-        pitch = 2.0f;
-
-    // If no modifications, stream original file directly
-    if (speed == 1.0f && pitch == 1.0f)
-    {
-        std::cout << "  Streaming original file (no effects)" << std::endl;
-        streaming_no_effects_ = true;
-        return;
-    }
+    log_busy(reason);
+    status_ = FINISH;
+    writer_.Finish(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Processor busy"), this);
+}
 
-    streaming_no_effects_ = false;
+void AudioProcessorAsync::BatchExtractAudioCallData::start_batch()
+{
+    const size_t items = static_cast<size_t>(request_.items_size());
+    LOG_INFO("batch.start").kv("req", request_id_).kv("items", items).kv("parallelism", svc_->batchParallelism_);
 
-    // Build libavfilter graph for time-stretching and pitch-shifting
-    std::string filter_desc;
-    if (speed != 1.0f && pitch != 1.0f)
+    // Set before any item can complete and wake the writer
+    status_ = WRITING;
+    size_t first = std::min(items, static_cast<size_t>(svc_->batchParallelism_));
     {
-        char buf[256];
-        snprintf(buf, sizeof(buf), "atempo=%.2f,rubberband=pitch=%.2f", speed, pitch);
-        filter_desc = buf;
+        std::lock_guard<std::mutex> lock(results_mu_);
+        writer_idle_ = true;
+        next_item_ = first;
     }
-    else if (speed != 1.0f)
+    if (items == 0)
     {
-        char buf[64];
-        snprintf(buf, sizeof(buf), "atempo=%.2f", speed);
-        filter_desc = buf;
+        write_next();
+        return;
     }
-    else if (pitch != 1.0f)
+    for (size_t i = 0; i < first; ++i)
+        svc_->extractExecutor_->submit([this, i]()
+                                       { run_item(i); });
+}
+
+// Runs on the extract executor: converts one item, queues its result, then starts the
+// next unscheduled item on this worker so the batch keeps batchParallelism in flight.
+// Nothing new is started once the client has gone or the batch was stopped.
+void AudioProcessorAsync::BatchExtractAudioCallData::run_item(size_t index)
+{
+    soundboard::BatchExtractAudioResult result;
+    result.set_index(static_cast<int32_t>(index));
+    bool ok = svc_->extract_audio(request_.items(static_cast<int>(index)),
+                                  request_id_ + "/" + std::to_string(index), *result.mutable_response());
+    (ok ? svc_->metrics_.batch_items_ok : svc_->metrics_.batch_items_failed).add();
+
+    size_t next = 0;
+    bool more = false;
+    bool wake = false;
     {
-        char buf[128];
-        snprintf(buf, sizeof(buf), "rubberband=pitch=%.2f", pitch);
-        filter_desc = buf;
+        std::lock_guard<std::mutex> lock(results_mu_);
+        results_.push_back(std::move(result));
+        completed_++;
+        if (!ok)
+            failed_++;
+        if (ctx_.IsCancelled())
+            stopped_ = true;
+        more = !stopped_ && next_item_ < static_cast<size_t>(request_.items_size());
+        if (more)
+            next = next_item_++;
+        wake = writer_idle_;
+        writer_idle_ = false;
     }
 
-    std::cout << "  Using libavfilter: \"" << filter_desc << "\"" << std::endl;
+    // Once the last result is queued the writer may finish and delete this call, so
+    // nothing here touches it after the wake-up unless another item is still to run
+    if (more)
+        svc_->extractExecutor_->submit([this, next]()
+                                       { run_item(next); });
+    if (wake)
+        alarm_.Set(cq_, gpr_now(GPR_CLOCK_MONOTONIC), this);
+}
 
-    // Open input file
-    AVFormatContext *in_fmt = nullptr;
-    if (int ret = avformat_open_input(&in_fmt, request_.audio_path().c_str(), nullptr, nullptr))
+// CQ thread: a failed Write() means the client is gone; stop starting items and
+// finish once those already running have returned
+void AudioProcessorAsync::BatchExtractAudioCallData::stop_batch()
+{
     {
-        std::cerr << "  ERROR: avformat_open_input: " << av_err_to_string(ret) << std::endl;
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to open input"), this);
-        return;
+        std::lock_guard<std::mutex> lock(results_mu_);
+        stopped_ = true;
     }
+    write_next();
+}
 
-    if (int ret = avformat_find_stream_info(in_fmt, nullptr))
+// CQ thread: write the oldest completed result, go idle until the next one, or finish
+// once every started item has completed and nothing more will start
+void AudioProcessorAsync::BatchExtractAudioCallData::write_next()
+{
+    std::unique_lock<std::mutex> lock(results_mu_);
+    if (stopped_)
+        results_.clear(); // nobody left to write them to
+    if (results_.empty())
     {
-        std::cerr << "  ERROR: avformat_find_stream_info: " << av_err_to_string(ret) << std::endl;
-        avformat_close_input(&in_fmt);
+        const bool all_started = stopped_ || next_item_ == static_cast<size_t>(request_.items_size());
+        if (!all_started || completed_ < next_item_)
+        {
+            writer_idle_ = true;
+            return;
+        }
+        const bool stopped = stopped_;
+        lock.unlock();
+
+        release_permit();
+        if (failed_ > 0 || stopped)
+            outcome_ = Outcome::ERROR;
+        LOG_INFO(stopped ? "batch.cancelled" : "batch.done")
+            .kv("req", request_id_)
+            .kv("items", request_.items_size())
+            .kv("completed", completed_)
+            .kv("failed", failed_)
+            .kv("elapsed_ms", static_cast<int64_t>(seconds_since(started_at_) * 1000));
         status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to find stream info"), this);
+        writer_.Finish(stopped ? grpc::Status::CANCELLED : grpc::Status::OK, this);
         return;
     }
+    writing_ = std::move(results_.front());
+    results_.pop_front();
+    lock.unlock();
+    writer_.Write(writing_, this);
+}
 
-    int audio_stream_index = -1;
-    for (unsigned i = 0; i < in_fmt->nb_streams; ++i)
+// ============================================================================
+// ExtractAudioStreamCallData Implementation
+// ============================================================================
+
+AudioProcessorAsync::ExtractAudioStreamCallData::ExtractAudioStreamCallData(
+    AudioProcessorAsync *svc, grpc::ServerCompletionQueue *cq)
+    : CallData(svc, cq), have_header_(false), expected_bytes_(0), bytes_(std::make_shared<std::string>()),
+      reader_(&ctx_)
+{
+    Proceed();
+}
+
+void AudioProcessorAsync::ExtractAudioStreamCallData::Proceed()
+{
+    if (status_ == CREATE)
     {
-        if (in_fmt->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+        status_ = PROCESS;
+        svc_->service_->RequestExtractAudioStream(&ctx_, &reader_, cq_, cq_, this);
+    }
+    else if (status_ == PROCESS)
+    {
+        new ExtractAudioStreamCallData(svc_, cq_);
+        rpc_started(Rpc::EXTRACT_AUDIO_STREAM);
+
+        // Admitted before reading, so the permits also bound the uploads held in memory
+        switch (request_permit(soundboard::AdmissionQueue::Method::EXTRACT_AUDIO))
         {
-            audio_stream_index = i;
+        case soundboard::AdmissionQueue::Result::ADMITTED:
+            begin_upload();
+            break;
+        case soundboard::AdmissionQueue::Result::QUEUED:
+            // Parked; alarm_ brings us back in QUEUED state
+            break;
+        case soundboard::AdmissionQueue::Result::REJECTED:
+            reject_busy("Admission queue full");
             break;
         }
     }
-    if (audio_stream_index < 0)
+    else if (status_ == QUEUED)
     {
-        std::cerr << "  ERROR: no audio stream found" << std::endl;
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "No audio stream"), this);
-        return;
+        if (resolve_permit())
+            begin_upload();
+        else
+            reject_busy("Admission queue timeout");
+    }
+    else if (status_ == READING)
+    {
+        // A failed Read() is the end of the client's stream
+        if (event_ok_)
+            on_upload_message();
+        else
+            end_upload();
     }
+    else
+    { // FINISH
+        delete this;
+    }
+}
+
+void AudioProcessorAsync::ExtractAudioStreamCallData::reject_busy(const char *reason)
+{
+    log_busy(reason);
+    status_ = FINISH;
+    reader_.FinishWithError(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Processor busy"), this);
+}
 
-    // Decode input
-    AVStream *in_stream = in_fmt->streams[audio_stream_index];
-    const AVCodec *dec = avcodec_find_decoder(in_stream->codecpar->codec_id);
-    if (!dec)
+void AudioProcessorAsync::ExtractAudioStreamCallData::begin_upload()
+{
+    status_ = READING;
+    reader_.Read(&upload_, this);
+}
+
+void AudioProcessorAsync::ExtractAudioStreamCallData::on_upload_message()
+{
+    switch (upload_.payload_case())
     {
-        std::cerr << "  ERROR: decoder not found" << std::endl;
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Decoder not found"), this);
-        return;
+    case soundboard::ExtractAudioUpload::kHeader:
+    {
+        if (have_header_)
+        {
+            fail(grpc::StatusCode::INVALID_ARGUMENT, "Duplicate upload header");
+            return;
+        }
+        have_header_ = true;
+        request_.Swap(upload_.mutable_header()->mutable_request());
+        expected_bytes_ = upload_.header().total_size();
+        // A cancelled or broken stream ends with a failed Read() just like a complete
+        // one, so the declared size is what tells a truncated upload apart
+        if (expected_bytes_ <= 0)
+        {
+            fail(grpc::StatusCode::INVALID_ARGUMENT, "Upload header must give total_size");
+            return;
+        }
+        if (expected_bytes_ > static_cast<int64_t>(svc_->uploadMaxBytes_))
+        {
+            fail(grpc::StatusCode::INVALID_ARGUMENT, "Upload too large");
+            return;
+        }
+        bytes_->reserve(static_cast<size_t>(expected_bytes_));
+        LOG_DEBUG("upload.start")
+            .kv("req", request_id_)
+            .kv("name", request_.video_path())
+            .kv("total_size", expected_bytes_);
+        break;
     }
+    case soundboard::ExtractAudioUpload::kData:
+    {
+        if (!have_header_)
+        {
+            fail(grpc::StatusCode::INVALID_ARGUMENT, "Upload must start with a header");
+            return;
+        }
+        const std::string &data = upload_.data();
+        if (bytes_->size() + data.size() > static_cast<size_t>(expected_bytes_))
+        {
+            fail(grpc::StatusCode::INVALID_ARGUMENT, "Upload larger than the header's total_size");
+            return;
+        }
+        bytes_->append(data);
+        svc_->metrics_.upload_bytes.add(data.size());
+        break;
+    }
+    default:
+        break;
+    }
+
+    upload_.Clear();
+    reader_.Read(&upload_, this);
+}
 
-    AVCodecContext *dec_ctx = avcodec_alloc_context3(dec);
-    if (!dec_ctx)
+void AudioProcessorAsync::ExtractAudioStreamCallData::end_upload()
+{
+    if (!have_header_)
     {
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to alloc decoder"), this);
+        fail(grpc::StatusCode::INVALID_ARGUMENT, "Missing upload header");
         return;
     }
-    avcodec_parameters_to_context(dec_ctx, in_stream->codecpar);
-    if (int ret = avcodec_open2(dec_ctx, dec, nullptr))
+    if (bytes_->empty())
     {
-        std::cerr << "  ERROR: avcodec_open2: " << av_err_to_string(ret) << std::endl;
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to open decoder"), this);
+        fail(grpc::StatusCode::INVALID_ARGUMENT, "Empty upload");
         return;
     }
-
-    // Setup encoder
-    const AVCodec *enc = avcodec_find_encoder(AV_CODEC_ID_MP3);
-    if (!enc)
+    if (static_cast<int64_t>(bytes_->size()) != expected_bytes_)
     {
-        std::cerr << "  ERROR: MP3 encoder not found" << std::endl;
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Encoder not found"), this);
+        fail(grpc::StatusCode::INVALID_ARGUMENT, "Upload ended short of the header's total_size");
         return;
     }
-
-    AVCodecContext *enc_ctx = avcodec_alloc_context3(enc);
-    if (!enc_ctx)
+    if (ctx_.IsCancelled())
     {
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to alloc encoder"), this);
+        fail(grpc::StatusCode::CANCELLED, "Upload cancelled");
         return;
     }
 
-    // Configure encoder: 44.1kHz stereo, 192kbps MP3
-    enc_ctx->sample_rate = 44100;
-    enc_ctx->channel_layout = AV_CH_LAYOUT_STEREO;
-    enc_ctx->channels = 2;
-    // Use FLTP (float planar) which is well-supported by libmp3lame
-    enc_ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;
-    enc_ctx->bit_rate = 192000;
+    // Whole-file conversion; keep it off the CQ thread and the DSP executor
+    status_ = PRODUCING;
+    svc_->extractExecutor_->submit([this]()
+                                   { convert(); });
+}
 
-    if (int ret = avcodec_open2(enc_ctx, enc, nullptr))
-    {
-        std::cerr << "  ERROR: avcodec_open2 (encoder): " << av_err_to_string(ret) << std::endl;
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to open encoder"), this);
-        return;
-    }
+void AudioProcessorAsync::ExtractAudioStreamCallData::fail(grpc::StatusCode code, const std::string &message)
+{
+    LOG_WARN("upload.rejected")
+        .kv("req", request_id_)
+        .kv("received_bytes", bytes_->size())
+        .kv("error", message);
+    outcome_ = Outcome::ERROR;
+    release_permit();
+    bytes_.reset();
+    status_ = FINISH;
+    reader_.FinishWithError(grpc::Status(code, message), this);
+}
 
-    // Build libavfilter graph
-    AVFilterGraph *graph = avfilter_graph_alloc();
-    if (!graph)
+// Runs on the extract executor; Finish() completes on cq_ in FINISH state
+void AudioProcessorAsync::ExtractAudioStreamCallData::convert()
+{
+    // The client may have gone while this waited for a worker; don't write its output
+    if (ctx_.IsCancelled())
     {
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to alloc filter graph"), this);
+        fail(grpc::StatusCode::CANCELLED, "Upload cancelled");
         return;
     }
+    if (!svc_->extract_audio(request_, request_id_, response_, std::move(bytes_)))
+        outcome_ = Outcome::ERROR;
+    release_permit();
+    status_ = FINISH;
+    reader_.Finish(response_, grpc::Status::OK, this);
+}
+
+// ============================================================================
+// GetAudioInfoCallData Implementation
+// ============================================================================
 
-    // Source filter (input) - abuffer
-    uint64_t channel_layout = dec_ctx->channel_layout;
-    if (!channel_layout)
+AudioProcessorAsync::GetAudioInfoCallData::GetAudioInfoCallData(
+    AudioProcessorAsync *svc, grpc::ServerCompletionQueue *cq)
+    : CallData(svc, cq), responder_(&ctx_)
+{
+    Proceed();
+}
+
+void AudioProcessorAsync::GetAudioInfoCallData::Proceed()
+{
+    if (status_ == CREATE)
     {
-        channel_layout = av_get_default_channel_layout(dec_ctx->channels);
+        status_ = PROCESS;
+        svc_->service_->RequestGetAudioInfo(&ctx_, &request_, &responder_, cq_, cq_, this);
     }
+    else if (status_ == PROCESS)
+    {
+        new GetAudioInfoCallData(svc_, cq_);
+        rpc_started(Rpc::GET_AUDIO_INFO);
 
-    char src_args[512];
-    snprintf(src_args, sizeof(src_args),
-             "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64,
-             1, dec_ctx->sample_rate,
-             dec_ctx->sample_rate,
-             av_get_sample_fmt_name(dec_ctx->sample_fmt),
-             channel_layout);
+        LOG_DEBUG("info.start").kv("req", request_id_).kv("audio", request_.audio_path());
 
-    std::cout << "  Filter source args: " << src_args << std::endl;
+        // A hit costs one stat(); no admission permit needed
+        soundboard::AudioInfo info;
+        if (svc_->audioInfoCache_.find(request_.audio_path(), info))
+        {
+            respond(info);
+            return;
+        }
 
-    AVFilterContext *src_ctx = nullptr;
-    const AVFilter *abuffer = avfilter_get_by_name("abuffer");
-    if (!abuffer)
+        // Probing does file I/O (and maybe libavformat), keep it off the CQ thread
+        status_ = PRODUCING;
+        svc_->dspExecutor_->submit([this]()
+                                   { probe(); });
+    }
+    else if (status_ == PRODUCING)
     {
-        std::cerr << "  ERROR: abuffer filter not found" << std::endl;
-        avfilter_graph_free(&graph);
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
+        // Probe failed on the executor; the success path responds from there
         status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "abuffer filter not found"), this);
-        return;
+        responder_.FinishWithError(probe_status_, this);
+    }
+    else
+    { // FINISH
+        delete this;
     }
+}
 
-    if (int ret = avfilter_graph_create_filter(&src_ctx, abuffer, "in", src_args, nullptr, graph))
+// Runs on the DSP executor
+void AudioProcessorAsync::GetAudioInfoCallData::probe()
+{
+    soundboard::AudioInfo info;
+    std::string err;
+    auto result = svc_->audioInfoCache_.get(request_.audio_path(), info, err);
+    if (result == soundboard::AudioInfoCache::Result::OK)
     {
-        std::cerr << "  ERROR: failed to create abuffer: " << av_err_to_string(ret) << std::endl;
-        avfilter_graph_free(&graph);
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to create source filter"), this);
+        respond(info);
         return;
     }
 
-    // Sink filter (output) - abuffersink
-    AVFilterContext *sink_ctx = nullptr;
-    const AVFilter *abuffersink = avfilter_get_by_name("abuffersink");
-    if (!abuffersink)
+    LOG_ERROR("info.failed").kv("req", request_id_).kv("audio", request_.audio_path()).kv("error", err);
+    outcome_ = Outcome::ERROR;
+    probe_status_ = grpc::Status(result == soundboard::AudioInfoCache::Result::NOT_FOUND
+                                     ? grpc::StatusCode::NOT_FOUND
+                                     : grpc::StatusCode::INTERNAL,
+                                 "Failed to probe audio: " + err);
+    alarm_.Set(cq_, gpr_now(GPR_CLOCK_MONOTONIC), this);
+}
+
+// Finish() may be called from any thread; its completion lands on cq_ in FINISH state
+void AudioProcessorAsync::GetAudioInfoCallData::respond(const soundboard::AudioInfo &info)
+{
+    response_.set_duration_seconds(static_cast<float>(info.duration_seconds));
+    response_.set_sample_rate(info.sample_rate);
+    response_.set_channels(info.channels);
+    response_.set_bitrate_kbps(info.bitrate_kbps);
+    response_.set_format(info.format);
+    status_ = FINISH;
+    responder_.Finish(response_, grpc::Status::OK, this);
+}
+
+// ============================================================================
+// ApplyEffectsStreamCallData Impl
+// ============================================================================
+
+AudioProcessorAsync::ApplyEffectsStreamCallData::ApplyEffectsStreamCallData(
+    AudioProcessorAsync *svc, grpc::ServerCompletionQueue *cq)
+    : CallData(svc, cq), writer_(&ctx_), streaming_started_(false), streaming_no_effects_(false),
+      chunk_sequence_(0), stream_time_us_(0), produce_result_(ProduceResult::DONE), pending_chunk_(nullptr),
+      pending_allocations_(0),
+      queue_head_(0), queued_chunks_(0), writer_idle_(false), producer_blocked_(false),
+      production_ended_(false), production_result_(ProduceResult::DONE), client_gone_(false), low_latency_(false),
+      cache_leader_(false), cache_read_index_(0),
+      range_active_(false),
+      stage_ns_{}, stage_timed_(false), streamed_audio_us_(0)
+{
+    Proceed();
+}
+
+void AudioProcessorAsync::ApplyEffectsStreamCallData::Proceed()
+{
+    if (status_ == CREATE)
     {
-        std::cerr << "  ERROR: abuffersink filter not found" << std::endl;
-        avfilter_graph_free(&graph);
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "abuffersink filter not found"), this);
-        return;
+        status_ = PROCESS;
+
+        // Request the RPC (enqueues a tag on the CQ)
+        svc_->service_->RequestApplyEffectsStream(&ctx_, &request_, &writer_, cq_, cq_, this);
     }
+    else if (status_ == PROCESS)
+    {
+        // This state runs once: when a new RPC arrives
+        // Spawn a new CallData immediately to handle the next incoming request
+        new ApplyEffectsStreamCallData(svc_, cq_);
+        rpc_started(Rpc::APPLY_EFFECTS_STREAM);
 
-    if (int ret = avfilter_graph_create_filter(&sink_ctx, abuffersink, "out", nullptr, nullptr, graph))
+        switch (request_permit(soundboard::AdmissionQueue::Method::APPLY_EFFECTS))
+        {
+        case soundboard::AdmissionQueue::Result::ADMITTED:
+            begin_streaming();
+            break;
+        case soundboard::AdmissionQueue::Result::QUEUED:
+            // Parked; alarm_ brings us back in QUEUED state
+            break;
+        case soundboard::AdmissionQueue::Result::REJECTED:
+            reject_busy("Admission queue full");
+            break;
+        }
+    }
+    else if (status_ == QUEUED)
     {
-        std::cerr << "  ERROR: failed to create abuffersink: " << av_err_to_string(ret) << std::endl;
-        avfilter_graph_free(&graph);
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to create sink filter"), this);
-        return;
+        if (resolve_permit())
+            begin_streaming();
+        else
+            reject_busy("Admission queue timeout");
+    }
+    else if (status_ == PRODUCING)
+    {
+        // Idle writer woken via alarm_: a chunk was queued or production is over
+        write_next();
+    }
+    else if (status_ == WRITING && !event_ok_)
+    {
+        // The Write() failed: the client cancelled or the connection broke
+        stop_production();
+    }
+    else if (status_ == WRITING)
+    {
+        // Previous Write() completed: free its slot (waking a producer blocked on a full
+        // queue) and send the next chunk if one is ready
+        stage_ns_[STAGE_WRITE] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - write_started_at_)
+                                      .count();
+        bool resume_producer;
+        {
+            std::lock_guard<std::mutex> lock(queue_mu_);
+            queue_head_ = (queue_head_ + 1) % chunk_queue_.size();
+            --queued_chunks_;
+            resume_producer = producer_blocked_;
+            producer_blocked_ = false;
+        }
+        if (resume_producer)
+            schedule_produce();
+        write_next();
     }
+    else
+    { // FINISH
+        release_permit();
+        release_streaming_state();
+        if (cache_leader_)
+            svc_->effectsCache_.abandon(cache_key_, cache_clip_);
+        delete this;
+    }
+}
 
-    // Set output format constraints on the sink to match encoder requirements
-    static const enum AVSampleFormat out_sample_fmts[] = {AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_NONE};
-    static const int64_t out_channel_layouts[] = {AV_CH_LAYOUT_STEREO, -1};
-    static const int out_sample_rates[] = {44100, -1};
+void AudioProcessorAsync::ApplyEffectsStreamCallData::reject_busy(const char *reason)
+{
+    log_busy(reason);
+    status_ = FINISH;
+    writer_.Finish(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Processor busy"), this);
+}
 
-    av_opt_set_int_list(sink_ctx, "sample_fmts", out_sample_fmts, AV_SAMPLE_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
-    av_opt_set_int_list(sink_ctx, "channel_layouts", out_channel_layouts, -1, AV_OPT_SEARCH_CHILDREN);
-    av_opt_set_int_list(sink_ctx, "sample_rates", out_sample_rates, -1, AV_OPT_SEARCH_CHILDREN);
+void AudioProcessorAsync::ApplyEffectsStreamCallData::begin_streaming()
+{
+    LOG_INFO("stream.start")
+        .kv("req", request_id_)
+        .kv("audio", request_.audio_path())
+        .kv("speed", request_.speed_factor())
+        .kv("pitch", request_.pitch_factor())
+        .kv("start_s", request_.start_seconds())
+        .kv("end_s", request_.end_seconds())
+        .kv("low_latency", request_.low_latency() || svc_->lowLatencyDefault_);
+    if (!validate_range())
+        return;
+    low_latency_ = request_.low_latency() || svc_->lowLatencyDefault_;
+
+    // Graph setup and the chunks are produced on the DSP executor, up to readAheadChunks
+    // ahead of the writer; the writer idles (PRODUCING) until the first one is queued
+    chunk_queue_.resize(svc_->readAheadChunks_);
+    status_ = PRODUCING;
+    writer_idle_ = true;
+    schedule_produce();
+}
 
-    // Build filter chain by creating and linking filters manually
-    AVFilterContext *last_ctx = src_ctx;
+// Reject malformed ranges up front; marks the call as a range request otherwise
+bool AudioProcessorAsync::ApplyEffectsStreamCallData::validate_range()
+{
+    double start = request_.start_seconds();
+    double end = request_.end_seconds();
+    if (start == 0.0 && end == 0.0)
+        return true;
 
-    // Create atempo filter if speed != 1.0
-    if (speed != 1.0f)
+    if (!std::isfinite(start) || !std::isfinite(end) || start < 0.0 || end < 0.0 || (end > 0.0 && end <= start))
     {
-        char atempo_args[64];
-        snprintf(atempo_args, sizeof(atempo_args), "tempo=%.2f", speed);
+        LOG_WARN("stream.invalid_range").kv("req", request_id_).kv("start_s", start).kv("end_s", end);
+        outcome_ = Outcome::ERROR;
+        status_ = FINISH;
+        writer_.Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid range"), this);
+        return false;
+    }
+    range_active_ = true;
+    return true;
+}
+
+void AudioProcessorAsync::ApplyEffectsStreamCallData::schedule_produce()
+{
+    svc_->dspExecutor_->submit([this]()
+                               { run_producer(); });
+}
 
-        const AVFilter *atempo_filter = avfilter_get_by_name("atempo");
-        if (!atempo_filter)
+// Runs on the DSP executor: fills the next free queue slot with one chunk, then requeues
+// itself for the one after, until the queue is full (the writer resumes it) or the stream
+// is over
+void AudioProcessorAsync::ApplyEffectsStreamCallData::run_producer()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mu_);
+        if (client_gone_)
         {
-            std::cerr << "  ERROR: atempo filter not found" << std::endl;
-            avfilter_graph_free(&graph);
-            avcodec_free_context(&enc_ctx);
-            avcodec_free_context(&dec_ctx);
-            avformat_close_input(&in_fmt);
-            status_ = FINISH;
-            writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "atempo filter not found"), this);
+            abandon_production();
             return;
         }
+    }
 
-        AVFilterContext *atempo_ctx = nullptr;
-        if (int ret = avfilter_graph_create_filter(&atempo_ctx, atempo_filter, "atempo", atempo_args, nullptr, graph))
+    if (!streaming_started_)
+    {
+        streaming_started_ = true;
+        if (!open_cache_entry() && !start_processing())
         {
-            std::cerr << "  ERROR: failed to create atempo filter: " << av_err_to_string(ret) << std::endl;
-            avfilter_graph_free(&graph);
-            avcodec_free_context(&enc_ctx);
-            avcodec_free_context(&dec_ctx);
-            avformat_close_input(&in_fmt);
-            status_ = FINISH;
-            writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to create atempo filter"), this);
+            if (cache_leader_)
+                svc_->effectsCache_.abandon(cache_key_, cache_clip_);
+            end_production(ProduceResult::FAILED);
             return;
         }
-
-        if (int ret = avfilter_link(last_ctx, 0, atempo_ctx, 0))
+        // Cache replays swap in the clip's own buffers instead
+        if (!cache_clip_ || cache_leader_)
         {
-            std::cerr << "  ERROR: failed to link to atempo: " << av_err_to_string(ret) << std::endl;
-            avfilter_graph_free(&graph);
-            avcodec_free_context(&enc_ctx);
-            avcodec_free_context(&dec_ctx);
-            avformat_close_input(&in_fmt);
-            status_ = FINISH;
-            writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to link atempo filter"), this);
-            return;
+            for (auto &chunk : chunk_queue_)
+                chunk.mutable_data()->reserve(chunk_buffer_capacity());
         }
-        last_ctx = atempo_ctx;
-        std::cout << "  Added atempo filter: " << atempo_args << std::endl;
     }
 
-    // Create rubberband filter if pitch != 1.0 (if available)
-    if (pitch != 1.0f)
+    // Claim the next free slot (after a YIELD we still hold the one being filled)
+    if (!pending_chunk_)
     {
-        const AVFilter *rubberband_filter = avfilter_get_by_name("rubberband");
-        if (rubberband_filter)
+        std::unique_lock<std::mutex> lock(queue_mu_);
+        if (client_gone_)
         {
-            char rubberband_args[128];
-            snprintf(rubberband_args, sizeof(rubberband_args), "pitch=%.2f", pitch);
-
-            AVFilterContext *rubberband_ctx = nullptr;
-            if (int ret = avfilter_graph_create_filter(&rubberband_ctx, rubberband_filter, "rubberband", rubberband_args, nullptr, graph))
-            {
-                std::cerr << "  WARNING: failed to create rubberband filter: " << av_err_to_string(ret) << std::endl;
-                std::cerr << "  Pitch shifting will be skipped" << std::endl;
-            }
-            else
-            {
-                if (int ret = avfilter_link(last_ctx, 0, rubberband_ctx, 0))
-                {
-                    std::cerr << "  WARNING: failed to link to rubberband: " << av_err_to_string(ret) << std::endl;
-                }
-                else
-                {
-                    last_ctx = rubberband_ctx;
-                    std::cout << "  Added rubberband filter: " << rubberband_args << std::endl;
-                }
-            }
+            lock.unlock();
+            abandon_production();
+            return;
         }
-        else
+        if (queued_chunks_ == chunk_queue_.size())
         {
-            std::cerr << "  WARNING: rubberband filter not available, pitch shifting skipped" << std::endl;
+            producer_blocked_ = true;
+            return;
         }
+        pending_chunk_ = &chunk_queue_[(queue_head_ + queued_chunks_) % chunk_queue_.size()];
+        pending_chunk_->mutable_data()->clear();
     }
 
-    // Create aformat filter to convert to encoder's expected format
-    char aformat_args[256];
-    snprintf(aformat_args, sizeof(aformat_args),
-             "sample_fmts=%s:sample_rates=%d:channel_layouts=stereo",
-             av_get_sample_fmt_name(AV_SAMPLE_FMT_FLTP),
-             enc_ctx->sample_rate);
+    // Steady state (buffers sized, past the small first chunk) should not touch the heap
+    // from our side; a cache leader's copies into the clip are expected and not counted.
+    // A chunk may take several runs (YIELDs), so its count builds up until it is published.
+    bool count_allocations = soundboard::allocation_counting_enabled() && chunk_sequence_ >= 2 && !cache_clip_;
+    uint64_t allocations_before = soundboard::thread_allocations();
+
+    // false: parked on another request's render; its next append reschedules us
+    if (!produce_next_chunk())
+        return;
 
-    const AVFilter *aformat_filter = avfilter_get_by_name("aformat");
-    if (aformat_filter)
+    switch (produce_result_)
     {
-        AVFilterContext *aformat_ctx = nullptr;
-        if (int ret = avfilter_graph_create_filter(&aformat_ctx, aformat_filter, "aformat", aformat_args, nullptr, graph))
+    case ProduceResult::CHUNK:
+        if (count_allocations)
         {
-            std::cerr << "  WARNING: failed to create aformat filter: " << av_err_to_string(ret) << std::endl;
-        }
-        else
-        {
-            if (int ret = avfilter_link(last_ctx, 0, aformat_ctx, 0))
-            {
-                std::cerr << "  WARNING: failed to link to aformat: " << av_err_to_string(ret) << std::endl;
-            }
-            else
-            {
-                last_ctx = aformat_ctx;
-                std::cout << "  Added aformat filter: " << aformat_args << std::endl;
-            }
+            svc_->metrics_.steady_allocations.add(pending_allocations_ + soundboard::thread_allocations() -
+                                                  allocations_before);
+            svc_->metrics_.steady_chunks.add();
         }
+        pending_allocations_ = 0;
+        publish_chunk();
+        schedule_produce();
+        break;
+    case ProduceResult::YIELD:
+        if (count_allocations)
+            pending_allocations_ += soundboard::thread_allocations() - allocations_before;
+        // Budget spent without a chunk: requeue behind the other streams' work
+        schedule_produce();
+        break;
+    case ProduceResult::DONE:
+    case ProduceResult::FAILED:
+        end_production(produce_result_);
+        break;
     }
+}
 
-    // Add asetnsamples filter to ensure exactly 1152 samples per frame (required by MP3 encoder)
-    const AVFilter *asetnsamples_filter = avfilter_get_by_name("asetnsamples");
-    if (asetnsamples_filter)
+// Producer side: hand the filled slot to the writer, waking it if it is idle
+void AudioProcessorAsync::ApplyEffectsStreamCallData::publish_chunk()
+{
+    bool wake_writer;
     {
-        AVFilterContext *asetnsamples_ctx = nullptr;
-        // MP3 frame size is 1152 samples, pad the last frame
-        if (int ret = avfilter_graph_create_filter(&asetnsamples_ctx, asetnsamples_filter, "asetnsamples", "n=1152:p=1", nullptr, graph))
-        {
-            std::cerr << "  WARNING: failed to create asetnsamples filter: " << av_err_to_string(ret) << std::endl;
-        }
-        else
-        {
-            if (int ret = avfilter_link(last_ctx, 0, asetnsamples_ctx, 0))
-            {
-                std::cerr << "  WARNING: failed to link to asetnsamples: " << av_err_to_string(ret) << std::endl;
-            }
-            else
-            {
-                last_ctx = asetnsamples_ctx;
-                std::cout << "  Added asetnsamples filter: n=1152:p=1" << std::endl;
-            }
-        }
+        std::lock_guard<std::mutex> lock(queue_mu_);
+        ++queued_chunks_;
+        wake_writer = writer_idle_;
+        writer_idle_ = false;
     }
+    pending_chunk_ = nullptr;
+    // Zero-deadline alarm posts this call's tag back onto its completion queue
+    if (wake_writer)
+        alarm_.Set(cq_, gpr_now(GPR_CLOCK_MONOTONIC), this);
+}
 
-    // Link the last filter to the sink
-    if (int ret = avfilter_link(last_ctx, 0, sink_ctx, 0))
+// Producer side: no more chunks; the writer finishes the call once the queue drains
+void AudioProcessorAsync::ApplyEffectsStreamCallData::end_production(ProduceResult result)
+{
+    bool wake_writer;
     {
-        std::cerr << "  ERROR: failed to link to sink: " << av_err_to_string(ret) << std::endl;
-        avfilter_graph_free(&graph);
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to link to sink"), this);
-        return;
+        std::lock_guard<std::mutex> lock(queue_mu_);
+        production_ended_ = true;
+        production_result_ = result;
+        wake_writer = writer_idle_;
+        writer_idle_ = false;
     }
+    if (wake_writer)
+        alarm_.Set(cq_, gpr_now(GPR_CLOCK_MONOTONIC), this);
+}
 
-    // Configure the filter graph
-    if (int ret = avfilter_graph_config(graph, nullptr))
+// Producer side, once the client is gone: free the pipeline and give up cache leadership
+// now, so the render stops here and followers aren't left waiting on it
+void AudioProcessorAsync::ApplyEffectsStreamCallData::abandon_production()
+{
+    release_streaming_state();
+    if (cache_leader_)
     {
-        std::cerr << "  ERROR: avfilter_graph_config: " << av_err_to_string(ret) << std::endl;
-        avfilter_graph_free(&graph);
-        avcodec_free_context(&enc_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt);
-        status_ = FINISH;
-        writer_.Finish(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to configure filter graph"), this);
-        return;
+        svc_->effectsCache_.abandon(cache_key_, cache_clip_);
+        cache_leader_ = false;
     }
-
-    std::cout << "  Filter graph configured successfully" << std::endl;
-
-    // Store for processing
-    streaming_in_fmt_ = in_fmt;
-    streaming_audio_stream_idx_ = audio_stream_index;
-    streaming_dec_ctx_ = dec_ctx;
-    streaming_enc_ctx_ = enc_ctx;
-    streaming_graph_ = graph;
-    streaming_src_ctx_ = src_ctx;
-    streaming_sink_ctx_ = sink_ctx;
-    streaming_filter_desc_ = filter_desc;
+    end_production(ProduceResult::FAILED);
 }
 
-void AudioProcessorAsync::ApplyEffectsStreamCallData::send_next_chunk()
+// CQ thread, after a failed Write(): queued chunks are dropped and the producer stops at
+// its next run. A producer parked on a full queue will not run again, so its production
+// is ended here; the call finishes once production is over.
+void AudioProcessorAsync::ApplyEffectsStreamCallData::stop_production()
 {
-    // Handle no-effects passthrough
-    if (streaming_no_effects_)
     {
-        // Read directly from input file and stream as MP3 chunks
-        if (!ffmpeg_pipe_)
+        std::lock_guard<std::mutex> lock(queue_mu_);
+        client_gone_ = true;
+        if (producer_blocked_)
         {
-            std::string cmd = "ffmpeg -i \"" + request_.audio_path() + "\" -acodec libmp3lame -ab 192k -ar 44100 -f mp3 - 2>/dev/null";
-            ffmpeg_pipe_ = popen(cmd.c_str(), "r");
-            if (!ffmpeg_pipe_)
-            {
-                finish_stream();
-                return;
-            }
+            producer_blocked_ = false;
+            production_ended_ = true;
+            production_result_ = ProduceResult::FAILED;
         }
+    }
+    write_next();
+}
 
-        size_t bytes_read = fread(ffmpeg_buffer_, 1, sizeof(ffmpeg_buffer_), ffmpeg_pipe_);
-        if (bytes_read > 0)
-        {
-            soundboard::AudioChunk chunk;
-            chunk.set_data(ffmpeg_buffer_, bytes_read);
-            chunk.set_sequence_number(chunk_sequence_++);
-            status_ = WRITING;
-            writer_.Write(chunk, this);
-        }
-        else
+// CQ thread: send the oldest queued chunk; with none queued, finish if production is
+// over, else go idle until the producer publishes (which wakes us via alarm_)
+void AudioProcessorAsync::ApplyEffectsStreamCallData::write_next()
+{
+    const soundboard::AudioChunk *chunk = nullptr;
+    ProduceResult result;
+    bool client_gone;
+    {
+        std::lock_guard<std::mutex> lock(queue_mu_);
+        client_gone = client_gone_;
+        if (queued_chunks_ > 0 && !client_gone)
+            chunk = &chunk_queue_[queue_head_];
+        else if (!production_ended_)
         {
-            finish_stream();
+            writer_idle_ = true;
+            status_ = PRODUCING;
+            return;
         }
-        return;
+        result = production_result_;
     }
 
-    // libavfilter streaming path
-    if (!streaming_frame_)
+    if (chunk)
+    {
+        if (chunk->sequence_number() == 0)
+            svc_->metrics_.first_chunk.observe(seconds_since(started_at_));
+        svc_->metrics_.stream_bytes.add(chunk->data().size());
+        svc_->metrics_.stream_chunks.add();
+        status_ = WRITING;
+        write_started_at_ = std::chrono::steady_clock::now();
+        writer_.Write(*chunk, this);
+    }
+    else if (client_gone)
     {
-        streaming_frame_ = av_frame_alloc();
-        streaming_filtered_frame_ = av_frame_alloc();
+        LOG_INFO("stream.cancelled")
+            .kv("req", request_id_)
+            .kv("chunks", chunk_sequence_)
+            .kv("elapsed_ms", static_cast<int64_t>(seconds_since(started_at_) * 1000));
+        outcome_ = Outcome::ERROR;
+        status_ = FINISH;
+        writer_.Finish(grpc::Status(grpc::StatusCode::CANCELLED, "Client stopped reading"), this);
+    }
+    else if (result == ProduceResult::DONE)
+    {
+        finish_stream();
     }
+    else
+    {
+        LOG_ERROR("stream.failed").kv("req", request_id_).kv("error", pending_status_.error_message());
+        outcome_ = Outcome::ERROR;
+        status_ = FINISH;
+        writer_.Finish(pending_status_, this);
+    }
+}
 
-    bool got_output = false;
+// Look up the rendered-effects cache. Returns true if this call will replay a
+// cached/in-flight render (no pipeline needed); false if it must render itself.
+bool AudioProcessorAsync::ApplyEffectsStreamCallData::open_cache_entry()
+{
+    float speed = clamp_factor(request_.speed_factor());
+    float pitch = clamp_factor(request_.pitch_factor());
+    // Ranges are rendered on demand: the cache holds whole clips only
+    if ((speed == 1.0f && pitch == 1.0f) || range_active_ || !svc_->effectsCache_.enabled())
+        return false;
+    if (!soundboard::make_effects_key(request_.audio_path(), speed, pitch, cache_key_))
+        return false;
+    // A short-window render must not be replayed to callers that asked for full quality,
+    // nor one engine's render to a server configured for the other
+    cache_key_.low_latency = low_latency_;
+    cache_key_.native_pitch = svc_->nativePitch_;
+
+    soundboard::EffectsCache::Role role;
+    cache_clip_ = svc_->effectsCache_.acquire(cache_key_, role);
+    switch (role)
+    {
+    case soundboard::EffectsCache::Role::HIT_MEMORY:
+        LOG_DEBUG("stream.source").kv("req", request_id_).kv("source", "cache_memory");
+        return true;
+    case soundboard::EffectsCache::Role::HIT_DISK:
+        LOG_DEBUG("stream.source").kv("req", request_id_).kv("source", "cache_disk");
+        return true;
+    case soundboard::EffectsCache::Role::FOLLOWER:
+        LOG_DEBUG("stream.source").kv("req", request_id_).kv("source", "shared_render");
+        return true;
+    case soundboard::EffectsCache::Role::LEADER:
+        cache_leader_ = true;
+        return false;
+    }
+    return false;
+}
 
-    // Helper lambda to try encoding filtered frames and sending output
-    auto try_encode_and_send = [&]() -> bool
+bool AudioProcessorAsync::ApplyEffectsStreamCallData::read_cached_chunk()
+{
+    soundboard::RenderedClip::Chunk chunk;
+    auto poll = cache_clip_->next(cache_read_index_, chunk, [this]()
+                                  { schedule_produce(); });
+    switch (poll)
     {
-        while (av_buffersink_get_frame(streaming_sink_ctx_, streaming_filtered_frame_) >= 0)
-        {
-            // Set proper PTS for the encoder
-            streaming_filtered_frame_->pts = streaming_pts_;
-            streaming_pts_ += streaming_filtered_frame_->nb_samples;
+    case soundboard::RenderedClip::Poll::CHUNK:
+        cache_read_index_++;
+        pending_chunk_->set_data(std::move(chunk.data));
+        emit_pending_chunk(chunk.duration_us);
+        return true;
+    case soundboard::RenderedClip::Poll::PENDING:
+        return false;
+    case soundboard::RenderedClip::Poll::END:
+        produce_result_ = ProduceResult::DONE;
+        return true;
+    case soundboard::RenderedClip::Poll::FAILED:
+        pending_status_ = grpc::Status(grpc::StatusCode::INTERNAL, "Shared render failed");
+        produce_result_ = ProduceResult::FAILED;
+        return true;
+    }
+    return true;
+}
 
-            int ret = avcodec_send_frame(streaming_enc_ctx_, streaming_filtered_frame_);
-            av_frame_unref(streaming_filtered_frame_);
+// End of stream on the producer side: free FFmpeg state and publish a leader's render
+void AudioProcessorAsync::ApplyEffectsStreamCallData::finish_production()
+{
+    release_streaming_state();
+    if (cache_leader_)
+    {
+        svc_->effectsCache_.publish(cache_key_, cache_clip_);
+        cache_leader_ = false;
+    }
+    produce_result_ = ProduceResult::DONE;
+}
 
-            if (ret < 0)
-            {
-                continue;
-            }
+// No-effects request: if the input is already MPEG-1 Layer III 44.1kHz stereo (what
+// convert_to_mp3_libav produces), open it for raw streaming. Otherwise the caller
+// falls back to an in-process transcode through the filter graph.
+bool AudioProcessorAsync::ApplyEffectsStreamCallData::open_passthrough()
+{
+    soundboard::Mp3StreamInfo info;
+    std::string probe_err;
+    if (!soundboard::probe_mp3_file(request_.audio_path(), info, probe_err) ||
+        !soundboard::is_passthrough_compatible(info))
+    {
+        LOG_DEBUG("stream.passthrough_unavailable").kv("req", request_id_).kv("reason", probe_err.empty() ? "format" : probe_err);
+        return false;
+    }
 
-            AVPacket *enc_pkt = av_packet_alloc();
-            while (avcodec_receive_packet(streaming_enc_ctx_, enc_pkt) >= 0)
-            {
-                soundboard::AudioChunk chunk;
-                chunk.set_data(enc_pkt->data, enc_pkt->size);
-                chunk.set_sequence_number(chunk_sequence_++);
-                status_ = WRITING;
-                av_packet_unref(enc_pkt);
-                av_packet_free(&enc_pkt);
-                writer_.Write(chunk, this);
-                return true;
-            }
-            av_packet_free(&enc_pkt);
-        }
+    if (!passthrough_.open(request_.audio_path(), info, probe_err))
+    {
+        LOG_DEBUG("stream.passthrough_unavailable").kv("req", request_id_).kv("reason", probe_err);
         return false;
-    };
+    }
+
+    LOG_DEBUG("stream.source").kv("req", request_id_).kv("source", "passthrough").kv("bitrate_kbps", info.bitrate_kbps);
+    streaming_no_effects_ = true;
+    return true;
+}
 
-    // Phase 1: Read and decode packets from input
-    if (!decoder_flushed_)
+bool AudioProcessorAsync::ApplyEffectsStreamCallData::start_processing()
+{
+    float speed = clamp_factor(request_.speed_factor());
+    float pitch = clamp_factor(request_.pitch_factor());
+
+    // If no modifications and the file is already 44.1kHz stereo MP3, stream its bytes directly
+    // (a range needs sample-accurate cuts, so it always goes through the graph)
+    if (speed == 1.0f && pitch == 1.0f && !range_active_ && open_passthrough())
     {
-        AVPacket *pkt = av_packet_alloc();
-        int read_ret = av_read_frame(streaming_in_fmt_, pkt);
+        return true;
+    }
 
-        if (read_ret >= 0)
+    streaming_no_effects_ = false;
+
+    soundboard::EffectsOptions effects;
+    effects.low_latency = low_latency_;
+    effects.native_pitch = svc_->nativePitch_;
+
+    // Same sizes as target_chunk_bytes(), plus the latency cap for slow encodes
+    soundboard::ChunkSink::Options chunking;
+    chunking.first_chunk_bytes = low_latency_ ? svc_->lowLatencyFirstChunkBytes_ : svc_->firstChunkBytes_;
+    chunking.chunk_bytes = svc_->chunkBytes_;
+    chunking.max_latency = svc_->chunkMaxLatency_;
+
+    // A hot clip's decoded PCM may already be in memory, leaving nothing to open. Ranges
+    // seek the demuxer, so they always decode.
+    std::shared_ptr<const soundboard::DecodedClip> clip;
+    if (!range_active_)
+        clip = svc_->pcmCache_.lookup(request_.audio_path());
+
+    soundboard::AudioFormat in_format;
+    soundboard::AudioInputOptions input_options;
+    soundboard::Demuxer demuxer;
+    soundboard::Decoder decoder;
+    soundboard::AudioPipeline::InputRange range;
+    if (clip)
+    {
+        in_format = soundboard::AudioFormat{soundboard::DecodedClip::kSampleRate, AV_SAMPLE_FMT_FLTP,
+                                            clip->channel_layout(), clip->channels()};
+    }
+    else
+    {
+        // Open input and decoder. In low-latency mode a file whose first frame header parses
+        // as MP3 skips the stream-info analysis pass: the header already has what we need.
+        if (low_latency_)
         {
-            if (pkt->stream_index == streaming_audio_stream_idx_)
-            {
-                avcodec_send_packet(streaming_dec_ctx_, pkt);
-
-                while (avcodec_receive_frame(streaming_dec_ctx_, streaming_frame_) == 0)
-                {
-                    // Push frame to filter graph
-                    if (av_buffersrc_add_frame_flags(streaming_src_ctx_, streaming_frame_, AV_BUFFERSRC_FLAG_KEEP_REF) < 0)
-                    {
-                        av_frame_unref(streaming_frame_);
-                        break;
-                    }
-                    av_frame_unref(streaming_frame_);
-
-                    // Try to get filtered output and encode
-                    if (try_encode_and_send())
-                    {
-                        got_output = true;
-                        break;
-                    }
-                }
-            }
-            av_packet_unref(pkt);
+            soundboard::Mp3StreamInfo mp3;
+            std::string probe_err;
+            input_options.fast_probe = soundboard::probe_mp3_file(request_.audio_path(), mp3, probe_err);
         }
-        else
+        std::string input_err;
+        if (!soundboard::open_decoder_input(request_.audio_path(), input_options, demuxer, decoder, input_err))
         {
-            // End of input - start flushing decoder
-            decoder_flushed_ = true;
-            avcodec_send_packet(streaming_dec_ctx_, nullptr);
+            LOG_ERROR("stream.open_failed").kv("req", request_id_).kv("stage", "input").kv("error", input_err);
+            pending_status_ = grpc::Status(grpc::StatusCode::INTERNAL, "Failed to open input");
+            return false;
         }
-        av_packet_free(&pkt);
+        in_format = decoder.format();
+
+        if (range_active_)
+            range = setup_range(demuxer, in_format.sample_rate, effects.trim, speed);
     }
 
-    // Phase 2: Flush decoder
-    if (!got_output && decoder_flushed_ && !filter_flushed_)
+    // Encoder (44.1kHz stereo, 192kbps MP3) plus the libavfilter graph for time-stretching
+    // and pitch-shifting; with neither effect, the graph only converts format and the stream
+    // is a plain in-process transcode. Full-file requests take a pre-built pipeline from the
+    // pool; a range's atrim is request-specific, so it always builds its own.
+    soundboard::StreamPipeline stages;
+    std::string pipeline_err;
+    bool pooled = false;
+    bool opened = range_active_
+                      ? soundboard::open_stream_pipeline(in_format, speed, pitch, effects, stages, pipeline_err)
+                      : svc_->pipelinePool_.acquire(soundboard::PipelineKey::of(in_format, speed, pitch, effects),
+                                                    stages, pooled, pipeline_err);
+    if (!opened)
     {
-        while (avcodec_receive_frame(streaming_dec_ctx_, streaming_frame_) == 0)
-        {
-            if (av_buffersrc_add_frame_flags(streaming_src_ctx_, streaming_frame_, AV_BUFFERSRC_FLAG_KEEP_REF) < 0)
-            {
-                av_frame_unref(streaming_frame_);
-                break;
-            }
-            av_frame_unref(streaming_frame_);
+        LOG_ERROR("stream.open_failed").kv("req", request_id_).kv("stage", "pipeline").kv("error", pipeline_err);
+        pending_status_ = grpc::Status(grpc::StatusCode::INTERNAL, "Failed to set up encoder or filter graph");
+        return false;
+    }
+    soundboard::FilterChain filters;
+    soundboard::Encoder encoder;
+    soundboard::adopt_stream_pipeline(stages, filters, encoder);
+
+    const bool pcm_cache = clip != nullptr;
+    if (clip)
+        pipeline_ = std::make_unique<soundboard::AudioPipeline>(std::move(clip), std::move(filters),
+                                                                std::move(encoder), chunking);
+    else
+        pipeline_ = std::make_unique<soundboard::AudioPipeline>(std::move(demuxer), std::move(decoder),
+                                                                std::move(filters), std::move(encoder),
+                                                                chunking, range);
+
+    const soundboard::EffectsGraph &graph = pipeline_->filters().graph();
+    if (pitch != 1.0f && !graph.pitch_applied)
+        LOG_WARN("stream.pitch_skipped").kv("req", request_id_).kv("reason", "channel layout not supported");
+    LOG_DEBUG("stream.source")
+        .kv("req", request_id_)
+        .kv("source", "libavfilter")
+        .kv("filters", graph.description)
+        .kv("pooled", pooled)
+        .kv("pcm_cache", pcm_cache)
+        .kv("fast_probe", input_options.fast_probe);
+    return true;
+}
 
-            if (try_encode_and_send())
-            {
-                got_output = true;
-                break;
-            }
-        }
+// Translate the requested output-time range into a demuxer seek, input-side sample
+// bounds and the graph's output trim. The seek lands kRangePrerollSeconds early (and on
+// a packet boundary); the pre-roll is decoded and filtered so atempo/rubberband are
+// primed, then cut by atrim.
+soundboard::AudioPipeline::InputRange AudioProcessorAsync::ApplyEffectsStreamCallData::setup_range(
+    soundboard::Demuxer &demuxer, int sample_rate, soundboard::EffectsTrim &trim, float speed)
+{
+    const double start_out = request_.start_seconds();
+    const double end_out = request_.end_seconds();
+    const double start_in = start_out * speed;
+    const double seek_in = std::max(0.0, start_in - kRangePrerollSeconds);
+
+    soundboard::AudioPipeline::InputRange range;
+    range.start_sample = std::llround(seek_in * sample_rate);
+    int64_t preroll_in_samples = std::llround(start_in * sample_rate) - range.start_sample;
+    trim.start_sample = std::llround(preroll_in_samples / speed);
+    if (end_out > 0.0)
+    {
+        trim.end_sample = trim.start_sample + std::llround((end_out - start_out) * sample_rate);
+        // Read a little past the end so the filters' internal latency is flushed through
+        range.stop_sample = std::llround((end_out * speed + kRangePrerollSeconds) * sample_rate);
+    }
 
-        if (!got_output)
+    // Chunk timestamps stay absolute in output time
+    stream_time_us_ = std::llround(start_out * 1000000.0);
+
+    if (seek_in > 0.0)
+    {
+        if (int ret = demuxer.seek(seek_in))
         {
-            // Flush the filter graph
-            filter_flushed_ = true;
-            if (av_buffersrc_add_frame_flags(streaming_src_ctx_, nullptr, 0) < 0)
-            {
-                // Filter flushing failed, continue anyway
-            }
+            // Unseekable input: decode from the top; the pipeline still drops the lead-in
+            LOG_WARN("stream.seek_failed").kv("req", request_id_).kv("error", soundboard::av_err_to_string(ret)).kv("fallback", "decode from start");
         }
     }
+    return range;
+}
+
+// Small first chunk so playback starts quickly, then larger ones to cut per-message overhead
+size_t AudioProcessorAsync::ApplyEffectsStreamCallData::target_chunk_bytes() const
+{
+    if (chunk_sequence_ > 0)
+        return svc_->chunkBytes_;
+    return low_latency_ ? svc_->lowLatencyFirstChunkBytes_ : svc_->firstChunkBytes_;
+}
+
+// Room for the largest chunk: a batch can overshoot its target by the last drained
+// packets, and passthrough reads whole pages past it. Reserved once, so no chunk reallocates.
+size_t AudioProcessorAsync::ApplyEffectsStreamCallData::chunk_buffer_capacity() const
+{
+    return soundboard::Mp3FrameReader::buffer_bytes(std::max(svc_->firstChunkBytes_, svc_->chunkBytes_));
+}
+
+// pending_chunk_'s data is already filled in; stamp it (run_producer then queues it for the writer)
+void AudioProcessorAsync::ApplyEffectsStreamCallData::emit_pending_chunk(int64_t duration_us)
+{
+    pending_chunk_->set_sequence_number(chunk_sequence_++);
+    pending_chunk_->set_start_us(stream_time_us_);
+    pending_chunk_->set_duration_us(duration_us);
+    stream_time_us_ += duration_us;
+    streamed_audio_us_ += duration_us;
+    produce_result_ = ProduceResult::CHUNK;
+
+    if (cache_leader_)
+    {
+        const std::string &data = pending_chunk_->data();
+        cache_clip_->append(reinterpret_cast<const uint8_t *>(data.data()), data.size(),
+                            pending_chunk_->start_us(), duration_us);
+    }
+}
+
+// Runs on the DSP executor: advances the pipeline until one chunk is ready, the stream
+// ends, or the work budget runs out (YIELD). Returns false only when parked waiting on
+// a shared render.
+bool AudioProcessorAsync::ApplyEffectsStreamCallData::produce_next_chunk()
+{
+    // Replay of a cached or in-flight render: no DSP at all
+    if (cache_clip_ && !cache_leader_)
+        return read_cached_chunk();
 
-    // Phase 3: Flush filter graph
-    if (!got_output && filter_flushed_ && !encoder_flushed_)
+    // Handle no-effects passthrough: whole frames of the original bytes, timed from their headers
+    if (streaming_no_effects_)
     {
-        if (try_encode_and_send())
-        {
-            got_output = true;
-        }
-        else
+        int64_t duration_us = 0;
+        std::string read_err;
+        switch (passthrough_.read(*pending_chunk_->mutable_data(), target_chunk_bytes(), duration_us, read_err))
         {
-            // Flush encoder
-            encoder_flushed_ = true;
-            avcodec_send_frame(streaming_enc_ctx_, nullptr);
+        case soundboard::Mp3FrameReader::Result::CHUNK:
+            emit_pending_chunk(duration_us);
+            break;
+        case soundboard::Mp3FrameReader::Result::END:
+            finish_production();
+            break;
+        case soundboard::Mp3FrameReader::Result::FAILED:
+            pending_status_ = grpc::Status(grpc::StatusCode::INTERNAL, "Failed to read input: " + read_err);
+            produce_result_ = ProduceResult::FAILED;
+            break;
         }
+        return true;
     }
 
-    // Phase 4: Flush encoder
-    if (!got_output && encoder_flushed_)
+    // libavfilter streaming path. A stretch with no output (atempo/rubberband priming,
+    // long silences trimmed away) is cut off at the work budget and resumed later, so one
+    // stream can't hold a DSP worker indefinitely.
+    soundboard::AudioPipeline::Budget budget;
+    budget.max_packets = svc_->pumpPacketBudget_;
+    budget.deadline = std::chrono::steady_clock::now() + svc_->pumpTimeBudget_;
+    stage_timed_ = true;
+
+    int64_t samples = 0;
+    switch (pipeline_->next_chunk(*pending_chunk_->mutable_data(), samples, budget))
     {
-        AVPacket *enc_pkt = av_packet_alloc();
-        if (avcodec_receive_packet(streaming_enc_ctx_, enc_pkt) >= 0)
-        {
-            soundboard::AudioChunk chunk;
-            chunk.set_data(enc_pkt->data, enc_pkt->size);
-            chunk.set_sequence_number(chunk_sequence_++);
-            status_ = WRITING;
-            av_packet_unref(enc_pkt);
-            av_packet_free(&enc_pkt);
-            writer_.Write(chunk, this);
-            got_output = true;
-        }
-        else
-        {
-            av_packet_free(&enc_pkt);
-            finish_stream();
-            return;
-        }
+    case soundboard::AudioPipeline::Result::CHUNK:
+        emit_pending_chunk(samples * 1000000 / pipeline_->output_sample_rate());
+        break;
+    case soundboard::AudioPipeline::Result::YIELD:
+        produce_result_ = ProduceResult::YIELD;
+        break;
+    case soundboard::AudioPipeline::Result::DONE:
+        finish_production();
+        break;
+    case soundboard::AudioPipeline::Result::FAILED:
+        pending_status_ = grpc::Status(grpc::StatusCode::INTERNAL, "Processing failed: " + pipeline_->error());
+        produce_result_ = ProduceResult::FAILED;
+        break;
     }
+    return true;
+}
 
-    // If no output was produced in phase 1, continue processing
-    if (!got_output && !decoder_flushed_)
+// Frees FFmpeg state; called on the executor at end of stream and again (no-op) on FINISH
+void AudioProcessorAsync::ApplyEffectsStreamCallData::release_streaming_state()
+{
+    if (pipeline_)
     {
-        // Continue to next iteration
-        send_next_chunk();
+        // PipelineStage and Stage share their first four entries
+        for (size_t st = 0; st < soundboard::kPipelineStageCount; ++st)
+            stage_ns_[st] += pipeline_->stage_ns()[st];
+        pipeline_.reset();
     }
+    passthrough_.close();
 }
 
 void AudioProcessorAsync::ApplyEffectsStreamCallData::finish_stream()
 {
-    status_ = FINISH;
-    std::cout << "  Result: SUCCESS (streamed " << chunk_sequence_ << " chunks)" << std::endl;
-
-    // Cleanup libavfilter resources
-    if (streaming_frame_)
-        av_frame_free(&streaming_frame_);
-    if (streaming_filtered_frame_)
-        av_frame_free(&streaming_filtered_frame_);
-    if (streaming_graph_)
-        avfilter_graph_free(&streaming_graph_);
-    if (streaming_enc_ctx_)
-        avcodec_free_context(&streaming_enc_ctx_);
-    if (streaming_dec_ctx_)
-        avcodec_free_context(&streaming_dec_ctx_);
-    if (streaming_in_fmt_)
-        avformat_close_input(&streaming_in_fmt_);
-    if (ffmpeg_pipe_)
-    {
-        pclose(ffmpeg_pipe_);
-        ffmpeg_pipe_ = nullptr;
+    // Stage split only for streams that ran the pipeline (not passthrough/cache replays)
+    if (stage_timed_)
+    {
+        for (int st = 0; st < STAGE_COUNT; ++st)
+            svc_->metrics_.stage[st].observe(stage_ns_[st] / 1e9);
     }
+    double wall = seconds_since(started_at_);
+    if (wall > 0.0 && streamed_audio_us_ > 0)
+        svc_->metrics_.realtime.observe(streamed_audio_us_ / 1e6 / wall);
 
+    status_ = FINISH;
+    LOG_INFO("stream.done")
+        .kv("req", request_id_)
+        .kv("chunks", chunk_sequence_)
+        .kv("audio_s", streamed_audio_us_ / 1e6)
+        .kv("elapsed_ms", static_cast<int64_t>(wall * 1000));
     writer_.Finish(grpc::Status::OK, this);
 }
@@ -2,60 +2,295 @@
 #define AUDIO_PROCESSOR_SERVICE_ASYNC_H
 
 #include <grpcpp/grpcpp.h>
+#include <grpcpp/alarm.h>
 #include <grpcpp/server_context.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <thread>
-#include <semaphore>
+#include <utility>
+#include <vector>
 #include "audio_processor.grpc.pb.h"
-
-// Forward declarations for FFmpeg types (avoid including headers directly)
-struct AVFormatContext;
-struct AVCodecContext;
-struct AVFilterGraph;
-struct AVFilterContext;
-struct AVFrame;
+#include "admission_queue.h"
+#include "audio_info.h"
+#include "audio_pipeline.h"
+#include "transcode_pipeline.h"
+#include "dsp_executor.h"
+#include "effects_cache.h"
+#include "effects_graph.h"
+#include "metrics.h"
+#include "mp3_probe.h"
+#include "pcm_cache.h"
+#include "pipeline_pool.h"
 
 // Async service implementation using the gRPC async pattern (CallData state machines)
 class AudioProcessorAsync {
 public:
-    explicit AudioProcessorAsync(int maxConcurrency);
+    struct Options {
+        int maxConcurrency = 1;
+        int dspThreads = 1;
+        // Workers for whole-file conversions (ExtractAudio and friends), kept apart from
+        // the DSP executor so uploads never starve ApplyEffectsStream producers (0 = dspThreads / 2)
+        int extractThreads = 0;
+        soundboard::AdmissionQueue::Limits admission;
+        soundboard::EffectsCache::Options effectsCache;
+
+        // ApplyEffectsStream batching: encoded packets are coalesced into chunks of
+        // about chunkBytes (firstChunkBytes for the first one, to start playback
+        // early); a partial batch is sent once it has been open for chunkMaxLatency
+        size_t firstChunkBytes = 8 * 1024;
+        size_t chunkBytes = 32 * 1024;
+        std::chrono::milliseconds chunkMaxLatency{200};
+
+        // Work one producer run may do without emitting a chunk (input packets, wall
+        // time) before it yields its DSP worker to other streams and is requeued
+        int pumpPacketBudget = 64;
+        std::chrono::microseconds pumpTimeBudget{5000};
+
+        // ApplyEffectsStream chunks a producer may run ahead of the client's writes
+        int readAheadChunks = 4;
+
+        // Low-latency streams (requested per call, or all calls when lowLatencyDefault):
+        // fast probe for MP3 input, short rubberband window, and a first chunk sent as
+        // soon as lowLatencyFirstChunkBytes are encoded (~2 MP3 frames)
+        bool lowLatencyDefault = false;
+        size_t lowLatencyFirstChunkBytes = 1024;
+
+        // Shift pitch with the built-in engine (NativeStretch) even where FFmpeg has
+        // rubberband; without rubberband it is used regardless
+        bool nativePitch = false;
+
+        // (speed, pitch) presets rendered at upload time when ExtractAudio asks for them
+        std::vector<std::pair<float, float>> prerenderPresets;
+
+        // BatchExtractAudio: conversions one call runs at once on the extract executor
+        // (0 = half of it; never more than extractThreads), and the most items one call may carry
+        int batchParallelism = 0;
+        int batchMaxItems = 1000;
+
+        // ExtractAudioStream: largest upload held in memory for conversion
+        size_t uploadMaxBytes = size_t(512) << 20;
+
+        // Pre-built encoder + filter graph pipelines per stream shape
+        soundboard::PipelinePool::Options pipelinePool;
+
+        // Decoded PCM of hot clips, fed to effects graphs without demux/decode
+        soundboard::PcmCache::Options pcmCache;
+
+        // GetAudioInfo results kept (validated by file identity on each lookup)
+        size_t audioInfoCacheEntries = 4096;
+
+        // Prometheus /metrics listener (0 disables)
+        int metricsPort = 9100;
+    };
+
+    explicit AudioProcessorAsync(const Options& options);
     ~AudioProcessorAsync();
     
     void Run(const std::string& server_address, int num_cq_threads);
 
 private:
     int maxConcurrency_;
-    std::counting_semaphore<1024> concurrencySem;
+    soundboard::AdmissionQueue admission_;
+    soundboard::PipelinePool pipelinePool_; // outlives dspExecutor_, which runs its refills
+    soundboard::PcmCache pcmCache_;         // likewise, for its background decodes
+    std::unique_ptr<soundboard::DspExecutor> dspExecutor_;
+    std::unique_ptr<soundboard::DspExecutor> extractExecutor_;
+    soundboard::EffectsCache effectsCache_;
+    size_t firstChunkBytes_;
+    size_t chunkBytes_;
+    std::chrono::milliseconds chunkMaxLatency_;
+    int pumpPacketBudget_;
+    std::chrono::microseconds pumpTimeBudget_;
+    int readAheadChunks_;
+    bool lowLatencyDefault_;
+    size_t lowLatencyFirstChunkBytes_;
+    bool nativePitch_;
+    std::vector<std::pair<float, float>> prerenderPresets_;
+    int batchParallelism_;
+    int batchMaxItems_;
+    size_t uploadMaxBytes_;
+    soundboard::AudioInfoCache audioInfoCache_;
+    int metricsPort_;
+
+    enum class Rpc { EXTRACT_AUDIO, GET_AUDIO_INFO, APPLY_EFFECTS_STREAM, BATCH_EXTRACT_AUDIO,
+                     EXTRACT_AUDIO_STREAM, COUNT };
+    static constexpr size_t kRpcCount = static_cast<size_t>(Rpc::COUNT);
+    enum class Outcome { OK, ERROR, REJECTED, COUNT };
+    static constexpr size_t kOutcomeCount = static_cast<size_t>(Outcome::COUNT);
+    enum Stage { STAGE_DEMUX, STAGE_DECODE, STAGE_FILTER, STAGE_ENCODE, STAGE_WRITE, STAGE_COUNT };
+
+    // Hot-path instrumentation: relaxed per-thread-slot atomics, summed at scrape time
+    struct Metrics {
+        std::array<std::array<soundboard::Counter, kOutcomeCount>, kRpcCount> requests;
+        std::array<soundboard::Gauge, kRpcCount> in_flight;
+        std::array<soundboard::Histogram, kRpcCount> duration;
+        std::array<soundboard::Histogram, kRpcCount> admission_wait;
+        soundboard::Histogram first_chunk;
+        std::array<soundboard::Histogram, STAGE_COUNT> stage; // per-stream totals
+        soundboard::Counter stream_bytes;
+        soundboard::Counter stream_chunks;
+        soundboard::Histogram realtime{soundboard::Histogram::realtime_buckets()};
+        // Heap allocations per steady-state chunk (AUDIO_COUNT_ALLOCS builds only)
+        soundboard::Counter steady_allocations;
+        soundboard::Counter steady_chunks;
+        // BatchExtractAudio items by result
+        soundboard::Counter batch_items_ok;
+        soundboard::Counter batch_items_failed;
+        soundboard::Counter upload_bytes; // ExtractAudioStream bytes received
+    };
+    Metrics metrics_;
+    std::atomic<uint64_t> nextRequestId_{1};
+    std::unique_ptr<soundboard::MetricsServer> metricsServer_;
+    std::string render_metrics() const;
+
+    // Shared by ExtractAudio and BatchExtractAudio items: transcode, seed the info cache,
+    // adopt prerendered presets and fill response. Runs on whichever thread calls it.
+    // The input is request.video_path, or upload when given (video_path then only names it).
+    bool extract_audio(const soundboard::ExtractAudioRequest& request, const std::string& request_id,
+                       soundboard::ExtractAudioResponse& response,
+                       std::shared_ptr<const std::string> upload = nullptr);
+    void plan_prerender(std::vector<soundboard::TranscodeOutput>& outputs, const std::string& request_id) const;
+    int adopt_prerendered(const soundboard::ExtractAudioRequest& request,
+                          const std::vector<soundboard::TranscodeOutput>& outputs, size_t begin, size_t end,
+                          const std::string& request_id);
     
     // Base class for all async RPC call handlers (state machines)
     class CallData {
     public:
         explicit CallData(AudioProcessorAsync* svc, grpc::ServerCompletionQueue* cq);
-        virtual ~CallData() = default;
+        virtual ~CallData(); // records the call's metrics
         virtual void Proceed() = 0;
+
+        // Entry point from the CQ loop: records the event's ok flag, then Proceed()
+        void handle_event(bool ok);
         
     protected:
         AudioProcessorAsync* svc_;
         grpc::ServerCompletionQueue* cq_;
         grpc::ServerContext ctx_;
-        enum CallStatus { CREATE, PROCESS, WRITING, FINISH };
+        enum CallStatus { CREATE, PROCESS, QUEUED, READING, PRODUCING, WRITING, FINISH };
         CallStatus status_;
+        bool event_ok_; // ok of the completion being handled (false: e.g. a Read() hit end of stream)
+
+        // Posts this call's tag back to cq_ (admission deadline/grant, executor hand-off)
+        grpc::Alarm alarm_;
+
+        // Admission: a QUEUED call is woken by alarm_ on grant or deadline, then resolves
+        soundboard::AdmissionQueue::Ticket ticket_;
+        bool holds_permit_;
+        soundboard::AdmissionQueue::Result request_permit(soundboard::AdmissionQueue::Method method);
+        bool resolve_permit();
+        void release_permit();
+        void log_busy(const char* reason);
+
+        // Metrics: rpc_started() when the RPC arrives; counted on deletion with outcome_.
+        // request_id_ tags the call's log records (client's x-request-id, else a counter).
+        bool rpc_started_;
+        std::string request_id_;
+        Rpc rpc_;
+        Outcome outcome_;
+        std::chrono::steady_clock::time_point started_at_;
+        std::chrono::steady_clock::time_point queued_at_;
+        void rpc_started(Rpc rpc);
     };
     
     // ExtractAudio unary RPC handler
+    // The conversion runs on the extract executor, which also calls Finish
     class ExtractAudioCallData : public CallData {
     public:
         ExtractAudioCallData(AudioProcessorAsync* svc, grpc::ServerCompletionQueue* cq);
         void Proceed() override;
         
     private:
+        void process();
+        void convert();
+        void reject_busy(const char* reason);
+
         soundboard::ExtractAudioRequest request_;
         soundboard::ExtractAudioResponse response_;
         grpc::ServerAsyncResponseWriter<soundboard::ExtractAudioResponse> responder_;
     };
+
+    // BatchExtractAudio server-streaming RPC handler
+    // Admitted as one ExtractAudio; items then run on the extract executor, at most
+    // batchParallelism at a time, and the CQ thread writes results as they complete
+    class BatchExtractAudioCallData : public CallData {
+    public:
+        BatchExtractAudioCallData(AudioProcessorAsync* svc, grpc::ServerCompletionQueue* cq);
+        void Proceed() override;
+
+    private:
+        void start_batch();
+        void reject_busy(const char* reason);
+        void run_item(size_t index);
+        void stop_batch();
+        void write_next();
+
+        soundboard::BatchExtractAudioRequest request_;
+        grpc::ServerAsyncWriter<soundboard::BatchExtractAudioResult> writer_;
+        soundboard::BatchExtractAudioResult writing_; // result of the Write() in flight
+
+        // Completed results not yet written. The executor side appends and wakes an idle
+        // writer through alarm_; writer_idle_ means no Write() or wake-up is pending.
+        std::mutex results_mu_;
+        std::deque<soundboard::BatchExtractAudioResult> results_;
+        size_t next_item_;  // next item to hand to the executor
+        size_t completed_;  // items whose result is in results_ or already written
+        int failed_;
+        bool writer_idle_;
+        bool stopped_; // client gone: start no more items, drop unwritten results
+    };
     
+    // ExtractAudioStream client-streaming RPC handler
+    // The CQ thread reads the upload into memory; the conversion then runs on the extract
+    // executor straight from that buffer, with no file staged on disk. Only an upload of
+    // exactly the header's total_size is converted.
+    class ExtractAudioStreamCallData : public CallData {
+    public:
+        ExtractAudioStreamCallData(AudioProcessorAsync* svc, grpc::ServerCompletionQueue* cq);
+        void Proceed() override;
+
+    private:
+        void begin_upload();
+        void reject_busy(const char* reason);
+        void on_upload_message();
+        void end_upload();
+        void fail(grpc::StatusCode code, const std::string& message);
+        void convert();
+
+        soundboard::ExtractAudioUpload upload_;   // message being read
+        soundboard::ExtractAudioRequest request_; // from the header
+        bool have_header_;
+        int64_t expected_bytes_; // header's total_size
+        std::shared_ptr<std::string> bytes_;
+        soundboard::ExtractAudioResponse response_;
+        grpc::ServerAsyncReader<soundboard::ExtractAudioResponse, soundboard::ExtractAudioUpload> reader_;
+    };
+
+    // GetAudioInfo unary RPC handler
+    // Cache hits are answered on the CQ thread; a miss is probed on the DSP executor
+    class GetAudioInfoCallData : public CallData {
+    public:
+        GetAudioInfoCallData(AudioProcessorAsync* svc, grpc::ServerCompletionQueue* cq);
+        void Proceed() override;
+
+    private:
+        void probe();
+        void respond(const soundboard::AudioInfo& info);
+
+        soundboard::AudioInfoRequest request_;
+        soundboard::AudioInfoResponse response_;
+        grpc::ServerAsyncResponseWriter<soundboard::AudioInfoResponse> responder_;
+        grpc::Status probe_status_;
+    };
+
     // ApplyEffectsStream server-streaming RPC handler
+    // Decode/filter/encode runs on the DSP executor; the CQ thread only issues Write/Finish
     class ApplyEffectsStreamCallData : public CallData {
     public:
         ApplyEffectsStreamCallData(AudioProcessorAsync* svc, grpc::ServerCompletionQueue* cq);
@@ -66,30 +301,77 @@ private:
         grpc::ServerAsyncWriter<soundboard::AudioChunk> writer_;
         bool streaming_started_;
         bool streaming_no_effects_;
-        FILE* ffmpeg_pipe_;
-        char ffmpeg_buffer_[65536];
+
+        // No-effects passthrough: compatible MP3 bytes are read straight into the
+        // chunk buffer, cut on frame boundaries, and sent as-is
+        soundboard::Mp3FrameReader passthrough_;
         int32_t chunk_sequence_;
+        int64_t stream_time_us_; // output time covered by the chunks emitted so far
+
+        // Outcome of one producer run on the DSP executor
+        enum class ProduceResult { CHUNK, YIELD, DONE, FAILED };
+        ProduceResult produce_result_;
+        soundboard::AudioChunk* pending_chunk_; // queue slot being filled; its data is the batch buffer
+        uint64_t pending_allocations_;          // made by earlier (YIELD) runs on pending_chunk_
+        grpc::Status pending_status_;
+
+        // Read-ahead: a ring of chunk slots shared by one producer (DSP executor) and
+        // one writer (CQ thread). Slot contents belong to whichever side holds them, so
+        // only the indices and wake-up flags sit under queue_mu_. A full ring blocks the
+        // producer until a Write() completes; an idle writer is woken through alarm_.
+        std::vector<soundboard::AudioChunk> chunk_queue_;
+        std::mutex queue_mu_;
+        size_t queue_head_;        // oldest queued chunk (next to write)
+        size_t queued_chunks_;
+        bool writer_idle_;         // no Write() in flight and waiting for alarm_
+        bool producer_blocked_;    // producer returned on a full ring
+        bool production_ended_;
+        ProduceResult production_result_; // DONE or FAILED once production_ended_
+        bool client_gone_;         // a Write() failed: produce nothing more, send nothing more
+
+        bool low_latency_; // request or server default; see Options::lowLatencyDefault
+
+        // Rendered-effects cache: a leader renders and appends; others replay cache_clip_
+        std::shared_ptr<soundboard::RenderedClip> cache_clip_;
+        soundboard::EffectsKey cache_key_;
+        bool cache_leader_;
+        size_t cache_read_index_;
         
-        // libavfilter streaming state
-        AVFormatContext* streaming_in_fmt_;
-        AVCodecContext* streaming_dec_ctx_;
-        AVCodecContext* streaming_enc_ctx_;
-        AVFilterGraph* streaming_graph_;
-        AVFilterContext* streaming_src_ctx_;
-        AVFilterContext* streaming_sink_ctx_;
-        AVFrame* streaming_frame_;
-        AVFrame* streaming_filtered_frame_;
-        int streaming_audio_stream_idx_;
-        std::string streaming_filter_desc_;
-        
-        // Flushing state
-        bool decoder_flushed_;
-        bool filter_flushed_;
-        bool encoder_flushed_;
-        int64_t streaming_pts_;
+        // Decode/effects/encode for streams that aren't passthrough or cache replays;
+        // created and driven on the DSP executor
+        std::unique_ptr<soundboard::AudioPipeline> pipeline_;
+
+        // Range request (start/end in output time); see setup_range()
+        bool range_active_;
+
+        // Metrics: wall time per stage, audio emitted, Write() timing
+        std::array<int64_t, STAGE_COUNT> stage_ns_;
+        bool stage_timed_;
+        int64_t streamed_audio_us_;
+        std::chrono::steady_clock::time_point write_started_at_;
         
-        void start_processing();
-        void send_next_chunk();
+        void begin_streaming();
+        void reject_busy(const char* reason);
+        bool validate_range();
+        void schedule_produce();
+        void run_producer();
+        void publish_chunk();
+        void end_production(ProduceResult result);
+        void abandon_production();
+        void stop_production();
+        void write_next();
+        bool open_cache_entry();
+        bool open_passthrough();
+        bool start_processing();
+        soundboard::AudioPipeline::InputRange setup_range(soundboard::Demuxer& demuxer, int sample_rate,
+                                                          soundboard::EffectsTrim& trim, float speed);
+        bool produce_next_chunk();
+        bool read_cached_chunk();
+        void finish_production();
+        size_t target_chunk_bytes() const;
+        size_t chunk_buffer_capacity() const;
+        void emit_pending_chunk(int64_t duration_us);
+        void release_streaming_state();
         void finish_stream();
     };
     
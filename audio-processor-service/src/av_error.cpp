@@ -0,0 +1,18 @@
+#include "av_error.h"
+
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+namespace soundboard
+{
+
+    std::string av_err_to_string(int errnum)
+    {
+        char buf[256];
+        av_strerror(errnum, buf, sizeof(buf));
+        return std::string(buf);
+    }
+
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+namespace soundboard
+{
+
+    // Human-readable text for an FFmpeg (AVERROR) return code
+    std::string av_err_to_string(int errnum);
+
+}
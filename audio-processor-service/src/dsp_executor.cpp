@@ -0,0 +1,124 @@
+#include "dsp_executor.h"
+#include <algorithm>
+
+namespace soundboard
+{
+
+    // Index of the worker owned by the current thread, or -1 off-pool
+    static thread_local int tls_worker_index = -1;
+    static thread_local const DspExecutor *tls_executor = nullptr;
+
+    DspExecutor::DspExecutor(int num_threads)
+    {
+        num_threads = std::clamp(num_threads, 1, 1024);
+        for (int i = 0; i < num_threads; ++i)
+        {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (int i = 0; i < num_threads; ++i)
+        {
+            threads_.emplace_back([this, i]()
+                                  { run(static_cast<size_t>(i)); });
+        }
+    }
+
+    DspExecutor::~DspExecutor()
+    {
+        shutdown();
+    }
+
+    void DspExecutor::submit(Task task)
+    {
+        size_t target;
+        if (tls_executor == this && tls_worker_index >= 0)
+        {
+            target = static_cast<size_t>(tls_worker_index);
+        }
+        else
+        {
+            target = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(workers_[target]->mu);
+            workers_[target]->tasks.push_back(std::move(task));
+        }
+        pending_.fetch_add(1, std::memory_order_release);
+
+        // Take the idle lock so a worker between its predicate check and wait() can't miss this
+        {
+            std::lock_guard<std::mutex> lock(idle_mu_);
+        }
+        idle_cv_.notify_one();
+    }
+
+    void DspExecutor::shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(idle_mu_);
+            if (stopping_)
+                return;
+            stopping_ = true;
+        }
+        idle_cv_.notify_all();
+
+        for (auto &t : threads_)
+        {
+            if (t.joinable())
+                t.join();
+        }
+    }
+
+    bool DspExecutor::try_pop(size_t index, Task &out)
+    {
+        // Own queue first (FIFO keeps a stream's chunks in order of submission)
+        {
+            Worker &own = *workers_[index];
+            std::lock_guard<std::mutex> lock(own.mu);
+            if (!own.tasks.empty())
+            {
+                out = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+
+        // Steal from the back of a sibling
+        for (size_t n = 1; n < workers_.size(); ++n)
+        {
+            Worker &victim = *workers_[(index + n) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mu);
+            if (!victim.tasks.empty())
+            {
+                out = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void DspExecutor::run(size_t index)
+    {
+        tls_worker_index = static_cast<int>(index);
+        tls_executor = this;
+
+        while (true)
+        {
+            Task task;
+            if (try_pop(index, task))
+            {
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(idle_mu_);
+            idle_cv_.wait(lock, [this]()
+                          { return stopping_ || pending_.load(std::memory_order_acquire) > 0; });
+            if (stopping_)
+                return;
+        }
+    }
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace soundboard
+{
+
+    /**
+     * Fixed-size worker pool for decode/filter/encode work, kept off the gRPC
+     * completion-queue threads so a slow filter graph never stalls other RPCs.
+     *
+     * Each worker owns a task deque. Tasks submitted from a worker stay on that
+     * worker (the next chunk of a stream reuses warm caches); tasks submitted
+     * from elsewhere are spread round-robin. Idle workers steal from the back
+     * of their siblings' deques.
+     */
+    class DspExecutor
+    {
+    public:
+        using Task = std::function<void()>;
+
+        explicit DspExecutor(int num_threads);
+        ~DspExecutor();
+
+        DspExecutor(const DspExecutor &) = delete;
+        DspExecutor &operator=(const DspExecutor &) = delete;
+
+        /**
+         * Queue a task for execution on one of the workers.
+         * Safe to call from any thread, including from inside a task.
+         */
+        void submit(Task task);
+
+        /**
+         * Stop all workers. Tasks still queued are dropped; running tasks
+         * are allowed to finish. Called automatically by the destructor.
+         */
+        void shutdown();
+
+        int size() const { return static_cast<int>(workers_.size()); }
+
+    private:
+        struct Worker
+        {
+            std::mutex mu;
+            std::deque<Task> tasks;
+        };
+
+        void run(size_t index);
+        bool try_pop(size_t index, Task &out);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+
+        std::mutex idle_mu_;
+        std::condition_variable idle_cv_;
+        std::atomic<size_t> pending_{0};
+        std::atomic<size_t> next_worker_{0};
+        bool stopping_ = false;
+    };
+
+}
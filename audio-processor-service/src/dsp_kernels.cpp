@@ -0,0 +1,165 @@
+#include "dsp_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOUNDBOARD_DSP_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SOUNDBOARD_DSP_NEON 1
+#endif
+
+namespace soundboard
+{
+
+    // ========================================================================
+    // Scalar (reference and fallback)
+    // ========================================================================
+
+    static float dot_scalar(const float *a, const float *b, size_t n)
+    {
+        // Four partial sums, so the compiler may keep them in one vector register
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            s0 += a[i] * b[i];
+            s1 += a[i + 1] * b[i + 1];
+            s2 += a[i + 2] * b[i + 2];
+            s3 += a[i + 3] * b[i + 3];
+        }
+        for (; i < n; ++i)
+            s0 += a[i] * b[i];
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    static void window_scalar(float *dst, const float *src, const float *win, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            dst[i] = src[i] * win[i];
+    }
+
+    static void window_add_scalar(float *dst, const float *src, const float *win, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            dst[i] += src[i] * win[i];
+    }
+
+#if SOUNDBOARD_DSP_X86
+
+    // ========================================================================
+    // AVX2 + FMA (compiled for the target regardless of -march, used only if
+    // the CPU reports both)
+    // ========================================================================
+
+    __attribute__((target("avx2,fma"))) static float dot_avx2(const float *a, const float *b, size_t n)
+    {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        }
+        if (i + 8 <= n)
+        {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+            i += 8;
+        }
+        __m256 acc = _mm256_add_ps(acc0, acc1);
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+        float sum = _mm_cvtss_f32(s);
+        for (; i < n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    __attribute__((target("avx2,fma"))) static void window_avx2(float *dst, const float *src, const float *win, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), _mm256_loadu_ps(win + i)));
+        for (; i < n; ++i)
+            dst[i] = src[i] * win[i];
+    }
+
+    __attribute__((target("avx2,fma"))) static void window_add_avx2(float *dst, const float *src, const float *win, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), _mm256_loadu_ps(win + i),
+                                                      _mm256_loadu_ps(dst + i)));
+        for (; i < n; ++i)
+            dst[i] += src[i] * win[i];
+    }
+
+#endif
+
+#if SOUNDBOARD_DSP_NEON
+
+    // ========================================================================
+    // NEON (baseline on AArch64, no runtime check needed)
+    // ========================================================================
+
+    static float dot_neon(const float *a, const float *b, size_t n)
+    {
+        float32x4_t acc0 = vdupq_n_f32(0.0f);
+        float32x4_t acc1 = vdupq_n_f32(0.0f);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+            acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        }
+        if (i + 4 <= n)
+        {
+            acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+            i += 4;
+        }
+        float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+        for (; i < n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    static void window_neon(float *dst, const float *src, const float *win, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            vst1q_f32(dst + i, vmulq_f32(vld1q_f32(src + i), vld1q_f32(win + i)));
+        for (; i < n; ++i)
+            dst[i] = src[i] * win[i];
+    }
+
+    static void window_add_neon(float *dst, const float *src, const float *win, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            vst1q_f32(dst + i, vfmaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), vld1q_f32(win + i)));
+        for (; i < n; ++i)
+            dst[i] += src[i] * win[i];
+    }
+
+#endif
+
+    static DspKernels select_kernels()
+    {
+#if SOUNDBOARD_DSP_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return DspKernels{"avx2", dot_avx2, window_avx2, window_add_avx2};
+#elif SOUNDBOARD_DSP_NEON
+        return DspKernels{"neon", dot_neon, window_neon, window_add_neon};
+#endif
+        return DspKernels{"scalar", dot_scalar, window_scalar, window_add_scalar};
+    }
+
+    const DspKernels &dsp_kernels()
+    {
+        static const DspKernels kernels = select_kernels();
+        return kernels;
+    }
+
+}
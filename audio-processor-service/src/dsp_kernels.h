@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace soundboard
+{
+
+    /**
+     * Float kernels behind the native time-stretch/pitch-shift engine. One set is
+     * picked per process from what the CPU supports: AVX2+FMA on x86-64 (checked at
+     * runtime, so the binary still runs on older hosts), NEON on AArch64, scalar
+     * otherwise. Pointers may be unaligned; n needn't be a multiple of the vector width.
+     */
+    struct DspKernels
+    {
+        const char *name; // "avx2", "neon" or "scalar"
+
+        // sum of a[i] * b[i]
+        float (*dot)(const float *a, const float *b, size_t n);
+
+        // dst[i] = src[i] * win[i]
+        void (*window)(float *dst, const float *src, const float *win, size_t n);
+
+        // dst[i] += src[i] * win[i] (overlap-add of a windowed segment)
+        void (*window_add)(float *dst, const float *src, const float *win, size_t n);
+    };
+
+    const DspKernels &dsp_kernels();
+
+}
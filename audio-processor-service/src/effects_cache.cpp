@@ -0,0 +1,431 @@
+#include "effects_cache.h"
+#include "log.h"
+#include "mp3_probe.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace soundboard
+{
+
+    // Unique suffix for temp files in the disk tier (renamed into place when complete)
+    static std::atomic<uint64_t> g_tmp_counter{0};
+
+    static std::string tmp_suffix()
+    {
+        return ".tmp." + std::to_string(getpid()) + "." + std::to_string(g_tmp_counter.fetch_add(1));
+    }
+
+    std::string EffectsKey::hex() const
+    {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%016llx-%016llx-%llx-%llx-s%03d-p%03d%s%s",
+                 static_cast<unsigned long long>(file.dev),
+                 static_cast<unsigned long long>(file.ino),
+                 static_cast<unsigned long long>(file.size),
+                 static_cast<unsigned long long>(file.mtime_ns),
+                 speed_q, pitch_q, low_latency ? "-ll" : "", native_pitch ? "-np" : "");
+        return std::string(buf);
+    }
+
+    size_t EffectsKeyHash::operator()(const EffectsKey &k) const
+    {
+        Fnv1a h;
+        h.mix(k.file);
+        h.mix(static_cast<uint64_t>(k.speed_q) << 32 | static_cast<uint32_t>(k.pitch_q));
+        h.mix((k.low_latency ? 1 : 0) | (k.native_pitch ? 2 : 0));
+        return h.value();
+    }
+
+    bool make_effects_key(const std::string &path, float speed, float pitch, EffectsKey &key_out)
+    {
+        if (!FileIdentity::of(path, key_out.file))
+            return false;
+
+        key_out.speed_q = static_cast<int>(std::lround(speed * 100.0f));
+        key_out.pitch_q = static_cast<int>(std::lround(pitch * 100.0f));
+        key_out.low_latency = false;
+        key_out.native_pitch = false;
+        return true;
+    }
+
+    // ============================================================================
+    // RenderedClip
+    // ============================================================================
+
+    RenderedClip::Poll RenderedClip::next(size_t index, Chunk &out, std::function<void()> on_ready)
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (index < chunks_.size())
+        {
+            out = chunks_[index];
+            return Poll::CHUNK;
+        }
+        if (state_ == State::COMPLETE)
+            return Poll::END;
+        if (state_ == State::FAILED)
+            return Poll::FAILED;
+
+        if (on_ready)
+            waiters_.push_back(std::move(on_ready));
+        return Poll::PENDING;
+    }
+
+    bool RenderedClip::chunk(size_t index, Chunk &out) const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (index >= chunks_.size())
+            return false;
+        out = chunks_[index];
+        return true;
+    }
+
+    void RenderedClip::notify_and_unlock(std::unique_lock<std::mutex> &lock)
+    {
+        std::vector<std::function<void()>> waiters;
+        waiters.swap(waiters_);
+        lock.unlock();
+        for (auto &w : waiters)
+            w();
+    }
+
+    void RenderedClip::append(const uint8_t *data, size_t size, int64_t start_us, int64_t duration_us)
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        chunks_.push_back(Chunk{std::string(reinterpret_cast<const char *>(data), size), start_us, duration_us});
+        bytes_ += size;
+        notify_and_unlock(lock);
+    }
+
+    void RenderedClip::complete()
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        if (state_ == State::RENDERING)
+            state_ = State::COMPLETE;
+        notify_and_unlock(lock);
+    }
+
+    void RenderedClip::fail()
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        if (state_ == State::RENDERING)
+            state_ = State::FAILED;
+        notify_and_unlock(lock);
+    }
+
+    bool RenderedClip::is_complete() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return state_ == State::COMPLETE;
+    }
+
+    size_t RenderedClip::bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return bytes_;
+    }
+
+    std::shared_ptr<RenderedClip> RenderedClip::from_bytes(const std::string &data, size_t chunk_bytes)
+    {
+        auto clip = std::make_shared<RenderedClip>();
+        auto pieces = split_mp3_frames(data, chunk_bytes);
+        if (!pieces.empty())
+        {
+            for (const auto &piece : pieces)
+                clip->chunks_.push_back(Chunk{data.substr(piece.offset, piece.size), piece.start_us, piece.duration_us});
+        }
+        else
+        {
+            for (size_t off = 0; off < data.size(); off += chunk_bytes)
+            {
+                size_t n = std::min(chunk_bytes, data.size() - off);
+                clip->chunks_.push_back(Chunk{std::string(data.data() + off, n), 0, 0});
+            }
+        }
+        clip->bytes_ = data.size();
+        clip->state_ = State::COMPLETE;
+        return clip;
+    }
+
+    // ============================================================================
+    // EffectsCache
+    // ============================================================================
+
+    EffectsCache::EffectsCache(const Options &options)
+        : options_(options)
+    {
+        if (options_.max_entry_bytes == 0)
+            options_.max_entry_bytes = options_.memory_bytes / 4;
+
+        if (!options_.disk_dir.empty())
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(options_.disk_dir, ec);
+            if (ec)
+            {
+                LOG_WARN("effects_cache.disk_disabled").kv("dir", options_.disk_dir).kv("error", ec.message());
+                options_.disk_dir.clear();
+            }
+            else
+            {
+                for (const auto &f : std::filesystem::directory_iterator(options_.disk_dir, ec))
+                {
+                    if (!f.is_regular_file(ec))
+                        continue;
+                    // Leftovers from writes interrupted by a restart
+                    if (f.path().filename().string().find(".tmp.") != std::string::npos)
+                        std::filesystem::remove(f.path(), ec);
+                    else
+                        disk_bytes_estimate_ += static_cast<size_t>(f.file_size(ec));
+                }
+            }
+        }
+    }
+
+    std::string EffectsCache::disk_path(const EffectsKey &key) const
+    {
+        return options_.disk_dir + "/" + key.hex() + ".mp3";
+    }
+
+    std::shared_ptr<RenderedClip> EffectsCache::acquire(const EffectsKey &key, Role &role_out)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+
+            auto it = memory_.find(key);
+            if (it != memory_.end())
+            {
+                lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+                stats_.hits_memory++;
+                role_out = Role::HIT_MEMORY;
+                return it->second.clip;
+            }
+
+            auto inflight = inflight_.find(key);
+            if (inflight != inflight_.end())
+            {
+                stats_.shared_renders++;
+                role_out = Role::FOLLOWER;
+                return inflight->second;
+            }
+
+            // Claim the key before touching disk so concurrent callers follow us
+            auto clip = std::make_shared<RenderedClip>();
+            inflight_[key] = clip;
+        }
+
+        // Disk lookup happens outside the lock; on hit, complete the in-flight clip
+        // so anyone who followed us meanwhile is served from it.
+        if (auto disk_clip = load_from_disk(key))
+        {
+            std::shared_ptr<RenderedClip> claimed;
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                claimed = inflight_[key];
+                inflight_.erase(key);
+                insert_memory_locked(key, disk_clip);
+                stats_.hits_disk++;
+            }
+            // Replay into the claimed clip for followers that attached during the load
+            RenderedClip::Chunk chunk;
+            for (size_t i = 0; disk_clip->chunk(i, chunk); ++i)
+                claimed->append(reinterpret_cast<const uint8_t *>(chunk.data.data()), chunk.data.size(),
+                                chunk.start_us, chunk.duration_us);
+            claimed->complete();
+
+            role_out = Role::HIT_DISK;
+            return disk_clip;
+        }
+
+        std::lock_guard<std::mutex> lock(mu_);
+        stats_.misses++;
+        role_out = Role::LEADER;
+        return inflight_[key];
+    }
+
+    void EffectsCache::publish(const EffectsKey &key, const std::shared_ptr<RenderedClip> &clip)
+    {
+        clip->complete();
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            auto it = inflight_.find(key);
+            if (it != inflight_.end() && it->second == clip)
+                inflight_.erase(it);
+            insert_memory_locked(key, clip);
+        }
+
+        if (!options_.disk_dir.empty())
+            write_to_disk(key, *clip);
+    }
+
+    void EffectsCache::abandon(const EffectsKey &key, const std::shared_ptr<RenderedClip> &clip)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            auto it = inflight_.find(key);
+            if (it != inflight_.end() && it->second == clip)
+                inflight_.erase(it);
+        }
+        if (!clip->is_complete())
+            clip->fail();
+    }
+
+    void EffectsCache::insert_memory_locked(const EffectsKey &key, const std::shared_ptr<RenderedClip> &clip)
+    {
+        size_t bytes = clip->bytes();
+        if (options_.memory_bytes == 0 || bytes > options_.max_entry_bytes || memory_.count(key))
+            return;
+
+        while (memory_bytes_ + bytes > options_.memory_bytes && !lru_.empty())
+        {
+            auto victim = memory_.find(lru_.back());
+            memory_bytes_ -= victim->second.clip->bytes();
+            memory_.erase(victim);
+            lru_.pop_back();
+            stats_.evictions++;
+        }
+
+        lru_.push_front(key);
+        memory_[key] = Entry{clip, lru_.begin()};
+        memory_bytes_ += bytes;
+    }
+
+    std::shared_ptr<RenderedClip> EffectsCache::load_from_disk(const EffectsKey &key) const
+    {
+        if (options_.disk_dir.empty())
+            return nullptr;
+
+        const std::string path = disk_path(key);
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in.is_open())
+            return nullptr;
+
+        std::streamsize size = in.tellg();
+        if (size <= 0)
+            return nullptr;
+        std::string data(static_cast<size_t>(size), '\0');
+        in.seekg(0);
+        if (!in.read(data.data(), size))
+            return nullptr;
+
+        // trim_disk evicts by mtime: a hit makes the file most recently used
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+        return RenderedClip::from_bytes(data, std::max<size_t>(options_.disk_chunk_bytes, 4096));
+    }
+
+    void EffectsCache::write_to_disk(const EffectsKey &key, const RenderedClip &clip)
+    {
+        std::string final_path = disk_path(key);
+        std::string tmp_path = final_path + tmp_suffix();
+
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+                return;
+            RenderedClip::Chunk chunk;
+            for (size_t i = 0; clip.chunk(i, chunk); ++i)
+                out.write(chunk.data.data(), static_cast<std::streamsize>(chunk.data.size()));
+            if (!out)
+            {
+                out.close();
+                std::remove(tmp_path.c_str());
+                return;
+            }
+        }
+
+        // Atomic publish: readers see either no file or the complete one
+        if (std::rename(tmp_path.c_str(), final_path.c_str()) != 0)
+        {
+            std::remove(tmp_path.c_str());
+            return;
+        }
+
+        account_disk_write(clip.bytes());
+    }
+
+    std::string EffectsCache::staging_path() const
+    {
+        if (options_.disk_dir.empty())
+            return std::string();
+        return options_.disk_dir + "/staged" + tmp_suffix();
+    }
+
+    bool EffectsCache::adopt_file(const EffectsKey &key, const std::string &staged_path)
+    {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(staged_path, ec);
+        if (ec || std::rename(staged_path.c_str(), disk_path(key).c_str()) != 0)
+        {
+            std::remove(staged_path.c_str());
+            return false;
+        }
+        account_disk_write(static_cast<size_t>(size));
+        return true;
+    }
+
+    void EffectsCache::account_disk_write(size_t bytes)
+    {
+        bool over_budget;
+        {
+            std::lock_guard<std::mutex> lock(disk_mu_);
+            disk_bytes_estimate_ += bytes;
+            over_budget = options_.disk_bytes > 0 && disk_bytes_estimate_ > options_.disk_bytes;
+        }
+        if (over_budget)
+            trim_disk();
+    }
+
+    void EffectsCache::trim_disk()
+    {
+        std::lock_guard<std::mutex> lock(disk_mu_);
+
+        struct FileInfo
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type mtime;
+            size_t size;
+        };
+        std::vector<FileInfo> files;
+        size_t total = 0;
+        std::error_code ec;
+        for (const auto &f : std::filesystem::directory_iterator(options_.disk_dir, ec))
+        {
+            if (!f.is_regular_file(ec) || f.path().extension() != ".mp3")
+                continue;
+            size_t size = static_cast<size_t>(f.file_size(ec));
+            files.push_back({f.path(), f.last_write_time(ec), size});
+            total += size;
+        }
+
+        // Least recently used first (disk hits refresh mtime); trim to 90% of the budget
+        // so we don't rescan on every write
+        std::sort(files.begin(), files.end(), [](const FileInfo &a, const FileInfo &b)
+                  { return a.mtime < b.mtime; });
+        size_t target = options_.disk_bytes / 10 * 9;
+        for (const auto &f : files)
+        {
+            if (total <= target)
+                break;
+            if (std::filesystem::remove(f.path, ec))
+                total -= f.size;
+        }
+        disk_bytes_estimate_ = total;
+    }
+
+    EffectsCache::Stats EffectsCache::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        Stats s = stats_;
+        s.memory_bytes = memory_bytes_;
+        s.entries = memory_.size();
+        return s;
+    }
+
+}
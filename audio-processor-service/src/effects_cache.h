@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "file_identity.h"
+
+namespace soundboard
+{
+
+    /**
+     * Identity of one rendered effects output: the source file (device, inode,
+     * size, mtime) plus speed/pitch quantized to the 0.01 steps the filter
+     * graph actually uses. Editing or replacing the source changes the key.
+     * Low-latency renders (short rubberband window) and renders by the native
+     * pitch engine sound different and are kept apart from the default ones.
+     */
+    struct EffectsKey
+    {
+        FileIdentity file;
+        int speed_q = 100;
+        int pitch_q = 100;
+        bool low_latency = false;
+        bool native_pitch = false;
+
+        bool operator==(const EffectsKey &o) const
+        {
+            return file == o.file && speed_q == o.speed_q && pitch_q == o.pitch_q && low_latency == o.low_latency &&
+                   native_pitch == o.native_pitch;
+        }
+
+        // Stable file name component for the disk tier
+        std::string hex() const;
+    };
+
+    struct EffectsKeyHash
+    {
+        size_t operator()(const EffectsKey &k) const;
+    };
+
+    /**
+     * Build the cache key for (path, speed, pitch) by stat()ing the file.
+     * The key is for a full-quality rubberband render; callers set low_latency
+     * and native_pitch as needed.
+     * @return false if the file can't be stat()ed (caller should bypass the cache)
+     */
+    bool make_effects_key(const std::string &path, float speed, float pitch, EffectsKey &key_out);
+
+    /**
+     * Encoded MP3 output of one render, as the sequence of chunk payloads that
+     * were streamed. Append-only while the leader renders; readers can tail it.
+     */
+    class RenderedClip
+    {
+    public:
+        struct Chunk
+        {
+            std::string data;
+            int64_t start_us = 0;    // 0 when unknown (a disk file that isn't parseable MP3)
+            int64_t duration_us = 0;
+        };
+
+        enum class Poll
+        {
+            CHUNK,   // out holds chunk `index`
+            PENDING, // not rendered yet; on_ready will be called once when it may be
+            END,     // index is past the last chunk of a completed render
+            FAILED   // the leader's render failed
+        };
+
+        /**
+         * Fetch chunk `index`. If it isn't available yet, on_ready is stored and
+         * invoked (from the leader's thread) on the next append/complete/fail.
+         */
+        Poll next(size_t index, Chunk &out, std::function<void()> on_ready);
+
+        // Copy chunk `index` if it has been rendered; never waits
+        bool chunk(size_t index, Chunk &out) const;
+
+        // Leader side
+        void append(const uint8_t *data, size_t size, int64_t start_us, int64_t duration_us);
+        void complete();
+        void fail();
+
+        bool is_complete() const;
+        size_t bytes() const;
+
+        // Build a completed clip from a whole MP3 file image, split on frame boundaries into
+        // pieces of about chunk_bytes timed from the frame headers (untimed chunk_bytes
+        // pieces if it has no MP3 frames)
+        static std::shared_ptr<RenderedClip> from_bytes(const std::string &data, size_t chunk_bytes);
+
+    private:
+        enum class State
+        {
+            RENDERING,
+            COMPLETE,
+            FAILED
+        };
+
+        void notify_and_unlock(std::unique_lock<std::mutex> &lock);
+
+        mutable std::mutex mu_;
+        std::vector<Chunk> chunks_;
+        size_t bytes_ = 0;
+        State state_ = State::RENDERING;
+        std::vector<std::function<void()>> waiters_;
+    };
+
+    /**
+     * Cache of rendered effects outputs with an in-memory LRU tier (bounded by
+     * bytes) and an on-disk tier of plain MP3 files. Concurrent requests for the
+     * same key share a single render: the first caller becomes the LEADER and
+     * renders, everyone else tails its RenderedClip.
+     */
+    class EffectsCache
+    {
+    public:
+        struct Options
+        {
+            size_t memory_bytes = 0;    // 0 disables the memory tier
+            size_t max_entry_bytes = 0; // larger renders are not kept in memory
+            std::string disk_dir;       // empty disables the disk tier
+            size_t disk_bytes = 0;      // trim least recently used files beyond this (0 = unbounded)
+            size_t disk_chunk_bytes = 64 * 1024; // disk hits are replayed in pieces of this size
+        };
+
+        enum class Role
+        {
+            HIT_MEMORY, // clip is complete
+            HIT_DISK,   // clip is complete (loaded from disk into memory)
+            FOLLOWER,   // clip is being rendered by another request
+            LEADER      // caller must render, append(), then publish() or abandon()
+        };
+
+        struct Stats
+        {
+            uint64_t hits_memory = 0;
+            uint64_t hits_disk = 0;
+            uint64_t shared_renders = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            size_t memory_bytes = 0;
+            size_t entries = 0;
+        };
+
+        explicit EffectsCache(const Options &options);
+
+        bool enabled() const { return options_.memory_bytes > 0 || !options_.disk_dir.empty(); }
+
+        std::shared_ptr<RenderedClip> acquire(const EffectsKey &key, Role &role_out);
+
+        // Leader finished successfully: keep the clip in memory and write it to disk
+        void publish(const EffectsKey &key, const std::shared_ptr<RenderedClip> &clip);
+
+        // Leader failed or went away: wake followers and forget the in-flight entry
+        void abandon(const EffectsKey &key, const std::shared_ptr<RenderedClip> &clip);
+
+        /**
+         * Disk tier entry rendered out-of-band (e.g. prerendered at upload time).
+         * staging_path() names a temp file inside the cache dir ("" if the disk tier
+         * is disabled); adopt_file() renames it into place under `key`.
+         */
+        std::string staging_path() const;
+        bool adopt_file(const EffectsKey &key, const std::string &staged_path);
+
+        Stats stats() const;
+
+    private:
+        struct Entry
+        {
+            std::shared_ptr<RenderedClip> clip;
+            std::list<EffectsKey>::iterator lru_it;
+        };
+
+        std::string disk_path(const EffectsKey &key) const;
+        std::shared_ptr<RenderedClip> load_from_disk(const EffectsKey &key) const;
+        void write_to_disk(const EffectsKey &key, const RenderedClip &clip);
+        void account_disk_write(size_t bytes);
+        void trim_disk();
+        void insert_memory_locked(const EffectsKey &key, const std::shared_ptr<RenderedClip> &clip);
+
+        Options options_;
+        mutable std::mutex mu_;
+        std::unordered_map<EffectsKey, Entry, EffectsKeyHash> memory_;
+        std::list<EffectsKey> lru_; // front = most recently used
+        std::unordered_map<EffectsKey, std::shared_ptr<RenderedClip>, EffectsKeyHash> inflight_;
+        size_t memory_bytes_ = 0;
+        Stats stats_;
+
+        std::mutex disk_mu_;
+        size_t disk_bytes_estimate_ = 0;
+    };
+
+}
@@ -0,0 +1,409 @@
+#include "effects_graph.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include "av_error.h"
+#include "native_stretch.h"
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/buffer.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+#include <libavutil/samplefmt.h>
+}
+
+namespace soundboard
+{
+
+    // Filters the graphs use, resolved once (avfilter_get_by_name walks the registry)
+    struct FilterTable
+    {
+        const AVFilter *abuffer = avfilter_get_by_name("abuffer");
+        const AVFilter *abuffersink = avfilter_get_by_name("abuffersink");
+        const AVFilter *atempo = avfilter_get_by_name("atempo");
+        const AVFilter *rubberband = avfilter_get_by_name("rubberband");
+        const AVFilter *atrim = avfilter_get_by_name("atrim");
+        const AVFilter *aformat = avfilter_get_by_name("aformat");
+        const AVFilter *asetnsamples = avfilter_get_by_name("asetnsamples");
+    };
+
+    static const FilterTable &filters()
+    {
+        static const FilterTable table;
+        return table;
+    }
+
+    AudioFormat AudioFormat::of(const AVCodecContext *dec_ctx)
+    {
+        AudioFormat f;
+        f.sample_rate = dec_ctx->sample_rate;
+        f.sample_fmt = dec_ctx->sample_fmt;
+        f.channels = dec_ctx->channels;
+        f.channel_layout = dec_ctx->channel_layout ? dec_ctx->channel_layout
+                                                   : av_get_default_channel_layout(dec_ctx->channels);
+        return f;
+    }
+
+    // Create a filter and link it after *last; on success *last points at the new filter
+    static bool append_filter(AVFilterGraph *graph, AVFilterContext **last, const AVFilter *filter,
+                              const char *name, const char *args, std::string &error_out)
+    {
+        if (!filter)
+        {
+            error_out = std::string(name) + " filter not found";
+            return false;
+        }
+
+        AVFilterContext *ctx = nullptr;
+        if (int ret = avfilter_graph_create_filter(&ctx, filter, name, args, nullptr, graph))
+        {
+            error_out = std::string("failed to create ") + name + ": " + av_err_to_string(ret);
+            return false;
+        }
+        if (int ret = avfilter_link(*last, 0, ctx, 0))
+        {
+            error_out = std::string("failed to link ") + name + ": " + av_err_to_string(ret);
+            return false;
+        }
+        *last = ctx;
+        return true;
+    }
+
+    std::string effects_filter_desc(float speed, float pitch, bool native_pitch)
+    {
+        const char *pitch_stage = native_pitch ? "native" : "rubberband";
+        char buf[128];
+        if (speed != 1.0f && pitch != 1.0f)
+            snprintf(buf, sizeof(buf), "%s=tempo=%.2f:pitch=%.2f", pitch_stage, speed, pitch);
+        else if (speed != 1.0f)
+            snprintf(buf, sizeof(buf), "atempo=%.2f", speed);
+        else if (pitch != 1.0f)
+            snprintf(buf, sizeof(buf), "%s=pitch=%.2f", pitch_stage, pitch);
+        else
+            return "anull";
+        return std::string(buf);
+    }
+
+    // ============================================================================
+    // Native pitch stage
+    // ============================================================================
+
+    // Samples per frame handed from NativeStretch to the second chain
+    static constexpr int kNativeFrameSamples = 1024;
+
+    struct NativeEffectsStage
+    {
+        NativeEffectsStage(int rate, uint64_t layout, int channels, float speed, float pitch, bool low_latency)
+            : stretch(rate, channels, speed, pitch, low_latency), sample_rate(rate), channel_layout(layout)
+        {
+        }
+
+        AVFilterContext *mid_sink = nullptr; // end of the first chain: FLTP at the input's rate/layout
+        AVFilterContext *mid_src = nullptr;  // start of the second chain
+        NativeStretch stretch;
+        AVFrame *in_frame = nullptr;        // reused for mid_sink output
+        AVFrame *out_frame = nullptr;       // reused for mid_src input (buffersrc takes its refs)
+        AVBufferPool *plane_pool = nullptr; // kNativeFrameSamples floats per plane
+        int sample_rate;
+        uint64_t channel_layout;
+        int64_t pts = 0;
+        bool flushed = false;
+    };
+
+    static void free_native_stage(NativeEffectsStage *stage)
+    {
+        av_frame_free(&stage->in_frame);
+        av_frame_free(&stage->out_frame);
+        av_buffer_pool_uninit(&stage->plane_pool);
+        delete stage;
+    }
+
+    // Split the graph at *last for the native engine: the first chain ends in an FLTP sink
+    // at the input's rate and layout, the second starts at an abuffer fed with the
+    // engine's output; on success *last is that abuffer
+    static bool attach_native_stage(EffectsGraph &g, const AudioFormat &in, uint64_t channel_layout,
+                                    float speed, float pitch, bool low_latency, AVFilterContext **last,
+                                    std::string &error_out)
+    {
+        const FilterTable &f = filters();
+        char args[256];
+        snprintf(args, sizeof(args), "sample_fmts=fltp:sample_rates=%d:channel_layouts=0x%" PRIx64,
+                 in.sample_rate, channel_layout);
+        if (!append_filter(g.graph, last, f.aformat, "native_in_format", args, error_out))
+            return false;
+
+        NativeEffectsStage *stage = new NativeEffectsStage(in.sample_rate, channel_layout, in.channels,
+                                                           speed, pitch, low_latency);
+        g.native = stage; // freed with the graph from here on
+
+        if (int ret = avfilter_graph_create_filter(&stage->mid_sink, f.abuffersink, "native_in", nullptr, nullptr, g.graph))
+        {
+            error_out = "failed to create native stage sink: " + av_err_to_string(ret);
+            return false;
+        }
+        if (int ret = avfilter_link(*last, 0, stage->mid_sink, 0))
+        {
+            error_out = "failed to link native stage sink: " + av_err_to_string(ret);
+            return false;
+        }
+
+        snprintf(args, sizeof(args), "time_base=1/%d:sample_rate=%d:sample_fmt=fltp:channel_layout=0x%" PRIx64,
+                 in.sample_rate, in.sample_rate, channel_layout);
+        if (int ret = avfilter_graph_create_filter(&stage->mid_src, f.abuffer, "native_out", args, nullptr, g.graph))
+        {
+            error_out = "failed to create native stage source: " + av_err_to_string(ret);
+            return false;
+        }
+
+        stage->in_frame = av_frame_alloc();
+        stage->out_frame = av_frame_alloc();
+        stage->plane_pool = av_buffer_pool_init(kNativeFrameSamples * sizeof(float), av_buffer_alloc);
+        if (!stage->in_frame || !stage->out_frame || !stage->plane_pool)
+        {
+            error_out = "failed to alloc native stage buffers";
+            return false;
+        }
+
+        *last = stage->mid_src;
+        return true;
+    }
+
+    // Move what NativeStretch has ready into the second chain, in frames whose planes
+    // come from the stage's pool
+    static int forward_native_output(NativeEffectsStage &n)
+    {
+        const int channels = n.stretch.channels();
+        AVFrame *out = n.out_frame;
+        while (n.stretch.available() > 0)
+        {
+            out->nb_samples = std::min(n.stretch.available(), kNativeFrameSamples);
+            out->format = AV_SAMPLE_FMT_FLTP;
+            out->sample_rate = n.sample_rate;
+            out->channel_layout = n.channel_layout;
+            out->channels = channels;
+            out->pts = n.pts;
+            out->linesize[0] = kNativeFrameSamples * sizeof(float);
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                out->buf[ch] = av_buffer_pool_get(n.plane_pool);
+                if (!out->buf[ch])
+                {
+                    av_frame_unref(out);
+                    return AVERROR(ENOMEM);
+                }
+                out->data[ch] = out->buf[ch]->data;
+            }
+            out->extended_data = out->data;
+            n.pts += n.stretch.pull(reinterpret_cast<float *const *>(out->data), out->nb_samples);
+
+            if (int ret = av_buffersrc_add_frame_flags(n.mid_src, out, 0))
+            {
+                av_frame_unref(out);
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    int push_effects_frame(EffectsGraph &graph, AVFrame *frame)
+    {
+        int ret = av_buffersrc_add_frame_flags(graph.src, frame, 0);
+        if (ret < 0 || !graph.native)
+            return ret;
+
+        NativeEffectsStage &n = *graph.native;
+        while ((ret = av_buffersink_get_frame(n.mid_sink, n.in_frame)) >= 0)
+        {
+            n.stretch.push(reinterpret_cast<const float *const *>(n.in_frame->extended_data), n.in_frame->nb_samples);
+            av_frame_unref(n.in_frame);
+            if ((ret = forward_native_output(n)) < 0)
+                return ret;
+        }
+        if (ret == AVERROR(EAGAIN) || (ret == AVERROR_EOF && n.flushed))
+            return 0;
+        if (ret != AVERROR_EOF)
+            return ret;
+
+        // First chain drained: flush the engine and end the second chain
+        n.flushed = true;
+        n.stretch.finish();
+        if ((ret = forward_native_output(n)) < 0)
+            return ret;
+        return av_buffersrc_add_frame_flags(n.mid_src, nullptr, 0);
+    }
+
+    bool build_effects_graph(const AudioFormat &in, const AVCodecContext *enc_ctx,
+                             float speed, float pitch, EffectsGraph &out, std::string &error_out,
+                             const EffectsOptions &options)
+    {
+        EffectsGraph g;
+        g.graph = avfilter_graph_alloc();
+        if (!g.graph)
+        {
+            error_out = "failed to alloc filter graph";
+            return false;
+        }
+
+        // Source filter (input) - abuffer
+        uint64_t channel_layout = in.channel_layout;
+        if (!channel_layout)
+            channel_layout = av_get_default_channel_layout(in.channels);
+
+        char src_args[512];
+        snprintf(src_args, sizeof(src_args),
+                 "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64,
+                 1, in.sample_rate,
+                 in.sample_rate,
+                 av_get_sample_fmt_name(static_cast<AVSampleFormat>(in.sample_fmt)),
+                 channel_layout);
+
+        const FilterTable &f = filters();
+        if (!f.abuffer || !f.abuffersink)
+        {
+            error_out = "abuffer/abuffersink filter not found";
+            free_effects_graph(g);
+            return false;
+        }
+        if (int ret = avfilter_graph_create_filter(&g.src, f.abuffer, "in", src_args, nullptr, g.graph))
+        {
+            error_out = "failed to create abuffer: " + av_err_to_string(ret);
+            free_effects_graph(g);
+            return false;
+        }
+        if (int ret = avfilter_graph_create_filter(&g.sink, f.abuffersink, "out", nullptr, nullptr, g.graph))
+        {
+            error_out = "failed to create abuffersink: " + av_err_to_string(ret);
+            free_effects_graph(g);
+            return false;
+        }
+
+        // Set output format constraints on the sink to match encoder requirements
+        uint64_t enc_layout = enc_ctx->channel_layout;
+        if (!enc_layout)
+            enc_layout = av_get_default_channel_layout(enc_ctx->channels);
+        const enum AVSampleFormat out_sample_fmts[] = {enc_ctx->sample_fmt, AV_SAMPLE_FMT_NONE};
+        const int64_t out_channel_layouts[] = {static_cast<int64_t>(enc_layout), -1};
+        const int out_sample_rates[] = {enc_ctx->sample_rate, -1};
+        av_opt_set_int_list(g.sink, "sample_fmts", out_sample_fmts, AV_SAMPLE_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+        av_opt_set_int_list(g.sink, "channel_layouts", out_channel_layouts, -1, AV_OPT_SEARCH_CHILDREN);
+        av_opt_set_int_list(g.sink, "sample_rates", out_sample_rates, -1, AV_OPT_SEARCH_CHILDREN);
+
+        AVFilterContext *last = g.src;
+
+        // Pitch: rubberband when FFmpeg has it and the native engine wasn't asked for,
+        // otherwise NativeStretch. Either one applies speed in the same pass, rather than
+        // behind a separate atempo. Only a layout with more planes than AVFrame.data holds
+        // streams at the original pitch.
+        bool native_pitch = false;
+        if (pitch != 1.0f)
+        {
+            if (f.rubberband && !options.native_pitch)
+            {
+                char args[96];
+                int n = speed != 1.0f ? snprintf(args, sizeof(args), "tempo=%.2f:pitch=%.2f", speed, pitch)
+                                      : snprintf(args, sizeof(args), "pitch=%.2f", pitch);
+                if (options.low_latency)
+                    snprintf(args + n, sizeof(args) - n, ":window=short:pitchq=speed");
+                std::string ignored;
+                g.pitch_applied = append_filter(g.graph, &last, f.rubberband, "rubberband", args, ignored);
+            }
+            if (!g.pitch_applied && in.channels <= AV_NUM_DATA_POINTERS)
+            {
+                if (!attach_native_stage(g, in, channel_layout, speed, pitch, options.low_latency, &last, error_out))
+                {
+                    free_effects_graph(g);
+                    return false;
+                }
+                g.pitch_applied = native_pitch = true;
+            }
+        }
+
+        if (speed != 1.0f && !g.pitch_applied)
+        {
+            char args[64];
+            snprintf(args, sizeof(args), "tempo=%.2f", speed);
+            if (!append_filter(g.graph, &last, f.atempo, "atempo", args, error_out))
+            {
+                free_effects_graph(g);
+                return false;
+            }
+        }
+
+        // Range streaming: cut the pre-roll and anything past the end, in output time
+        const EffectsTrim &trim = options.trim;
+        if (trim.start_sample > 0 || trim.end_sample > 0)
+        {
+            char args[96];
+            if (trim.end_sample > 0)
+                snprintf(args, sizeof(args), "start_sample=%" PRId64 ":end_sample=%" PRId64,
+                         trim.start_sample, trim.end_sample);
+            else
+                snprintf(args, sizeof(args), "start_sample=%" PRId64, trim.start_sample);
+            if (!append_filter(g.graph, &last, f.atrim, "atrim", args, error_out))
+            {
+                free_effects_graph(g);
+                return false;
+            }
+        }
+
+        // Convert to the encoder's format, then its exact frame size (e.g. 1152 for MP3), padding the last
+        char aformat_args[256];
+        snprintf(aformat_args, sizeof(aformat_args), "sample_fmts=%s:sample_rates=%d:channel_layouts=0x%" PRIx64,
+                 av_get_sample_fmt_name(enc_ctx->sample_fmt), enc_ctx->sample_rate, enc_layout);
+        if (!append_filter(g.graph, &last, f.aformat, "aformat", aformat_args, error_out))
+        {
+            free_effects_graph(g);
+            return false;
+        }
+        if (enc_ctx->frame_size > 0)
+        {
+            char nsamples_args[64];
+            snprintf(nsamples_args, sizeof(nsamples_args), "n=%d:p=1", enc_ctx->frame_size);
+            if (!append_filter(g.graph, &last, f.asetnsamples, "asetnsamples", nsamples_args, error_out))
+            {
+                free_effects_graph(g);
+                return false;
+            }
+        }
+
+        if (int ret = avfilter_link(last, 0, g.sink, 0))
+        {
+            error_out = "failed to link to sink: " + av_err_to_string(ret);
+            free_effects_graph(g);
+            return false;
+        }
+
+        if (int ret = avfilter_graph_config(g.graph, nullptr))
+        {
+            error_out = "avfilter_graph_config: " + av_err_to_string(ret);
+            free_effects_graph(g);
+            return false;
+        }
+
+        g.description = effects_filter_desc(speed, g.pitch_applied ? pitch : 1.0f, native_pitch);
+        out = g;
+        return true;
+    }
+
+    void free_effects_graph(EffectsGraph &graph)
+    {
+        if (graph.graph)
+            avfilter_graph_free(&graph.graph);
+        if (graph.native)
+        {
+            free_native_stage(graph.native);
+            graph.native = nullptr;
+        }
+        graph.src = nullptr;
+        graph.sink = nullptr;
+    }
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct AVCodecContext;
+struct AVFilterGraph;
+struct AVFilterContext;
+struct AVFrame;
+
+namespace soundboard
+{
+
+    /**
+     * Sample format of the frames fed into a graph (normally a decoder's output).
+     */
+    struct AudioFormat
+    {
+        int sample_rate = 0;
+        int sample_fmt = -1; // AVSampleFormat
+        uint64_t channel_layout = 0;
+        int channels = 0;
+
+        static AudioFormat of(const AVCodecContext *dec_ctx);
+
+        bool operator==(const AudioFormat &o) const
+        {
+            return sample_rate == o.sample_rate && sample_fmt == o.sample_fmt &&
+                   channel_layout == o.channel_layout && channels == o.channels;
+        }
+    };
+
+    struct NativeEffectsStage;
+
+    /**
+     * A configured speed/pitch filter graph:
+     * abuffer -> [atempo | rubberband] -> [atrim] -> aformat -> [asetnsamples] -> abuffersink.
+     * Speed alone is atempo; any pitch shift is one rubberband stage that applies the
+     * speed too. Output matches the target encoder: its sample format, rate and channel
+     * layout, in frames of exactly its frame_size (the last one padded).
+     *
+     * When pitch runs in the native engine instead of rubberband, the graph holds two
+     * chains with NativeStretch (doing speed and pitch) between them, see push_effects_frame():
+     * abuffer -> aformat(fltp) -> abuffersink | NativeStretch |
+     * abuffer -> [atrim] -> aformat -> [asetnsamples] -> abuffersink.
+     */
+    struct EffectsGraph
+    {
+        AVFilterGraph *graph = nullptr;
+        AVFilterContext *src = nullptr;
+        AVFilterContext *sink = nullptr;
+        NativeEffectsStage *native = nullptr; // owned; freed by free_effects_graph()
+        std::string description;    // e.g. "rubberband=tempo=1.50:pitch=0.80" ("anull" for none)
+        bool pitch_applied = false; // false if pitch was requested but could not be applied
+    };
+
+    /**
+     * Output-side trim, in samples of output time at the decoder's sample rate
+     * (i.e. after speed is applied). Zero fields mean "no trim" at that end.
+     */
+    struct EffectsTrim
+    {
+        int64_t start_sample = 0;
+        int64_t end_sample = 0;
+    };
+
+    /**
+     * How a graph is built, beyond the speed/pitch factors.
+     */
+    struct EffectsOptions
+    {
+        // Optional atrim applied after the effects (range streaming)
+        EffectsTrim trim;
+
+        // Short rubberband window / native segments and speed-oriented pitch mode,
+        // so the first output arrives after less buffered input
+        bool low_latency = false;
+
+        // Shift pitch with the built-in NativeStretch engine even when rubberband is
+        // available (it is always used when rubberband is not)
+        bool native_pitch = false;
+    };
+
+    /**
+     * Filter chain description for the given factors ("anull" when both are 1.0).
+     * Factors are formatted to two decimals, matching what the graph uses.
+     * native_pitch names the built-in engine ("native=pitch=...") instead of rubberband.
+     */
+    std::string effects_filter_desc(float speed, float pitch, bool native_pitch = false);
+
+    /**
+     * Build and configure an effects graph fed with frames of the given format.
+     * Speed/pitch are expected to be clamped already (atempo accepts 0.5 - 2.0).
+     * Filters are looked up by name once per process, not per graph.
+     *
+     * @param in Format of the frames that will be pushed into graph.src
+     * @param enc_ctx Opened encoder the graph output is shaped for
+     * @param speed Tempo factor (1.0 = unchanged)
+     * @param pitch Pitch factor (1.0 = unchanged); rubberband if available, else native
+     * @param out Filled in on success; release with free_effects_graph()
+     * @param error_out Reason on failure
+     * @param options Trim and tuning, see EffectsOptions
+     * @return true on success, false on fail (nothing to free)
+     */
+    bool build_effects_graph(const AudioFormat &in, const AVCodecContext *enc_ctx,
+                             float speed, float pitch, EffectsGraph &out, std::string &error_out,
+                             const EffectsOptions &options = {});
+
+    /**
+     * Feed one input frame (nullptr at end of input) into the graph, taking over its
+     * reference like av_buffersrc_add_frame_flags(graph.src, frame, 0). With a native
+     * stage, also moves everything the first chain has ready through NativeStretch into
+     * the second. Output is read from graph.sink either way.
+     * @return 0 or a negative AVERROR
+     */
+    int push_effects_frame(EffectsGraph &graph, AVFrame *frame);
+
+    void free_effects_graph(EffectsGraph &graph);
+
+}
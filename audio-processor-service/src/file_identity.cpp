@@ -0,0 +1,26 @@
+#include "file_identity.h"
+#include <sys/stat.h>
+
+namespace soundboard
+{
+
+    bool FileIdentity::of(const std::string &path, FileIdentity &out)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+        out = from_stat(st);
+        return true;
+    }
+
+    FileIdentity FileIdentity::from_stat(const struct stat &st)
+    {
+        FileIdentity id;
+        id.dev = static_cast<uint64_t>(st.st_dev);
+        id.ino = static_cast<uint64_t>(st.st_ino);
+        id.size = static_cast<int64_t>(st.st_size);
+        id.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        return id;
+    }
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct stat;
+
+namespace soundboard
+{
+
+    /**
+     * Identity of a file's contents: device, inode, size and mtime. Replacing or
+     * editing the file changes it, so it keys caches of anything derived from
+     * the contents (mappings, decoded PCM, rendered effects, probe results).
+     */
+    struct FileIdentity
+    {
+        uint64_t dev = 0;
+        uint64_t ino = 0;
+        int64_t size = 0;
+        int64_t mtime_ns = 0;
+
+        // false if path can't be stat()ed
+        static bool of(const std::string &path, FileIdentity &out);
+        static FileIdentity from_stat(const struct stat &st);
+
+        bool operator==(const FileIdentity &o) const
+        {
+            return dev == o.dev && ino == o.ino && size == o.size && mtime_ns == o.mtime_ns;
+        }
+    };
+
+    /**
+     * FNV-1a over 64-bit fields, for the hash functors of the cache keys.
+     */
+    class Fnv1a
+    {
+    public:
+        void mix(uint64_t v)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                h_ ^= (v >> (i * 8)) & 0xff;
+                h_ *= 1099511628211ULL;
+            }
+        }
+
+        void mix(const FileIdentity &id)
+        {
+            mix(id.dev);
+            mix(id.ino);
+            mix(static_cast<uint64_t>(id.size));
+            mix(static_cast<uint64_t>(id.mtime_ns));
+        }
+
+        size_t value() const { return static_cast<size_t>(h_); }
+
+    private:
+        uint64_t h_ = 1469598103934665603ULL;
+    };
+
+    struct FileIdentityHash
+    {
+        size_t operator()(const FileIdentity &id) const
+        {
+            Fnv1a h;
+            h.mix(id);
+            return h.value();
+        }
+    };
+
+}
@@ -0,0 +1,444 @@
+#include "log.h"
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <strings.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace soundboard::log
+{
+
+    namespace detail
+    {
+        std::atomic<int> g_min_level{static_cast<int>(Level::INFO)};
+        std::atomic<int> g_format{static_cast<int>(Format::KV)};
+    }
+
+    // Records per thread buffered between writer passes; a burst beyond this is dropped
+    static constexpr size_t kRingCapacity = 1024;
+    static constexpr auto kWriterInterval = std::chrono::milliseconds(20);
+
+    static const char *level_name(Level level)
+    {
+        switch (level)
+        {
+        case Level::DEBUG:
+            return "debug";
+        case Level::INFO:
+            return "info";
+        case Level::WARN:
+            return "warn";
+        case Level::ERROR:
+            return "error";
+        }
+        return "info";
+    }
+
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    static bool is_json()
+    {
+        return detail::g_format.load(std::memory_order_relaxed) == static_cast<int>(Format::JSON);
+    }
+
+    // ============================================================================
+    // Per-thread ring (single producer: the owning thread; single consumer: the writer)
+    // ============================================================================
+
+    struct Entry
+    {
+        int64_t ts_ns = 0;
+        Level level = Level::INFO;
+        bool json = false; // format the text was built in
+        std::string text;
+    };
+
+    class Ring
+    {
+    public:
+        bool push(Entry &&e)
+        {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) >= kRingCapacity)
+                return false;
+            slots_[head % kRingCapacity] = std::move(e);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        template <typename F>
+        size_t drain(F &&f)
+        {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            size_t head = head_.load(std::memory_order_acquire);
+            for (size_t i = tail; i < head; ++i)
+            {
+                Entry &e = slots_[i % kRingCapacity];
+                f(e);
+                e.text = std::string(); // release the producer's buffer
+            }
+            tail_.store(head, std::memory_order_release);
+            return head - tail;
+        }
+
+        bool empty() const
+        {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+
+        std::atomic<bool> orphaned{false}; // owning thread exited
+
+    private:
+        Entry slots_[kRingCapacity];
+        alignas(64) std::atomic<size_t> head_{0};
+        alignas(64) std::atomic<size_t> tail_{0};
+    };
+
+    // ============================================================================
+    // Writer
+    // ============================================================================
+
+    class Logger
+    {
+    public:
+        Logger() : thread_([this]()
+                           { run(); }) {}
+
+        ~Logger() { stop(); }
+
+        void set_fd(int fd) { fd_.store(fd, std::memory_order_relaxed); }
+
+        void submit(Entry &&e)
+        {
+            Ring *ring = thread_ring();
+            if (!ring || stopped_.load(std::memory_order_acquire) || !ring->push(std::move(e)))
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(wake_mu_);
+                if (stopping_)
+                    return;
+                stopping_ = true;
+            }
+            wake_cv_.notify_one();
+            if (thread_.joinable())
+                thread_.join();
+            stopped_.store(true, std::memory_order_release);
+            flush(); // anything that raced with the last pass
+        }
+
+    private:
+        struct RingHolder
+        {
+            std::shared_ptr<Ring> ring;
+            ~RingHolder()
+            {
+                if (ring)
+                    ring->orphaned.store(true, std::memory_order_release);
+            }
+        };
+
+        Ring *thread_ring()
+        {
+            thread_local RingHolder holder;
+            if (!holder.ring)
+            {
+                holder.ring = std::make_shared<Ring>();
+                std::lock_guard<std::mutex> lock(rings_mu_);
+                rings_.push_back(holder.ring);
+            }
+            return holder.ring.get();
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(wake_mu_);
+            while (!stopping_)
+            {
+                wake_cv_.wait_for(lock, kWriterInterval, [this]()
+                                  { return stopping_; });
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+
+        // Drain every ring into one buffer and write it with a single syscall
+        void flush()
+        {
+            std::lock_guard<std::mutex> flush_lock(flush_mu_);
+            buf_.clear();
+            {
+                std::lock_guard<std::mutex> lock(rings_mu_);
+                for (auto it = rings_.begin(); it != rings_.end();)
+                {
+                    (*it)->drain([&](const Entry &e)
+                                 { format_line(e); });
+                    // A dead thread's ring goes once it's drained
+                    if ((*it)->orphaned.load(std::memory_order_acquire) && (*it)->empty())
+                        it = rings_.erase(it);
+                    else
+                        ++it;
+                }
+            }
+
+            uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+            if (dropped != reported_dropped_)
+            {
+                Entry e;
+                e.ts_ns = now_ns();
+                e.level = Level::WARN;
+                e.json = is_json();
+                std::string n = std::to_string(dropped - reported_dropped_);
+                e.text = e.json ? "\"event\":\"log.dropped\",\"count\":" + n : "event=log.dropped count=" + n;
+                format_line(e);
+                reported_dropped_ = dropped;
+            }
+
+            write_all(buf_);
+        }
+
+        void format_line(const Entry &e)
+        {
+            char ts[40];
+            time_t secs = static_cast<time_t>(e.ts_ns / 1000000000);
+            struct tm tm;
+            gmtime_r(&secs, &tm);
+            size_t n = strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+            snprintf(ts + n, sizeof(ts) - n, ".%03dZ", static_cast<int>((e.ts_ns / 1000000) % 1000));
+
+            if (e.json)
+            {
+                buf_ += "{\"ts\":\"";
+                buf_ += ts;
+                buf_ += "\",\"level\":\"";
+                buf_ += level_name(e.level);
+                buf_ += "\",";
+                buf_ += e.text;
+                buf_ += "}\n";
+            }
+            else
+            {
+                buf_ += "ts=";
+                buf_ += ts;
+                buf_ += " level=";
+                buf_ += level_name(e.level);
+                buf_ += ' ';
+                buf_ += e.text;
+                buf_ += '\n';
+            }
+        }
+
+        void write_all(const std::string &data)
+        {
+            int fd = fd_.load(std::memory_order_relaxed);
+            size_t off = 0;
+            while (off < data.size())
+            {
+                ssize_t n = ::write(fd, data.data() + off, data.size() - off);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return;
+                off += static_cast<size_t>(n);
+            }
+        }
+
+        std::atomic<int> fd_{1};
+        std::atomic<uint64_t> dropped_{0};
+        uint64_t reported_dropped_ = 0; // writer only (under flush_mu_)
+        std::atomic<bool> stopped_{false};
+
+        std::mutex rings_mu_; // registration (once per thread) vs. writer pass
+        std::vector<std::shared_ptr<Ring>> rings_;
+
+        std::mutex flush_mu_;
+        std::string buf_;
+
+        std::mutex wake_mu_;
+        std::condition_variable wake_cv_;
+        bool stopping_ = false;
+        std::thread thread_;
+    };
+
+    static Logger &logger()
+    {
+        static Logger instance;
+        return instance;
+    }
+
+    void init(const Options &options)
+    {
+        detail::g_min_level.store(static_cast<int>(options.level), std::memory_order_relaxed);
+        detail::g_format.store(static_cast<int>(options.format), std::memory_order_relaxed);
+        logger().set_fd(options.fd);
+    }
+
+    void shutdown()
+    {
+        logger().stop();
+    }
+
+    Level parse_level(const char *s, Level def)
+    {
+        if (!s)
+            return def;
+        if (!strcasecmp(s, "debug"))
+            return Level::DEBUG;
+        if (!strcasecmp(s, "info"))
+            return Level::INFO;
+        if (!strcasecmp(s, "warn") || !strcasecmp(s, "warning"))
+            return Level::WARN;
+        if (!strcasecmp(s, "error"))
+            return Level::ERROR;
+        return def;
+    }
+
+    Format parse_format(const char *s, Format def)
+    {
+        if (!s)
+            return def;
+        if (!strcasecmp(s, "kv") || !strcasecmp(s, "logfmt"))
+            return Format::KV;
+        if (!strcasecmp(s, "json"))
+            return Format::JSON;
+        return def;
+    }
+
+    // ============================================================================
+    // Record
+    // ============================================================================
+
+    // JSON string body, or a logfmt value (quoted only when it needs to be)
+    static void append_escaped(std::string &out, std::string_view v, bool json)
+    {
+        bool quote = json || v.empty() ||
+                     v.find_first_of(" =\"\\\t\r\n") != std::string_view::npos;
+        if (quote)
+            out += '"';
+        for (char c : v)
+        {
+            switch (c)
+            {
+            case '"':
+                out += quote ? "\\\"" : "\"";
+                break;
+            case '\\':
+                out += quote ? "\\\\" : "\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    out += esc;
+                }
+                else
+                    out += c;
+            }
+        }
+        if (quote)
+            out += '"';
+    }
+
+    Record::Record(Level level, std::string_view event) : level_(level), json_(is_json())
+    {
+        text_.reserve(128);
+        if (json_)
+        {
+            text_ += "\"event\":";
+            append_escaped(text_, event, true);
+        }
+        else
+        {
+            text_ += "event=";
+            append_escaped(text_, event, false);
+        }
+    }
+
+    Record::~Record()
+    {
+        Entry e;
+        e.ts_ns = now_ns();
+        e.level = level_;
+        e.json = json_;
+        e.text = std::move(text_);
+        logger().submit(std::move(e));
+    }
+
+    Record &Record::raw(std::string_view key, std::string_view literal)
+    {
+        if (json_)
+        {
+            text_ += ",\"";
+            text_ += key;
+            text_ += "\":";
+        }
+        else
+        {
+            text_ += ' ';
+            text_ += key;
+            text_ += '=';
+        }
+        text_ += literal;
+        return *this;
+    }
+
+    Record &Record::kv(std::string_view key, std::string_view value)
+    {
+        if (json_)
+        {
+            text_ += ",\"";
+            text_ += key;
+            text_ += "\":";
+        }
+        else
+        {
+            text_ += ' ';
+            text_ += key;
+            text_ += '=';
+        }
+        append_escaped(text_, value, json_);
+        return *this;
+    }
+
+    Record &Record::kv(std::string_view key, bool value)
+    {
+        return raw(key, value ? "true" : "false");
+    }
+
+    Record &Record::kv(std::string_view key, double value)
+    {
+        if (!std::isfinite(value))
+            return raw(key, json_ ? "null" : "nan");
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.6g", value);
+        return raw(key, buf);
+    }
+
+}
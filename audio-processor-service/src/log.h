@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace soundboard::log
+{
+
+    enum class Level
+    {
+        DEBUG,
+        INFO,
+        WARN,
+        ERROR
+    };
+
+    enum class Format
+    {
+        KV,  // ts=... level=info event=stream.start req=12 speed=1.5
+        JSON // {"ts":"...","level":"info","event":"stream.start","req":"12","speed":1.5}
+    };
+
+    struct Options
+    {
+        Level level = Level::INFO;
+        Format format = Format::KV;
+        int fd = 1; // stdout
+    };
+
+    /**
+     * Configure the logger (level, format, output). Call once at startup, before
+     * other threads log; records logged earlier use the defaults.
+     */
+    void init(const Options &options);
+
+    /**
+     * Stop the background writer after draining every thread's buffer.
+     * Records logged afterwards are dropped.
+     */
+    void shutdown();
+
+    // Parse "debug"/"info"/"warn"/"error" and "kv"/"json" (def when unrecognised)
+    Level parse_level(const char *s, Level def);
+    Format parse_format(const char *s, Format def);
+
+    namespace detail
+    {
+        extern std::atomic<int> g_min_level;
+        extern std::atomic<int> g_format;
+    }
+
+    inline bool enabled(Level level)
+    {
+        return static_cast<int>(level) >= detail::g_min_level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * One structured log line, built on the calling thread and handed to that
+     * thread's lock-free ring buffer when the Record is destroyed. A background
+     * writer drains all rings and writes them in batches with one write() each,
+     * so logging never takes a shared lock or makes a syscall on the hot path.
+     * If a ring is full the record is dropped (and counted) rather than blocking.
+     *
+     * Use through the LOG_* macros, which skip building the record entirely when
+     * the level is disabled:
+     *
+     *     LOG_INFO("stream.start").kv("req", request_id_).kv("speed", speed);
+     */
+    class Record
+    {
+    public:
+        Record(Level level, std::string_view event);
+        ~Record();
+
+        Record(const Record &) = delete;
+        Record &operator=(const Record &) = delete;
+
+        Record &kv(std::string_view key, std::string_view value);
+        Record &kv(std::string_view key, const char *value) { return kv(key, std::string_view(value ? value : "")); }
+        Record &kv(std::string_view key, const std::string &value) { return kv(key, std::string_view(value)); }
+        Record &kv(std::string_view key, bool value);
+        Record &kv(std::string_view key, double value);
+        Record &kv(std::string_view key, float value) { return kv(key, static_cast<double>(value)); }
+
+        template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+        Record &kv(std::string_view key, T value)
+        {
+            return raw(key, std::to_string(value));
+        }
+
+    private:
+        Record &raw(std::string_view key, std::string_view literal);
+
+        Level level_;
+        bool json_;
+        std::string text_; // event and fields, already in the output format
+    };
+
+    // Lets the LOG_* macros be a single expression (no dangling-else): `&` binds
+    // looser than the .kv() chain, so the whole record is built before it applies
+    struct Voidify
+    {
+        void operator&(const Record &) {}
+    };
+
+}
+
+#define LOG_AT(level, event)                                       \
+    !soundboard::log::enabled(level) ? (void)0                     \
+                                     : soundboard::log::Voidify() & \
+                                           soundboard::log::Record(level, event)
+
+#define LOG_DEBUG(event) LOG_AT(soundboard::log::Level::DEBUG, event)
+#define LOG_INFO(event) LOG_AT(soundboard::log::Level::INFO, event)
+#define LOG_WARN(event) LOG_AT(soundboard::log::Level::WARN, event)
+#define LOG_ERROR(event) LOG_AT(soundboard::log::Level::ERROR, event)
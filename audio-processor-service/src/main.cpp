@@ -1,11 +1,15 @@
-#include <iostream>
 #include <memory>
 #include <string>
 #include <cstdlib>
 #include <thread>
 #include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <utility>
+#include <vector>
 #include <grpcpp/grpcpp.h>
 #include "audio_processor_service_async.h"
+#include "log.h"
 
 static int parseConcurrencyFromEnv() {
     const char* env = std::getenv("AUDIO_PROC_MAX_CONCURRENCY");
@@ -21,17 +25,139 @@ static int parseConcurrencyFromEnv() {
     return std::clamp(def, 1, 1024);
 }
 
+static int parseDspThreadsFromEnv(int maxConcurrency) {
+    const char* env = std::getenv("AUDIO_PROC_DSP_THREADS");
+    if (env && *env) {
+        try {
+            int v = std::stoi(env);
+            if (v > 0) return std::clamp(v, 1, 1024);
+        } catch (...) {}
+    }
+    // One worker per permitted stream, capped at the core count
+    unsigned int hw = std::thread::hardware_concurrency();
+    if (hw == 0) hw = 2;
+    return std::clamp(maxConcurrency, 1, static_cast<int>(hw));
+}
+
+// Non-negative integer from the environment, or def when unset/invalid
+static int parseIntFromEnv(const char* name, int def) {
+    const char* env = std::getenv(name);
+    if (env && *env) {
+        try {
+            int v = std::stoi(env);
+            if (v >= 0) return v;
+        } catch (...) {}
+    }
+    return def;
+}
+
+static soundboard::AdmissionQueue::Limits parseAdmissionLimitsFromEnv(int maxConcurrency) {
+    using Method = soundboard::AdmissionQueue::Method;
+    soundboard::AdmissionQueue::Limits limits;
+    limits.total = maxConcurrency;
+    // Per-method caps default to the global limit (0 = no extra cap)
+    limits.per_method[static_cast<size_t>(Method::EXTRACT_AUDIO)] = parseIntFromEnv("AUDIO_PROC_MAX_EXTRACT", 0);
+    limits.per_method[static_cast<size_t>(Method::APPLY_EFFECTS)] = parseIntFromEnv("AUDIO_PROC_MAX_STREAMS", 0);
+    limits.max_queued = static_cast<size_t>(parseIntFromEnv("AUDIO_PROC_ADMISSION_QUEUE", maxConcurrency * 4));
+    limits.max_wait = std::chrono::milliseconds(parseIntFromEnv("AUDIO_PROC_ADMISSION_TIMEOUT_MS", 2000));
+    return limits;
+}
+
+static soundboard::EffectsCache::Options parseEffectsCacheOptionsFromEnv() {
+    soundboard::EffectsCache::Options opts;
+    opts.memory_bytes = static_cast<size_t>(parseIntFromEnv("AUDIO_PROC_EFFECTS_CACHE_MB", 256)) << 20;
+    opts.disk_bytes = static_cast<size_t>(parseIntFromEnv("AUDIO_PROC_EFFECTS_CACHE_DISK_MB", 2048)) << 20;
+    const char* dir = std::getenv("AUDIO_PROC_EFFECTS_CACHE_DIR");
+    opts.disk_dir = dir ? dir : "/tmp/audio/effects-cache";  // set empty to disable the disk tier
+    return opts;
+}
+
+static soundboard::PcmCache::Options parsePcmCacheOptionsFromEnv() {
+    soundboard::PcmCache::Options opts;
+    opts.memory_bytes = static_cast<size_t>(std::max(0, parseIntFromEnv("AUDIO_PROC_PCM_CACHE_MB", 128))) << 20;
+    opts.max_clip_bytes = static_cast<size_t>(std::max(1, parseIntFromEnv("AUDIO_PROC_PCM_CACHE_MAX_CLIP_MB", 32))) << 20;
+    // Requests for a clip before it is decoded into the cache
+    opts.admit_after = std::max(1, parseIntFromEnv("AUDIO_PROC_PCM_CACHE_ADMIT_AFTER", 2));
+    return opts;
+}
+
+static void parseChunkingFromEnv(AudioProcessorAsync::Options& options) {
+    options.firstChunkBytes = static_cast<size_t>(std::max(1, parseIntFromEnv("AUDIO_PROC_FIRST_CHUNK_KB", 8))) << 10;
+    options.chunkBytes = static_cast<size_t>(std::max(1, parseIntFromEnv("AUDIO_PROC_CHUNK_KB", 32))) << 10;
+    // 0 sends every encoded packet as soon as it's ready
+    options.chunkMaxLatency = std::chrono::milliseconds(parseIntFromEnv("AUDIO_PROC_CHUNK_MAX_LATENCY_MS", 200));
+    // Low-latency mode for every stream (clients can also ask per request)
+    options.lowLatencyDefault = parseIntFromEnv("AUDIO_PROC_LOW_LATENCY", 0) != 0;
+    options.lowLatencyFirstChunkBytes = static_cast<size_t>(std::max(1, parseIntFromEnv("AUDIO_PROC_LOW_LATENCY_FIRST_CHUNK_BYTES", 1024)));
+    // Encoded chunks produced ahead of the client; 1 = lock-step with the writes
+    options.readAheadChunks = std::max(1, parseIntFromEnv("AUDIO_PROC_READ_AHEAD_CHUNKS", 4));
+    // Per producer run, before a stream with no output yet yields to the others
+    options.pumpPacketBudget = std::max(1, parseIntFromEnv("AUDIO_PROC_PUMP_PACKETS", 64));
+    options.pumpTimeBudget = std::chrono::microseconds(std::max(100, parseIntFromEnv("AUDIO_PROC_PUMP_BUDGET_US", 5000)));
+}
+
+// Comma-separated speed:pitch pairs, e.g. "0.75:1,1.5:1,1:1.2"; empty disables prerendering
+static std::vector<std::pair<float, float>> parsePrerenderPresetsFromEnv() {
+    const char* env = std::getenv("AUDIO_PROC_PRERENDER_PRESETS");
+    std::string spec = env ? env : "0.75:1,1.5:1,1:1.2,1:0.8";
+    std::vector<std::pair<float, float>> presets;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) continue;
+        try {
+            presets.emplace_back(std::stof(item.substr(0, colon)), std::stof(item.substr(colon + 1)));
+        } catch (...) {
+            LOG_WARN("config.invalid_preset").kv("preset", item);
+        }
+    }
+    return presets;
+}
+
+static soundboard::log::Options parseLogOptionsFromEnv() {
+    soundboard::log::Options opts;
+    opts.level = soundboard::log::parse_level(std::getenv("AUDIO_PROC_LOG_LEVEL"), soundboard::log::Level::INFO);
+    opts.format = soundboard::log::parse_format(std::getenv("AUDIO_PROC_LOG_FORMAT"), soundboard::log::Format::KV);
+    return opts;
+}
+
 int main(int argc, char** argv) {
+    soundboard::log::init(parseLogOptionsFromEnv());
     try {
         std::string server_address("0.0.0.0:50051");
         int maxConcurrency = parseConcurrencyFromEnv();
         int numCQThreads = std::max(1, maxConcurrency / 2);  // 1 CQ thread per 2 RPC permits
         
-        AudioProcessorAsync server(maxConcurrency);
+        AudioProcessorAsync::Options options;
+        options.maxConcurrency = maxConcurrency;
+        options.dspThreads = parseDspThreadsFromEnv(maxConcurrency);
+        // Whole-file conversions get their own workers (0 = half the DSP threads)
+        options.extractThreads = parseIntFromEnv("AUDIO_PROC_EXTRACT_THREADS", 0);
+        options.admission = parseAdmissionLimitsFromEnv(maxConcurrency);
+        options.effectsCache = parseEffectsCacheOptionsFromEnv();
+        parseChunkingFromEnv(options);
+        options.effectsCache.disk_chunk_bytes = options.chunkBytes;
+        options.prerenderPresets = parsePrerenderPresetsFromEnv();
+        // BatchExtractAudio: conversions in flight per call (0 = half the extract threads) and items per call
+        options.batchParallelism = std::max(0, parseIntFromEnv("AUDIO_PROC_BATCH_PARALLELISM", 0));
+        options.batchMaxItems = std::max(1, parseIntFromEnv("AUDIO_PROC_BATCH_MAX_ITEMS", 1000));
+        // ExtractAudioStream uploads are held in memory; larger ones are refused
+        options.uploadMaxBytes = static_cast<size_t>(std::max(1, parseIntFromEnv("AUDIO_PROC_UPLOAD_MAX_MB", 512))) << 20;
+        // Idle pre-built pipelines kept per (input format, speed, pitch); 0 disables pooling
+        options.pipelinePool.max_idle_per_key = static_cast<size_t>(std::max(0, parseIntFromEnv("AUDIO_PROC_PIPELINE_POOL", 2)));
+        options.nativePitch = parseIntFromEnv("AUDIO_PROC_NATIVE_PITCH", 0) != 0;
+        options.pcmCache = parsePcmCacheOptionsFromEnv();
+        options.audioInfoCacheEntries = static_cast<size_t>(parseIntFromEnv("AUDIO_PROC_INFO_CACHE_ENTRIES", 4096));
+        options.metricsPort = parseIntFromEnv("AUDIO_PROC_METRICS_PORT", 9100);
+        
+        AudioProcessorAsync server(options);
         server.Run(server_address, numCQThreads);
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        LOG_ERROR("server.fatal").kv("error", e.what());
+        soundboard::log::shutdown();
         return 1;
     }
+    soundboard::log::shutdown();
     return 0;
 }
\ No newline at end of file
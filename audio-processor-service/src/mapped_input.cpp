@@ -0,0 +1,360 @@
+#include "mapped_input.h"
+#include "file_identity.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+namespace soundboard
+{
+
+    // Mappings kept by the process-wide cache (held ones stay valid past eviction)
+    static constexpr size_t kMaxCachedMappings = 256;
+
+    // How often a miss re-checks cached files for deletion or replacement
+    static constexpr std::chrono::seconds kStaleSweepInterval{5};
+
+    // Larger files (long videos) are read through the file protocol instead
+    static constexpr size_t kMaxMappedBytes = size_t(512) << 20;
+
+    // Prefetched on first mapping: enough for probing and the first seconds of audio
+    static constexpr size_t kWillNeedBytes = size_t(1) << 20;
+
+    // AVIOContext buffer; refills are memcpy from the mapping
+    static constexpr int kIoBufferBytes = 64 * 1024;
+
+    // ============================================================================
+    // MappedFile
+    // ============================================================================
+
+    MappedFile::~MappedFile()
+    {
+        munmap(const_cast<uint8_t *>(data_), size_);
+    }
+
+    std::shared_ptr<const MappedFile> MappedFile::map(const std::string &path, std::string &error_out)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            error_out = std::string("open: ") + strerror(errno);
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        {
+            error_out = "not a non-empty regular file";
+            close(fd);
+            return nullptr;
+        }
+
+        size_t size = static_cast<size_t>(st.st_size);
+        FileIdentity identity = FileIdentity::from_stat(st);
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file open
+        if (addr == MAP_FAILED)
+        {
+            error_out = std::string("mmap: ") + strerror(errno);
+            return nullptr;
+        }
+
+        // Demuxers read front to back: aggressive readahead, and start on the head now
+        madvise(addr, size, MADV_SEQUENTIAL);
+        madvise(addr, std::min(size, kWillNeedBytes), MADV_WILLNEED);
+        return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const uint8_t *>(addr), size, identity));
+    }
+
+    // ============================================================================
+    // Process-wide mapping cache
+    // ============================================================================
+
+    namespace
+    {
+        struct MappingCache
+        {
+            struct Entry
+            {
+                std::shared_ptr<const MappedFile> file;
+                std::string path; // where it was last opened from
+                std::list<FileIdentity>::iterator lru_it;
+            };
+
+            std::mutex mu;
+            std::unordered_map<FileIdentity, Entry, FileIdentityHash> entries;
+            std::list<FileIdentity> lru; // front = most recently used
+            size_t mapped_bytes = 0;
+            std::chrono::steady_clock::time_point last_sweep;
+            MappedFileStats stats;
+
+            void erase(std::unordered_map<FileIdentity, Entry, FileIdentityHash>::iterator it)
+            {
+                mapped_bytes -= it->second.file->size();
+                lru.erase(it->second.lru_it);
+                entries.erase(it);
+            }
+
+            // Drop entries whose path no longer names the mapped file (deleted, or
+            // replaced by a rename): nothing will hit them again, and the mapping
+            // would keep a deleted file's blocks allocated. mu held.
+            void sweep_stale()
+            {
+                auto now = std::chrono::steady_clock::now();
+                if (now - last_sweep < kStaleSweepInterval)
+                    return;
+                last_sweep = now;
+                for (auto it = entries.begin(); it != entries.end();)
+                {
+                    auto next = std::next(it);
+                    struct stat st;
+                    if (stat(it->second.path.c_str(), &st) != 0 || !(FileIdentity::from_stat(st) == it->first))
+                        erase(it);
+                    it = next;
+                }
+            }
+        };
+
+        MappingCache &mapping_cache()
+        {
+            static MappingCache cache;
+            return cache;
+        }
+    }
+
+    std::shared_ptr<const MappedFile> shared_mapping(const std::string &path)
+    {
+        MappingCache &cache = mapping_cache();
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+            static_cast<size_t>(st.st_size) > kMaxMappedBytes)
+        {
+            std::lock_guard<std::mutex> lock(cache.mu);
+            ++cache.stats.fallbacks;
+            return nullptr;
+        }
+
+        FileIdentity key = FileIdentity::from_stat(st);
+
+        {
+            std::lock_guard<std::mutex> lock(cache.mu);
+            auto it = cache.entries.find(key);
+            if (it != cache.entries.end())
+            {
+                cache.lru.splice(cache.lru.begin(), cache.lru, it->second.lru_it);
+                ++cache.stats.hits;
+                return it->second.file;
+            }
+        }
+
+        // Map outside the lock; if two readers race, the first insert wins
+        std::string err;
+        std::shared_ptr<const MappedFile> file = MappedFile::map(path, err);
+
+        std::lock_guard<std::mutex> lock(cache.mu);
+        if (!file || file->size() > kMaxMappedBytes)
+        {
+            ++cache.stats.fallbacks;
+            return nullptr;
+        }
+        ++cache.stats.misses;
+        cache.sweep_stale();
+        // Keyed on what was actually mapped: path may have been replaced since the stat()
+        key = file->identity();
+        auto it = cache.entries.find(key);
+        if (it != cache.entries.end())
+            return it->second.file;
+
+        while (cache.entries.size() >= kMaxCachedMappings && !cache.lru.empty())
+            cache.erase(cache.entries.find(cache.lru.back()));
+        cache.lru.push_front(key);
+        cache.entries.emplace(key, MappingCache::Entry{file, path, cache.lru.begin()});
+        cache.mapped_bytes += file->size();
+        return file;
+    }
+
+    MappedFileStats mapped_file_stats()
+    {
+        MappingCache &cache = mapping_cache();
+        std::lock_guard<std::mutex> lock(cache.mu);
+        MappedFileStats s = cache.stats;
+        s.mappings = cache.entries.size();
+        s.mapped_bytes = cache.mapped_bytes;
+        return s;
+    }
+
+    // ============================================================================
+    // AVIOContext over a mapping (or any bytes in memory)
+    // ============================================================================
+
+    namespace
+    {
+        struct MappedReader
+        {
+            std::shared_ptr<const void> owner; // keeps data alive
+            const uint8_t *data = nullptr;
+            size_t size = 0;
+            int64_t pos = 0;
+        };
+    }
+
+    static int read_mapped(void *opaque, uint8_t *buf, int buf_size)
+    {
+        MappedReader *r = static_cast<MappedReader *>(opaque);
+        int64_t left = static_cast<int64_t>(r->size) - r->pos;
+        if (left <= 0)
+            return AVERROR_EOF;
+        int n = static_cast<int>(std::min<int64_t>(buf_size, left));
+        memcpy(buf, r->data + r->pos, n);
+        r->pos += n;
+        return n;
+    }
+
+    static int64_t seek_mapped(void *opaque, int64_t offset, int whence)
+    {
+        MappedReader *r = static_cast<MappedReader *>(opaque);
+        const int64_t size = static_cast<int64_t>(r->size);
+        int64_t pos;
+        switch (whence & ~AVSEEK_FORCE)
+        {
+        case AVSEEK_SIZE:
+            return size;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = r->pos + offset;
+            break;
+        case SEEK_END:
+            pos = size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        r->pos = std::min(pos, size);
+        return r->pos;
+    }
+
+    static void free_mapped_io(AVIOContext **pb)
+    {
+        if (!*pb)
+            return;
+        delete static_cast<MappedReader *>((*pb)->opaque);
+        av_freep(&(*pb)->buffer);
+        avio_context_free(pb);
+    }
+
+    static AVIOContext *open_mapped_io(std::shared_ptr<const void> owner, const uint8_t *data, size_t size)
+    {
+        uint8_t *buffer = static_cast<uint8_t *>(av_malloc(kIoBufferBytes));
+        if (!buffer)
+            return nullptr;
+        MappedReader *reader = new MappedReader{std::move(owner), data, size, 0};
+        AVIOContext *pb = avio_alloc_context(buffer, kIoBufferBytes, 0, reader, read_mapped, nullptr, seek_mapped);
+        if (!pb)
+        {
+            delete reader;
+            av_free(buffer);
+        }
+        return pb;
+    }
+
+    static AVIOContext *open_mapped_io(const std::string &path, bool shared)
+    {
+        std::shared_ptr<const MappedFile> file;
+        if (shared)
+        {
+            file = shared_mapping(path);
+        }
+        else
+        {
+            std::string err;
+            file = MappedFile::map(path, err);
+            if (file && file->size() > kMaxMappedBytes)
+                file.reset();
+        }
+        if (!file)
+            return nullptr;
+        const uint8_t *data = file->data();
+        size_t size = file->size();
+        return open_mapped_io(std::move(file), data, size);
+    }
+
+    int open_format_input(AVFormatContext **fmt, const std::string &path, bool shared)
+    {
+        AVIOContext *pb = open_mapped_io(path, shared);
+        if (pb)
+        {
+            if (!*fmt && !(*fmt = avformat_alloc_context()))
+            {
+                free_mapped_io(&pb);
+                return AVERROR(ENOMEM);
+            }
+            // A preset pb makes libavformat mark the context AVFMT_FLAG_CUSTOM_IO
+            (*fmt)->pb = pb;
+        }
+
+        // On failure avformat_open_input frees *fmt, but never a caller-supplied pb
+        int ret = avformat_open_input(fmt, path.c_str(), nullptr, nullptr);
+        if (ret < 0)
+            free_mapped_io(&pb);
+        return ret;
+    }
+
+    int open_memory_input(AVFormatContext **fmt, std::shared_ptr<const std::string> bytes, const std::string &name)
+    {
+        if (!bytes || bytes->empty())
+        {
+            if (*fmt)
+                avformat_free_context(*fmt);
+            *fmt = nullptr;
+            return AVERROR_INVALIDDATA;
+        }
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(bytes->data());
+        size_t size = bytes->size();
+        AVIOContext *pb = open_mapped_io(std::move(bytes), data, size);
+        if (!pb || (!*fmt && !(*fmt = avformat_alloc_context())))
+        {
+            free_mapped_io(&pb);
+            if (*fmt)
+                avformat_free_context(*fmt);
+            *fmt = nullptr;
+            return AVERROR(ENOMEM);
+        }
+        (*fmt)->pb = pb;
+
+        int ret = avformat_open_input(fmt, name.c_str(), nullptr, nullptr);
+        if (ret < 0)
+            free_mapped_io(&pb);
+        return ret;
+    }
+
+    void close_format_input(AVFormatContext **fmt)
+    {
+        if (!*fmt)
+            return;
+        AVIOContext *pb = ((*fmt)->flags & AVFMT_FLAG_CUSTOM_IO) && (*fmt)->pb &&
+                                  (*fmt)->pb->read_packet == read_mapped
+                              ? (*fmt)->pb
+                              : nullptr;
+        avformat_close_input(fmt);
+        free_mapped_io(&pb);
+    }
+
+}
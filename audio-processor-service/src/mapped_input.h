@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "file_identity.h"
+
+struct AVFormatContext;
+
+namespace soundboard
+{
+
+    /**
+     * Read-only mmap of a whole file, unmapped when the last holder lets go.
+     *
+     * Inputs are assumed never to be truncated in place: reading a page past the new
+     * end of a shrunk file raises SIGBUS. Files here are replaced by writing a new one
+     * and renaming it over the old (a new inode), which leaves mappings of the old
+     * file intact.
+     */
+    class MappedFile
+    {
+    public:
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        /**
+         * Map path (regular, non-empty files only) with sequential-access hints.
+         * @return nullptr on failure (error_out says why)
+         */
+        static std::shared_ptr<const MappedFile> map(const std::string &path, std::string &error_out);
+
+        const uint8_t *data() const { return data_; }
+        size_t size() const { return size_; }
+
+        // Identity of the file actually mapped (fstat of the mapped descriptor)
+        const FileIdentity &identity() const { return identity_; }
+
+    private:
+        MappedFile(const uint8_t *data, size_t size, const FileIdentity &identity)
+            : data_(data), size_(size), identity_(identity) {}
+
+        const uint8_t *data_;
+        size_t size_;
+        FileIdentity identity_;
+    };
+
+    struct MappedFileStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;   // mapped afresh
+        uint64_t fallbacks = 0; // not mappable, opened by path instead
+        size_t mappings = 0;
+        size_t mapped_bytes = 0;
+    };
+
+    /**
+     * The shared mapping of path, from a process-wide cache keyed by file identity
+     * (dev, inode, size, mtime): every reader of an unchanged file shares one mapping,
+     * and a replaced file is mapped anew. The cache keeps the most recently used
+     * mappings, dropping those whose file has since been deleted or replaced so their
+     * disk blocks are freed once the last reader lets go; files over the size limit
+     * are not mapped.
+     * @return nullptr if the file can't or shouldn't be mapped
+     */
+    std::shared_ptr<const MappedFile> shared_mapping(const std::string &path);
+
+    MappedFileStats mapped_file_stats();
+
+    /**
+     * avformat_open_input() for a local file, reading through an AVIOContext over the
+     * file's shared mapping instead of libavformat's file protocol: no read() per
+     * buffer refill, and no page-cache copy per reader. Falls back to opening by path
+     * if the file can't be mapped.
+     *
+     * @param fmt As for avformat_open_input: may point to a pre-allocated context
+     *        (e.g. with probe limits set); set to nullptr on failure
+     * @param shared Use the process-wide mapping cache. Pass false for one-shot inputs
+     *        (files converted once and then deleted, like uploads): they get a private
+     *        mapping, released with the context
+     * @return 0 or a negative AVERROR
+     */
+    int open_format_input(AVFormatContext **fmt, const std::string &path, bool shared = true);
+
+    /**
+     * open_format_input() over bytes already in memory, such as an upload received
+     * over gRPC. The context keeps bytes alive until close_format_input(). name is
+     * only a hint for format probing (by extension) and for messages.
+     * @return 0 or a negative AVERROR
+     */
+    int open_memory_input(AVFormatContext **fmt, std::shared_ptr<const std::string> bytes, const std::string &name);
+
+    /**
+     * avformat_close_input() that also frees the mapped or in-memory AVIOContext, if any.
+     */
+    void close_format_input(AVFormatContext **fmt);
+
+}
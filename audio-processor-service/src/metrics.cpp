@@ -0,0 +1,302 @@
+#include "metrics.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace soundboard
+{
+
+    size_t metric_shard_index()
+    {
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+        return index;
+    }
+
+    // ============================================================================
+    // Counter / Histogram
+    // ============================================================================
+
+    uint64_t Counter::value() const
+    {
+        uint64_t total = 0;
+        for (const auto &s : shards_)
+            total += s.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    Histogram::Histogram(std::vector<double> bounds) : bounds_(std::move(bounds))
+    {
+        for (auto &s : shards_)
+        {
+            s.buckets.reset(new std::atomic<uint64_t>[bounds_.size() + 1]);
+            for (size_t i = 0; i <= bounds_.size(); ++i)
+                s.buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Histogram::observe(double value)
+    {
+        size_t bucket = 0;
+        while (bucket < bounds_.size() && value > bounds_[bucket])
+            ++bucket;
+
+        Shard &s = shards_[metric_shard_index()];
+        s.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        s.sum_micros.fetch_add(static_cast<uint64_t>(std::llround(std::max(value, 0.0) * 1e6)),
+                               std::memory_order_relaxed);
+    }
+
+    Histogram::Snapshot Histogram::snapshot() const
+    {
+        Snapshot snap;
+        snap.bounds = bounds_;
+        snap.cumulative.assign(bounds_.size() + 1, 0);
+        uint64_t sum_micros = 0;
+        for (const auto &s : shards_)
+        {
+            for (size_t i = 0; i <= bounds_.size(); ++i)
+                snap.cumulative[i] += s.buckets[i].load(std::memory_order_relaxed);
+            sum_micros += s.sum_micros.load(std::memory_order_relaxed);
+        }
+        for (size_t i = 1; i < snap.cumulative.size(); ++i)
+            snap.cumulative[i] += snap.cumulative[i - 1];
+        snap.count = snap.cumulative.back();
+        snap.sum = double(sum_micros) / 1e6;
+        return snap;
+    }
+
+    std::vector<double> Histogram::latency_buckets()
+    {
+        return {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+    }
+
+    std::vector<double> Histogram::realtime_buckets()
+    {
+        return {1, 2, 5, 10, 20, 50, 100, 200, 500};
+    }
+
+    // ============================================================================
+    // MetricsWriter
+    // ============================================================================
+
+    void MetricsWriter::header(const char *name, const char *help, const char *type)
+    {
+        if (last_name_ == name)
+            return;
+        last_name_ = name;
+        out_ += "# HELP ";
+        out_ += name;
+        out_ += ' ';
+        out_ += help;
+        out_ += "\n# TYPE ";
+        out_ += name;
+        out_ += ' ';
+        out_ += type;
+        out_ += '\n';
+    }
+
+    void MetricsWriter::sample(const std::string &name, const std::string &labels, double value)
+    {
+        char buf[64];
+        if (value == std::floor(value) && std::fabs(value) < 1e15)
+            snprintf(buf, sizeof(buf), "%" PRId64, static_cast<int64_t>(value));
+        else
+            snprintf(buf, sizeof(buf), "%.6g", value);
+
+        out_ += name;
+        if (!labels.empty())
+        {
+            out_ += '{';
+            out_ += labels;
+            out_ += '}';
+        }
+        out_ += ' ';
+        out_ += buf;
+        out_ += '\n';
+    }
+
+    void MetricsWriter::counter(const char *name, const char *help, double value, const std::string &labels)
+    {
+        header(name, help, "counter");
+        sample(name, labels, value);
+    }
+
+    void MetricsWriter::gauge(const char *name, const char *help, double value, const std::string &labels)
+    {
+        header(name, help, "gauge");
+        sample(name, labels, value);
+    }
+
+    void MetricsWriter::histogram(const char *name, const char *help, const Histogram &h, const std::string &labels)
+    {
+        header(name, help, "histogram");
+        Histogram::Snapshot snap = h.snapshot();
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        std::string bucket = std::string(name) + "_bucket";
+        for (size_t i = 0; i < snap.bounds.size(); ++i)
+        {
+            char le[32];
+            snprintf(le, sizeof(le), "%g", snap.bounds[i]);
+            sample(bucket, prefix + "le=\"" + le + "\"", double(snap.cumulative[i]));
+        }
+        sample(bucket, prefix + "le=\"+Inf\"", double(snap.count));
+        sample(std::string(name) + "_sum", labels, snap.sum);
+        sample(std::string(name) + "_count", labels, double(snap.count));
+    }
+
+    void write_process_metrics(MetricsWriter &w)
+    {
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0)
+        {
+            double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+            w.counter("process_cpu_seconds_total", "Total user and system CPU time spent in seconds.", cpu);
+        }
+
+        // statm: size resident shared ... (in pages)
+        std::ifstream statm("/proc/self/statm");
+        long pages_total = 0, pages_resident = 0;
+        if (statm >> pages_total >> pages_resident)
+            w.gauge("process_resident_memory_bytes", "Resident memory size in bytes.",
+                    double(pages_resident) * sysconf(_SC_PAGESIZE));
+
+        if (DIR *dir = opendir("/proc/self/fd"))
+        {
+            int fds = 0;
+            while (readdir(dir))
+                ++fds;
+            closedir(dir);
+            w.gauge("process_open_fds", "Number of open file descriptors.", fds - 2); // minus . and ..
+        }
+    }
+
+    // ============================================================================
+    // MetricsServer
+    // ============================================================================
+
+    MetricsServer::MetricsServer(int port, Render render) : port_(port), render_(std::move(render)) {}
+
+    MetricsServer::~MetricsServer()
+    {
+        stop();
+    }
+
+    bool MetricsServer::start(std::string &error_out)
+    {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0)
+        {
+            error_out = std::string("socket: ") + strerror(errno);
+            return false;
+        }
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(static_cast<uint16_t>(port_));
+        if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_fd_, 16) != 0)
+        {
+            error_out = "bind/listen on port " + std::to_string(port_) + ": " + strerror(errno);
+            close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+
+        thread_ = std::thread([this]()
+                              { run(); });
+        return true;
+    }
+
+    void MetricsServer::stop()
+    {
+        stopping_.store(true);
+        if (thread_.joinable())
+            thread_.join();
+        if (listen_fd_ >= 0)
+        {
+            close(listen_fd_);
+            listen_fd_ = -1;
+        }
+    }
+
+    void MetricsServer::run()
+    {
+        while (!stopping_.load())
+        {
+            // Wake up periodically to notice stop()
+            pollfd pfd{listen_fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 500) <= 0)
+                continue;
+
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+                continue;
+            handle(fd);
+            close(fd);
+        }
+    }
+
+    static void write_all(int fd, const std::string &data)
+    {
+        size_t off = 0;
+        while (off < data.size())
+        {
+            ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return;
+            off += static_cast<size_t>(n);
+        }
+    }
+
+    void MetricsServer::handle(int fd)
+    {
+        // A scraper won't stall the listener for long
+        timeval tv{2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+        {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            request.append(buf, static_cast<size_t>(n));
+        }
+
+        std::string status = "200 OK";
+        std::string body;
+        if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET /metrics?", 0) == 0)
+            body = render_();
+        else
+        {
+            status = "404 Not Found";
+            body = "not found\n";
+        }
+
+        std::string response = "HTTP/1.1 " + status + "\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n";
+        write_all(fd, response);
+        write_all(fd, body);
+    }
+
+}
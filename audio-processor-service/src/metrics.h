@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace soundboard
+{
+
+    // Counters and histograms are split into this many cache-line sized slots; each
+    // thread always updates the same slot, so the hot path is one relaxed atomic add
+    // with no cross-core contention. Readers sum the slots at scrape time.
+    static constexpr size_t kMetricShards = 16;
+
+    // Slot for the calling thread (assigned round-robin on first use)
+    size_t metric_shard_index();
+
+    /**
+     * Monotonic counter.
+     */
+    class Counter
+    {
+    public:
+        void add(uint64_t n = 1)
+        {
+            shards_[metric_shard_index()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+        uint64_t value() const;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> value{0};
+        };
+        Shard shards_[kMetricShards];
+    };
+
+    /**
+     * Up/down gauge (in-flight counts). Updated far less often than counters,
+     * so a single atomic is enough.
+     */
+    class Gauge
+    {
+    public:
+        void add(int64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+        void sub(int64_t n = 1) { value_.fetch_sub(n, std::memory_order_relaxed); }
+        int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<int64_t> value_{0};
+    };
+
+    /**
+     * Fixed-bucket histogram (Prometheus semantics: cumulative "le" buckets plus
+     * sum and count). The sum is kept in micro-units, so observed values have
+     * 1e-6 resolution.
+     */
+    class Histogram
+    {
+    public:
+        struct Snapshot
+        {
+            std::vector<double> bounds;
+            std::vector<uint64_t> cumulative; // bounds.size() + 1 entries, last is +Inf
+            double sum = 0.0;
+            uint64_t count = 0;
+        };
+
+        explicit Histogram(std::vector<double> bounds = latency_buckets());
+
+        void observe(double value);
+        Snapshot snapshot() const;
+
+        // Bucket layouts used by the service
+        static std::vector<double> latency_buckets();  // seconds, 1ms - 60s
+        static std::vector<double> realtime_buckets(); // x realtime, 1 - 500
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+            std::atomic<uint64_t> sum_micros{0};
+        };
+
+        std::vector<double> bounds_;
+        Shard shards_[kMetricShards];
+    };
+
+    /**
+     * Builds a Prometheus text exposition (format 0.0.4). HELP/TYPE lines are
+     * written the first time a metric name is seen, so labelled series of the
+     * same metric must be written consecutively.
+     */
+    class MetricsWriter
+    {
+    public:
+        void counter(const char *name, const char *help, double value, const std::string &labels = "");
+        void gauge(const char *name, const char *help, double value, const std::string &labels = "");
+        void histogram(const char *name, const char *help, const Histogram &h, const std::string &labels = "");
+
+        const std::string &text() const { return out_; }
+
+    private:
+        void header(const char *name, const char *help, const char *type);
+        void sample(const std::string &name, const std::string &labels, double value);
+
+        std::string out_;
+        std::string last_name_;
+    };
+
+    // Process-wide series (CPU time, resident memory, open fds)
+    void write_process_metrics(MetricsWriter &w);
+
+    /**
+     * Minimal HTTP listener answering GET /metrics with render()'s output.
+     * One connection at a time on its own thread; scrapes are rare and small.
+     */
+    class MetricsServer
+    {
+    public:
+        using Render = std::function<std::string()>;
+
+        MetricsServer(int port, Render render);
+        ~MetricsServer();
+
+        MetricsServer(const MetricsServer &) = delete;
+        MetricsServer &operator=(const MetricsServer &) = delete;
+
+        /**
+         * Bind and start serving.
+         * @return false if the port can't be bound (error_out says why)
+         */
+        bool start(std::string &error_out);
+        void stop();
+
+    private:
+        void run();
+        void handle(int fd);
+
+        int port_;
+        Render render_;
+        int listen_fd_ = -1;
+        std::atomic<bool> stopping_{false};
+        std::thread thread_;
+    };
+
+}
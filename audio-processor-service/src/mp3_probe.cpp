@@ -0,0 +1,406 @@
+#include "mp3_probe.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace soundboard
+{
+
+    // How far past the ID3v2 tag we search for the first frame sync
+    static constexpr size_t kSyncSearchBytes = 16 * 1024;
+
+    // Consecutive frames of one stream (same version, rate and channels) needed before
+    // a sync is believed: random data passes a single successor check a few % of the time
+    static constexpr int kConfirmFrames = 3;
+
+    static const int kBitratesV1L3[16] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, -1};
+    static const int kBitratesV2L3[16] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, -1};
+    static const int kSampleRates[3][3] = {
+        {44100, 48000, 32000}, // MPEG-1
+        {22050, 24000, 16000}, // MPEG-2
+        {11025, 12000, 8000},  // MPEG-2.5
+    };
+
+    struct FrameHeader
+    {
+        int version = 0; // 1, 2, 25
+        int sample_rate = 0;
+        int channels = 0;
+        int bitrate_kbps = 0;
+        int samples = 0;
+        int length = 0;    // bytes including header
+        int side_info = 0; // bytes of Layer III side info
+    };
+
+    static uint32_t read_be32(const uint8_t *p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    // Decode a 4-byte Layer III frame header; false for anything else (incl. free-format)
+    static bool parse_frame_header(const uint8_t *p, FrameHeader &h)
+    {
+        uint32_t v = read_be32(p);
+        if ((v & 0xFFE00000u) != 0xFFE00000u)
+            return false;
+
+        int version_bits = (v >> 19) & 3;
+        int layer_bits = (v >> 17) & 3;
+        int bitrate_idx = (v >> 12) & 15;
+        int rate_idx = (v >> 10) & 3;
+        int padding = (v >> 9) & 1;
+        int mode = (v >> 6) & 3;
+
+        if (version_bits == 1 || layer_bits != 1 || bitrate_idx == 0 || bitrate_idx == 15 || rate_idx == 3)
+            return false;
+
+        int vi = version_bits == 3 ? 0 : (version_bits == 2 ? 1 : 2);
+        h.version = vi == 0 ? 1 : (vi == 1 ? 2 : 25);
+        h.sample_rate = kSampleRates[vi][rate_idx];
+        h.channels = mode == 3 ? 1 : 2;
+        h.bitrate_kbps = vi == 0 ? kBitratesV1L3[bitrate_idx] : kBitratesV2L3[bitrate_idx];
+        h.samples = vi == 0 ? 1152 : 576;
+        int coeff = vi == 0 ? 144 : 72;
+        h.length = coeff * h.bitrate_kbps * 1000 / h.sample_rate + padding;
+        if (vi == 0)
+            h.side_info = h.channels == 1 ? 17 : 32;
+        else
+            h.side_info = h.channels == 1 ? 9 : 17;
+        return true;
+    }
+
+    // Bytes taken by an ID3v2 tag at p (10-byte header, syncsafe size, optional footer); 0 if none
+    static int64_t id3v2_length(const uint8_t *p, size_t avail)
+    {
+        if (avail < 10 || memcmp(p, "ID3", 3) != 0)
+            return 0;
+        int64_t tag_size = (int64_t(p[6] & 0x7f) << 21) | (int64_t(p[7] & 0x7f) << 14) |
+                           (int64_t(p[8] & 0x7f) << 7) | int64_t(p[9] & 0x7f);
+        return 10 + tag_size + ((p[5] & 0x10) ? 10 : 0);
+    }
+
+    // Xing/Info tag frame (LAME's header frame, which decoders drop)
+    static bool is_info_frame(const uint8_t *frame, size_t avail, const FrameHeader &h)
+    {
+        size_t xing = 4 + static_cast<size_t>(h.side_info);
+        return avail >= xing + 4 && (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0);
+    }
+
+    static bool read_at(int fd, int64_t offset, std::vector<uint8_t> &buf, size_t len)
+    {
+        buf.resize(len);
+        ssize_t n = pread(fd, buf.data(), len, offset);
+        if (n < 0)
+            return false;
+        buf.resize(static_cast<size_t>(n));
+        return true;
+    }
+
+    // Frame header at file offset `at`, from buf (read at buf_offset) when it holds it
+    static bool header_at(int fd, const std::vector<uint8_t> &buf, int64_t buf_offset, int64_t at, FrameHeader &h)
+    {
+        uint8_t bytes[4];
+        const uint8_t *p = bytes;
+        if (at >= buf_offset && at - buf_offset + 4 <= static_cast<int64_t>(buf.size()))
+            p = &buf[static_cast<size_t>(at - buf_offset)];
+        else if (pread(fd, bytes, sizeof(bytes), at) != static_cast<ssize_t>(sizeof(bytes)))
+            return false;
+        return parse_frame_header(p, h);
+    }
+
+    // True if `first` at `at` is followed by frames of the same stream: kConfirmFrames in
+    // all, or at least two that end exactly at the end of the file. Reads past buf as needed.
+    static bool confirm_frames(int fd, const std::vector<uint8_t> &buf, int64_t buf_offset, int64_t file_size,
+                               int64_t at, const FrameHeader &first)
+    {
+        int64_t next = at + first.length;
+        for (int n = 1; n < kConfirmFrames; ++n)
+        {
+            if (next == file_size)
+                return n >= 2;
+            FrameHeader h;
+            if (!header_at(fd, buf, buf_offset, next, h) || h.version != first.version ||
+                h.sample_rate != first.sample_rate || h.channels != first.channels)
+                return false;
+            next += h.length;
+        }
+        return true;
+    }
+
+    bool probe_mp3_file(const std::string &path, Mp3StreamInfo &info, std::string &error_out)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            error_out = "open failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            error_out = "fstat failed: " + std::string(strerror(errno));
+            close(fd);
+            return false;
+        }
+
+        // Skip an ID3v2 tag if present
+        std::vector<uint8_t> buf;
+        if (!read_at(fd, 0, buf, 10))
+        {
+            error_out = "read failed";
+            close(fd);
+            return false;
+        }
+        int64_t offset = id3v2_length(buf.data(), buf.size());
+
+        if (!read_at(fd, offset, buf, kSyncSearchBytes))
+        {
+            error_out = "read failed";
+            close(fd);
+            return false;
+        }
+
+        // First sync that starts a confirmed run of frames
+        FrameHeader first;
+        size_t pos = 0;
+        bool found = false;
+        for (; pos + 4 <= buf.size(); ++pos)
+        {
+            if (buf[pos] != 0xFF || !parse_frame_header(&buf[pos], first))
+                continue;
+            if (confirm_frames(fd, buf, offset, static_cast<int64_t>(st.st_size), offset + static_cast<int64_t>(pos),
+                               first))
+            {
+                found = true;
+                break;
+            }
+        }
+        close(fd);
+        if (!found)
+        {
+            error_out = "no MPEG Layer III frame found";
+            return false;
+        }
+
+        info = Mp3StreamInfo{};
+        info.mpeg_version = first.version;
+        info.sample_rate = first.sample_rate;
+        info.channels = first.channels;
+        info.bitrate_kbps = first.bitrate_kbps;
+        info.samples_per_frame = first.samples;
+        info.audio_offset = offset + static_cast<int64_t>(pos);
+
+        // Xing/Info tag sits after the side info; VBRI at a fixed offset of 32 bytes
+        const uint8_t *frame = &buf[pos];
+        size_t avail = buf.size() - pos;
+        size_t xing = 4 + static_cast<size_t>(first.side_info);
+        if (avail >= xing + 12 && (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0))
+        {
+            uint32_t flags = read_be32(frame + xing + 4);
+            if (flags & 1)
+                info.frame_count = read_be32(frame + xing + 8);
+            info.vbr_tag = memcmp(frame + xing, "Xing", 4) == 0;
+        }
+        else if (avail >= 4 + 32 + 18 && memcmp(frame + 36, "VBRI", 4) == 0)
+        {
+            info.frame_count = read_be32(frame + 36 + 14);
+            info.vbr_tag = true;
+        }
+
+        int64_t audio_bytes = static_cast<int64_t>(st.st_size) - info.audio_offset;
+        if (info.frame_count > 0)
+        {
+            info.duration_seconds = double(info.frame_count) * info.samples_per_frame / info.sample_rate;
+            if (info.duration_seconds > 0)
+                info.bitrate_kbps = static_cast<int>(audio_bytes * 8 / info.duration_seconds / 1000);
+        }
+        else if (info.bitrate_kbps > 0 && audio_bytes > 0)
+        {
+            // CBR estimate
+            info.duration_seconds = double(audio_bytes) * 8.0 / (info.bitrate_kbps * 1000.0);
+        }
+        return true;
+    }
+
+    bool is_passthrough_compatible(const Mp3StreamInfo &info)
+    {
+        return info.mpeg_version == 1 && info.sample_rate == 44100 && info.channels == 2;
+    }
+
+    std::vector<Mp3Piece> split_mp3_frames(const std::string &data, size_t piece_bytes)
+    {
+        std::vector<Mp3Piece> pieces;
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(data.data());
+        const size_t size = data.size();
+        size_t pos = static_cast<size_t>(std::min<int64_t>(id3v2_length(p, size), static_cast<int64_t>(size)));
+
+        // Times come from the running sample count, so rounding doesn't accumulate
+        int sample_rate = 0;
+        int64_t samples = 0;
+        auto time_us = [&]()
+        { return sample_rate > 0 ? samples * 1000000 / sample_rate : 0; };
+
+        Mp3Piece piece;
+        bool first_frame = true;
+        while (pos + 4 <= size)
+        {
+            FrameHeader h;
+            if (!parse_frame_header(p + pos, h) || pos + static_cast<size_t>(h.length) > size ||
+                (sample_rate && h.sample_rate != sample_rate))
+                break;
+            sample_rate = h.sample_rate;
+            if (!(first_frame && is_info_frame(p + pos, size - pos, h)))
+                samples += h.samples;
+            first_frame = false;
+            pos += static_cast<size_t>(h.length);
+
+            if (pos - piece.offset >= piece_bytes)
+            {
+                piece.size = pos - piece.offset;
+                piece.duration_us = time_us() - piece.start_us;
+                pieces.push_back(piece);
+                piece = Mp3Piece{pos, 0, time_us(), 0};
+            }
+        }
+        if (sample_rate == 0)
+            return {};
+
+        if (piece.offset < size)
+        {
+            piece.size = size - piece.offset;
+            piece.duration_us = time_us() - piece.start_us;
+            if (piece.duration_us == 0 && !pieces.empty())
+                pieces.back().size += piece.size; // trailing tag or junk: no audio of its own
+            else
+                pieces.push_back(piece);
+        }
+        return pieces;
+    }
+
+    // ============================================================================
+    // Mp3FrameReader
+    // ============================================================================
+
+    Mp3FrameReader::~Mp3FrameReader()
+    {
+        close();
+    }
+
+    size_t Mp3FrameReader::buffer_bytes(size_t min_bytes)
+    {
+        // Whole pages, and one more so the frame that crosses min_bytes fits (frames are < 1.5 KiB)
+        return ((min_bytes + 4095) & ~size_t(4095)) + 4096;
+    }
+
+    bool Mp3FrameReader::open(const std::string &path, const Mp3StreamInfo &info, std::string &error_out)
+    {
+        close();
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0)
+        {
+            error_out = "open failed: " + std::string(strerror(errno));
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0)
+        {
+            error_out = "fstat failed: " + std::string(strerror(errno));
+            close();
+            return false;
+        }
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        file_size_ = static_cast<int64_t>(st.st_size);
+        offset_ = 0;
+        audio_offset_ = info.audio_offset;
+        sample_rate_ = info.sample_rate;
+        samples_ = 0;
+        return true;
+    }
+
+    void Mp3FrameReader::close()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    // Times come from the running sample count, so rounding doesn't accumulate
+    int64_t Mp3FrameReader::time_us() const
+    {
+        return sample_rate_ > 0 ? samples_ * 1000000 / sample_rate_ : 0;
+    }
+
+    Mp3FrameReader::Result Mp3FrameReader::read(std::string &chunk, size_t min_bytes, int64_t &duration_us,
+                                                std::string &error_out)
+    {
+        const size_t want = buffer_bytes(min_bytes);
+        chunk.resize(want);
+        ssize_t n;
+        do
+        {
+            n = pread(fd_, chunk.data(), want, offset_);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+        {
+            error_out = "read failed: " + std::string(strerror(errno));
+            return Result::FAILED;
+        }
+        if (n == 0)
+        {
+            chunk.clear();
+            return Result::END;
+        }
+
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(chunk.data());
+        const size_t avail = static_cast<size_t>(n);
+        const bool at_eof = offset_ + n >= file_size_;
+        const int64_t start_us = time_us();
+
+        // The ID3v2 tag before the first frame rides along untimed
+        size_t pos = static_cast<size_t>(std::clamp<int64_t>(audio_offset_ - offset_, 0, n));
+        while (pos < avail && pos < min_bytes)
+        {
+            // A header or frame cut off by the read starts the next chunk; at the end of
+            // the file it is a truncated last frame, sent untimed
+            if (pos + 4 > avail)
+            {
+                if (at_eof)
+                    pos = avail;
+                break;
+            }
+            FrameHeader h;
+            if (!parse_frame_header(p + pos, h) || h.sample_rate != sample_rate_)
+            {
+                // Not a frame of this stream (a tag, junk): sent untimed while we resync
+                ++pos;
+                continue;
+            }
+            if (pos + static_cast<size_t>(h.length) > avail)
+            {
+                if (at_eof)
+                    pos = avail;
+                break;
+            }
+            if (!(offset_ + static_cast<int64_t>(pos) == audio_offset_ && is_info_frame(p + pos, avail - pos, h)))
+                samples_ += h.samples;
+            pos += static_cast<size_t>(h.length);
+        }
+        // Not even one whole frame fits (can't happen for real frames): take the read as is
+        if (pos == 0)
+            pos = avail;
+
+        chunk.resize(pos);
+        offset_ += static_cast<int64_t>(pos);
+        duration_us = time_us() - start_us;
+        return Result::CHUNK;
+    }
+
+}
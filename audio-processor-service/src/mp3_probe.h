@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace soundboard
+{
+
+    /**
+     * Stream parameters read from an MP3 file's first frame header (after any
+     * ID3v2 tag), plus the Xing/Info/VBRI frame count when present.
+     */
+    struct Mp3StreamInfo
+    {
+        int mpeg_version = 0;     // 1, 2, or 25 (MPEG-2.5)
+        int sample_rate = 0;
+        int channels = 0;
+        int bitrate_kbps = 0;     // first frame's bitrate (average when VBR tag present)
+        int samples_per_frame = 0;
+        int64_t audio_offset = 0; // byte offset of the first frame
+        int64_t frame_count = 0;  // from VBR/Info tag, 0 if absent
+        double duration_seconds = 0.0;
+        bool vbr_tag = false;
+    };
+
+    /**
+     * Header-only MP3 probe: reads a few KiB, never decodes audio.
+     * Only MPEG audio Layer III is recognised. A frame sync counts only when the
+     * frames after it (three in all, or two that end the file) are consistent
+     * Layer III frames, so other containers whose bytes happen to look like one
+     * header are not taken for MP3.
+     *
+     * @param path Path to the file
+     * @param info Filled in on success
+     * @param error_out Reason on failure (not an MP3, I/O error)
+     * @return true if the file starts with a run of valid Layer III frames
+     */
+    bool probe_mp3_file(const std::string &path, Mp3StreamInfo &info, std::string &error_out);
+
+    /**
+     * True if the stream already matches what the service emits (MPEG-1 Layer III,
+     * 44.1 kHz, stereo), so its bytes can be sent to clients unchanged.
+     */
+    bool is_passthrough_compatible(const Mp3StreamInfo &info);
+
+    /**
+     * A run of whole MP3 frames within a buffer and the audio it holds.
+     */
+    struct Mp3Piece
+    {
+        size_t offset = 0;
+        size_t size = 0;
+        int64_t start_us = 0;
+        int64_t duration_us = 0; // frames x samples per frame / sample rate
+    };
+
+    /**
+     * Split an MP3 stream held in memory into pieces of at least piece_bytes
+     * (the last may be shorter) that end on frame boundaries, timed from the
+     * frame headers alone. A leading ID3v2 tag rides in the first piece, a
+     * Xing/Info frame counts as no audio, and anything after the last valid
+     * frame (e.g. an ID3v1 tag) rides in the last piece.
+     *
+     * @return the pieces covering all of data, or none if it has no Layer III frames
+     */
+    std::vector<Mp3Piece> split_mp3_frames(const std::string &data, size_t piece_bytes);
+
+    /**
+     * Reads an MP3 file as chunks of whole frames, for passthrough streaming: each
+     * chunk is one pread of whole pages, cut back to the last frame boundary past the
+     * size asked for, and the cut-off bytes start the next chunk. As with
+     * split_mp3_frames, durations come from the frame headers: a leading ID3v2 tag and
+     * a Xing/Info frame count as no audio, and bytes that aren't frames (an ID3v1 or
+     * APE tag at the end) ride along in the chunk they fall in, untimed.
+     */
+    class Mp3FrameReader
+    {
+    public:
+        enum class Result
+        {
+            CHUNK, // chunk holds the next run of bytes
+            END,   // the whole file has been read
+            FAILED // read error (error_out says why)
+        };
+
+        Mp3FrameReader() = default;
+        ~Mp3FrameReader();
+
+        Mp3FrameReader(const Mp3FrameReader &) = delete;
+        Mp3FrameReader &operator=(const Mp3FrameReader &) = delete;
+
+        // Bytes one read() may fill for chunks of at least min_bytes; reserve this much
+        static size_t buffer_bytes(size_t min_bytes);
+
+        /**
+         * Open path for reading from its start; info is its probe result.
+         * @return false on failure (error_out says why)
+         */
+        bool open(const std::string &path, const Mp3StreamInfo &info, std::string &error_out);
+        void close();
+        bool is_open() const { return fd_ >= 0; }
+
+        /**
+         * Fill chunk (resized, never reallocated if it has buffer_bytes(min_bytes)
+         * reserved) with at least min_bytes ending on a frame boundary; the last chunk
+         * of the file may be shorter.
+         * @param duration_us Set on CHUNK: audio time in the chunk
+         */
+        Result read(std::string &chunk, size_t min_bytes, int64_t &duration_us, std::string &error_out);
+
+    private:
+        int64_t time_us() const;
+
+        int fd_ = -1;
+        int64_t file_size_ = 0;
+        int64_t offset_ = 0;       // start of the next chunk
+        int64_t audio_offset_ = 0; // first frame (after any ID3v2 tag)
+        int sample_rate_ = 0;
+        int64_t samples_ = 0;      // audio samples in the chunks read so far
+    };
+
+}
@@ -0,0 +1,284 @@
+#include "native_stretch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "dsp_kernels.h"
+
+namespace soundboard
+{
+
+    // Resampler: taps per output sample and fractional positions per input sample
+    static constexpr int kTaps = 16;
+    static constexpr int kPhases = 128;
+    static constexpr int kTapsBefore = kTaps / 2 - 1; // taps left of the interpolated position
+
+    // Coarse step of the WSOLA offset search; the best coarse offset is refined +-(step - 1)
+    static constexpr int kSearchStep = 4;
+
+    // Erase consumed samples from the front of a buffer once this many have piled up
+    static constexpr int64_t kCompactSamples = 4096;
+
+    static constexpr double kPi = 3.14159265358979323846;
+
+    NativeStretch::NativeStretch(int sample_rate, int channels, double tempo, double pitch, bool low_latency)
+        : channels_(channels), tempo_(tempo), pitch_(pitch),
+          stretch_(std::abs(tempo / pitch - 1.0) > 1e-6), resample_(std::abs(pitch - 1.0) > 1e-6)
+    {
+        in_.resize(channels);
+        tail_.resize(channels);
+        mid_.resize(channels);
+        out_.resize(channels);
+
+        // ~40ms segments, searched +-12ms (low latency: 25ms, +-8ms)
+        seg_ = std::max(64, static_cast<int>(sample_rate * (low_latency ? 0.025 : 0.040)) & ~1);
+        hop_ = seg_ / 2;
+        search_ = std::max(kSearchStep * 2, static_cast<int>(sample_rate * (low_latency ? 0.008 : 0.012)));
+        // Stretch by pitch as well, so resampling by pitch lands back at input / tempo
+        analysis_hop_ = hop_ * tempo / pitch;
+
+        // Periodic Hann: halves overlapped at hop_ sum to exactly 1
+        window_.resize(seg_);
+        for (int i = 0; i < seg_; ++i)
+            window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * kPi * i / seg_));
+        for (auto &t : tail_)
+            t.assign(hop_, 0.0f);
+
+        if (resample_)
+        {
+            // Windowed-sinc low-pass at 95% of the lower Nyquist, one normalized row per phase
+            const double cutoff = 0.95 * std::min(1.0, 1.0 / pitch);
+            filter_.resize(static_cast<size_t>(kPhases) * kTaps);
+            for (int p = 0; p < kPhases; ++p)
+            {
+                float *row = &filter_[static_cast<size_t>(p) * kTaps];
+                double sum = 0.0;
+                for (int j = 0; j < kTaps; ++j)
+                {
+                    double t = (j - kTapsBefore) - double(p) / kPhases;
+                    double x = cutoff * t;
+                    double sinc = x == 0.0 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+                    double w = t / (kTaps / 2);
+                    double blackman = 0.42 + 0.5 * std::cos(kPi * w) + 0.08 * std::cos(2.0 * kPi * w);
+                    row[j] = static_cast<float>(sinc * blackman);
+                    sum += row[j];
+                }
+                for (int j = 0; j < kTaps; ++j)
+                    row[j] = static_cast<float>(row[j] / sum);
+            }
+
+            // Silence before the first sample, so position 0 has its left taps
+            mid_origin_ = -kTapsBefore;
+            for (auto &m : mid_)
+                m.assign(kTapsBefore, 0.0f);
+        }
+    }
+
+    void NativeStretch::push(const float *const *planes, int nb_samples)
+    {
+        if (finished_ || nb_samples <= 0)
+            return;
+        total_in_ += nb_samples;
+        size_t before = out_[0].size();
+        append_input(planes, nb_samples);
+        process();
+        produced_ += static_cast<int64_t>(out_[0].size() - before);
+    }
+
+    void NativeStretch::finish()
+    {
+        if (finished_)
+            return;
+        finished_ = true;
+
+        // Feed silence until the output covers the input, then cut it to length
+        const int64_t target = std::llround(double(total_in_) / tempo_);
+        const int block = seg_ + 2 * search_ + kTaps;
+        std::vector<float> zeros(block, 0.0f);
+        std::vector<const float *> planes(channels_, zeros.data());
+        for (int i = 0; i < 64 && produced_ < target; ++i)
+        {
+            size_t before = out_[0].size();
+            append_input(planes.data(), block);
+            process();
+            produced_ += static_cast<int64_t>(out_[0].size() - before);
+        }
+
+        int64_t excess = std::min<int64_t>(produced_ - target, available());
+        if (excess > 0)
+        {
+            for (auto &o : out_)
+                o.resize(o.size() - static_cast<size_t>(excess));
+            produced_ -= excess;
+        }
+    }
+
+    int NativeStretch::pull(float *const *planes, int max)
+    {
+        int n = std::min(max, available());
+        if (n <= 0)
+            return 0;
+        for (int ch = 0; ch < channels_; ++ch)
+            std::memcpy(planes[ch], out_[ch].data() + out_read_, sizeof(float) * n);
+        out_read_ += n;
+
+        if (out_read_ == out_[0].size())
+        {
+            for (auto &o : out_)
+                o.clear();
+            out_read_ = 0;
+        }
+        else if (out_read_ >= static_cast<size_t>(kCompactSamples))
+        {
+            for (auto &o : out_)
+                o.erase(o.begin(), o.begin() + static_cast<std::ptrdiff_t>(out_read_));
+            out_read_ = 0;
+        }
+        return n;
+    }
+
+    void NativeStretch::append_input(const float *const *planes, int nb_samples)
+    {
+        if (!stretch_)
+        {
+            // Pitch and tempo equal: a plain resample (or a copy)
+            auto &dst = resample_ ? mid_ : out_;
+            for (int ch = 0; ch < channels_; ++ch)
+                dst[ch].insert(dst[ch].end(), planes[ch], planes[ch] + nb_samples);
+            return;
+        }
+
+        for (int ch = 0; ch < channels_; ++ch)
+            in_[ch].insert(in_[ch].end(), planes[ch], planes[ch] + nb_samples);
+
+        // Offsets are chosen once for all channels, on their sum
+        size_t at = mono_.size();
+        mono_.insert(mono_.end(), planes[0], planes[0] + nb_samples);
+        for (int ch = 1; ch < channels_; ++ch)
+            for (int i = 0; i < nb_samples; ++i)
+                mono_[at + i] += planes[ch][i];
+    }
+
+    void NativeStretch::process()
+    {
+        if (stretch_)
+            run_wsola();
+        if (resample_)
+            run_resampler();
+    }
+
+    void NativeStretch::run_wsola()
+    {
+        auto &dst = resample_ ? mid_ : out_;
+        const int64_t in_end = in_origin_ + static_cast<int64_t>(mono_.size());
+        for (;;)
+        {
+            const int64_t nominal = std::llround(next_nominal_);
+            if (nominal + search_ + seg_ > in_end)
+                break;
+            int64_t pos = prev_pos_ < 0 ? nominal
+                                        : best_offset(nominal, std::max(nominal - search_, in_origin_), nominal + search_);
+            overlap_add(pos, dst);
+            prev_pos_ = pos;
+            next_nominal_ += analysis_hop_;
+        }
+
+        // Keep what the next search window and the continuation template still need
+        int64_t keep_from = std::min<int64_t>(std::llround(next_nominal_) - search_, prev_pos_ + hop_);
+        int64_t drop = keep_from - in_origin_;
+        if (drop >= kCompactSamples)
+        {
+            for (auto &in : in_)
+                in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(drop));
+            mono_.erase(mono_.begin(), mono_.begin() + static_cast<std::ptrdiff_t>(drop));
+            in_origin_ += drop;
+        }
+    }
+
+    // Offset in [lo, hi] whose first half-segment best matches the natural continuation
+    // of the previous segment, which is what the overlap-add will blend it with
+    int64_t NativeStretch::best_offset(int64_t nominal, int64_t lo, int64_t hi) const
+    {
+        const DspKernels &k = dsp_kernels();
+        const float *tmpl = &mono_[static_cast<size_t>(prev_pos_ + hop_ - in_origin_)];
+        auto score = [&](int64_t pos)
+        {
+            const float *cand = &mono_[static_cast<size_t>(pos - in_origin_)];
+            float corr = k.dot(tmpl, cand, hop_);
+            float energy = k.dot(cand, cand, hop_);
+            return corr / std::sqrt(energy + 1e-6f);
+        };
+
+        // Ties (e.g. silence) keep the nominal position
+        int64_t best = std::clamp(nominal, lo, hi);
+        float best_score = score(best);
+        for (int64_t pos = lo; pos <= hi; pos += kSearchStep)
+        {
+            float s = score(pos);
+            if (s > best_score)
+            {
+                best_score = s;
+                best = pos;
+            }
+        }
+        const int64_t coarse = best;
+        for (int64_t pos = std::max(lo, coarse - (kSearchStep - 1)); pos <= std::min(hi, coarse + (kSearchStep - 1)); ++pos)
+        {
+            float s = score(pos);
+            if (s > best_score)
+            {
+                best_score = s;
+                best = pos;
+            }
+        }
+        return best;
+    }
+
+    // Emit one output hop: the previous segment's windowed tail plus the first half of
+    // the segment at pos; the second half becomes the new tail
+    void NativeStretch::overlap_add(int64_t pos, std::vector<std::vector<float>> &dst)
+    {
+        const DspKernels &k = dsp_kernels();
+        for (int ch = 0; ch < channels_; ++ch)
+        {
+            const float *src = &in_[ch][static_cast<size_t>(pos - in_origin_)];
+            float *tail = tail_[ch].data();
+            auto &d = dst[ch];
+            size_t at = d.size();
+            d.insert(d.end(), tail, tail + hop_);
+            k.window_add(d.data() + at, src, window_.data(), hop_);
+            k.window(tail, src + hop_, window_.data() + hop_, hop_);
+        }
+    }
+
+    void NativeStretch::run_resampler()
+    {
+        const DspKernels &k = dsp_kernels();
+        const int64_t mid_end = mid_origin_ + static_cast<int64_t>(mid_[0].size());
+        for (;;)
+        {
+            int64_t i = static_cast<int64_t>(std::floor(rs_pos_));
+            int phase = static_cast<int>(std::lround((rs_pos_ - i) * kPhases));
+            if (phase == kPhases)
+            {
+                phase = 0;
+                ++i;
+            }
+            const int64_t first = i - kTapsBefore;
+            if (first + kTaps > mid_end)
+                break;
+            const float *h = &filter_[static_cast<size_t>(phase) * kTaps];
+            for (int ch = 0; ch < channels_; ++ch)
+                out_[ch].push_back(k.dot(&mid_[ch][static_cast<size_t>(first - mid_origin_)], h, kTaps));
+            rs_pos_ += pitch_;
+        }
+
+        int64_t drop = static_cast<int64_t>(std::floor(rs_pos_)) - kTapsBefore - mid_origin_;
+        if (drop >= kCompactSamples)
+        {
+            for (auto &m : mid_)
+                m.erase(m.begin(), m.begin() + static_cast<std::ptrdiff_t>(drop));
+            mid_origin_ += drop;
+        }
+    }
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace soundboard
+{
+
+    /**
+     * Built-in tempo/pitch engine for planar float audio, so effects don't depend on
+     * librubberband being compiled into FFmpeg.
+     *
+     * Time-stretching is WSOLA: Hann-windowed segments are overlap-added at a fixed
+     * output hop, each taken from near its nominal input position at the offset that
+     * best continues the previous one (normalized cross-correlation on a mono mix).
+     * Pitch is shifted by stretching by the pitch factor and resampling back with a
+     * windowed-sinc polyphase filter, so duration is input / tempo either way. The
+     * inner loops run on dsp_kernels() (AVX2/NEON where available).
+     *
+     * Not thread-safe; one instance per stream. After warm-up, push()/pull() reuse
+     * their buffers and don't allocate.
+     */
+    class NativeStretch
+    {
+    public:
+        /**
+         * @param tempo Speed factor (1.5 = 1.5x faster, output is 1/1.5 as long)
+         * @param pitch Pitch factor (1.0 = unchanged)
+         * @param low_latency Shorter segments and search range: less look-ahead before
+         *        the first output, slightly rougher on sustained tonal material
+         */
+        NativeStretch(int sample_rate, int channels, double tempo, double pitch, bool low_latency = false);
+
+        // Append nb_samples per channel of input
+        void push(const float *const *planes, int nb_samples);
+
+        // End of input: everything left becomes available, trimmed to input length / tempo
+        void finish();
+
+        // Samples per channel ready for pull()
+        int available() const { return static_cast<int>(out_[0].size() - out_read_); }
+
+        // Copy up to max samples per channel into planes; returns how many were copied
+        int pull(float *const *planes, int max);
+
+        int channels() const { return channels_; }
+
+    private:
+        void append_input(const float *const *planes, int nb_samples);
+        void process();
+        void run_wsola();
+        void run_resampler();
+        int64_t best_offset(int64_t nominal, int64_t lo, int64_t hi) const;
+        void overlap_add(int64_t pos, std::vector<std::vector<float>> &dst);
+
+        int channels_;
+        double tempo_;
+        double pitch_;
+        bool stretch_;  // WSOLA stage active (tempo != pitch)
+        bool resample_; // resampler stage active (pitch != 1)
+
+        // WSOLA: segment length, output hop (half a segment), search radius, input hop
+        int seg_ = 0;
+        int hop_ = 0;
+        int search_ = 0;
+        double analysis_hop_ = 0.0;
+        std::vector<float> window_;
+
+        // Input (absolute sample index of element 0 is in_origin_), plus its mono mix
+        std::vector<std::vector<float>> in_;
+        std::vector<float> mono_;
+        int64_t in_origin_ = 0;
+        double next_nominal_ = 0.0; // nominal input position of the next segment
+        int64_t prev_pos_ = -1;     // where the previous segment was actually taken from
+        std::vector<std::vector<float>> tail_; // windowed second half of the previous segment
+
+        // Stretched audio waiting for the resampler (index of element 0 is mid_origin_)
+        std::vector<std::vector<float>> mid_;
+        int64_t mid_origin_ = 0;
+        double rs_pos_ = 0.0;
+        std::vector<float> filter_; // kPhases x kTaps coefficients
+
+        // Output ready to pull
+        std::vector<std::vector<float>> out_;
+        size_t out_read_ = 0;
+
+        int64_t total_in_ = 0;
+        int64_t produced_ = 0; // samples ever appended to out_
+        bool finished_ = false;
+    };
+
+}
@@ -0,0 +1,293 @@
+#include "pcm_cache.h"
+#include <algorithm>
+#include "audio_input.h"
+#include "av_error.h"
+#include "log.h"
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/buffer.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+namespace soundboard
+{
+
+    // Zeroed floats after each plane's last sample, for SIMD code that reads a little past the end
+    static constexpr int kPlanePadSamples = 64;
+
+    // Distinct clips whose misses are counted towards admission before the counts reset
+    static constexpr size_t kMaxTrackedMisses = 4096;
+
+    // Clips remembered as not cacheable (too large, undecodable) before the set resets
+    static constexpr size_t kMaxRejected = 4096;
+
+    // ============================================================================
+    // DecodedClip
+    // ============================================================================
+
+    DecodedClip::~DecodedClip()
+    {
+        for (AVBufferRef *&plane : planes_)
+            av_buffer_unref(&plane);
+    }
+
+    static void free_plane(void *opaque, uint8_t *)
+    {
+        delete static_cast<std::vector<float> *>(opaque);
+    }
+
+    std::shared_ptr<const DecodedClip> DecodedClip::decode(const std::string &path, size_t max_bytes,
+                                                           std::string &error_out)
+    {
+        AudioInput input;
+        if (!open_audio_input(path, AudioInputOptions{}, input, error_out))
+            return nullptr;
+
+        AVCodecContext *dec_ctx = input.dec_ctx;
+        const int channels = dec_ctx->channels;
+        if (channels <= 0 || channels > AV_NUM_DATA_POINTERS)
+        {
+            error_out = "unsupported channel count " + std::to_string(channels);
+            close_audio_input(input);
+            return nullptr;
+        }
+        const uint64_t layout = dec_ctx->channel_layout ? dec_ctx->channel_layout
+                                                        : av_get_default_channel_layout(channels);
+
+        SwrContext *swr = swr_alloc_set_opts(nullptr, static_cast<int64_t>(layout), AV_SAMPLE_FMT_FLTP, kSampleRate,
+                                             static_cast<int64_t>(layout), dec_ctx->sample_fmt, dec_ctx->sample_rate,
+                                             0, nullptr);
+        if (!swr || swr_init(swr) < 0)
+        {
+            error_out = "failed to init resampler";
+            swr_free(&swr);
+            close_audio_input(input);
+            return nullptr;
+        }
+
+        // Planes grow while decoding, sized up front from the container's duration when known
+        std::vector<std::unique_ptr<std::vector<float>>> planes;
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            planes.push_back(std::make_unique<std::vector<float>>());
+            if (input.fmt->duration > 0)
+                planes.back()->reserve(static_cast<size_t>(input.fmt->duration * kSampleRate / AV_TIME_BASE) + 4096);
+        }
+
+        // Resample one decoded frame (nullptr flushes) onto the end of the planes
+        auto convert = [&](const AVFrame *frame) -> bool
+        {
+            int in_count = frame ? frame->nb_samples : 0;
+            int max_out = swr_get_out_samples(swr, in_count);
+            if (max_out <= 0)
+                return true;
+
+            size_t at = planes[0]->size();
+            uint8_t *out[AV_NUM_DATA_POINTERS] = {};
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                planes[ch]->resize(at + max_out);
+                out[ch] = reinterpret_cast<uint8_t *>(planes[ch]->data() + at);
+            }
+            int n = swr_convert(swr, out, max_out, frame ? const_cast<const uint8_t **>(frame->extended_data) : nullptr,
+                                in_count);
+            if (n < 0)
+            {
+                error_out = "swr_convert: " + av_err_to_string(n);
+                return false;
+            }
+            for (int ch = 0; ch < channels; ++ch)
+                planes[ch]->resize(at + n);
+
+            if (max_bytes > 0 && (at + n) * channels * sizeof(float) > max_bytes)
+            {
+                error_out = "decoded size exceeds " + std::to_string(max_bytes) + " bytes";
+                return false;
+            }
+            return true;
+        };
+
+        AVPacket *pkt = av_packet_alloc();
+        AVFrame *frame = av_frame_alloc();
+        bool ok = pkt && frame;
+        if (!ok)
+            error_out = "failed to alloc packet/frame";
+        while (ok && av_read_frame(input.fmt, pkt) >= 0)
+        {
+            if (pkt->stream_index == input.stream_index && avcodec_send_packet(dec_ctx, pkt) >= 0)
+            {
+                while (ok && avcodec_receive_frame(dec_ctx, frame) == 0)
+                {
+                    ok = convert(frame);
+                    av_frame_unref(frame);
+                }
+            }
+            av_packet_unref(pkt);
+        }
+        if (ok)
+        {
+            avcodec_send_packet(dec_ctx, nullptr);
+            while (ok && avcodec_receive_frame(dec_ctx, frame) == 0)
+            {
+                ok = convert(frame);
+                av_frame_unref(frame);
+            }
+        }
+        if (ok)
+            ok = convert(nullptr);
+        av_frame_free(&frame);
+        av_packet_free(&pkt);
+        swr_free(&swr);
+        close_audio_input(input);
+
+        if (ok && planes[0]->empty())
+        {
+            error_out = "no audio decoded";
+            ok = false;
+        }
+        if (!ok)
+            return nullptr;
+
+        std::shared_ptr<DecodedClip> clip(new DecodedClip());
+        clip->channel_layout_ = layout;
+        clip->samples_ = static_cast<int64_t>(planes[0]->size());
+        for (auto &plane : planes)
+        {
+            plane->resize(plane->size() + kPlanePadSamples, 0.0f);
+            plane->shrink_to_fit();
+            AVBufferRef *buf = av_buffer_create(reinterpret_cast<uint8_t *>(plane->data()),
+                                                static_cast<int>(plane->size() * sizeof(float)),
+                                                free_plane, plane.get(), AV_BUFFER_FLAG_READONLY);
+            if (!buf)
+            {
+                error_out = "failed to wrap decoded plane";
+                return nullptr;
+            }
+            plane.release(); // owned by buf now
+            clip->planes_.push_back(buf);
+        }
+        return clip;
+    }
+
+    bool DecodedClip::frame(size_t index, AVFrame *out) const
+    {
+        const int64_t start = static_cast<int64_t>(index) * kFrameSamples;
+        if (start >= samples_)
+            return false;
+
+        out->nb_samples = static_cast<int>(std::min<int64_t>(kFrameSamples, samples_ - start));
+        out->format = AV_SAMPLE_FMT_FLTP;
+        out->sample_rate = kSampleRate;
+        out->channel_layout = channel_layout_;
+        out->channels = channels();
+        out->linesize[0] = out->nb_samples * static_cast<int>(sizeof(float));
+        for (size_t ch = 0; ch < planes_.size(); ++ch)
+        {
+            out->buf[ch] = av_buffer_ref(planes_[ch]);
+            if (!out->buf[ch])
+            {
+                av_frame_unref(out);
+                return false;
+            }
+            out->data[ch] = planes_[ch]->data + start * sizeof(float);
+        }
+        out->extended_data = out->data;
+        return true;
+    }
+
+    // ============================================================================
+    // PcmCache
+    // ============================================================================
+
+    PcmCache::PcmCache(const Options &options, Schedule schedule)
+        : options_(options), schedule_(std::move(schedule)) {}
+
+    std::shared_ptr<const DecodedClip> PcmCache::lookup(const std::string &path)
+    {
+        PcmKey key;
+        if (!enabled() || !PcmKey::of(path, key))
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = entries_.find(key);
+        if (it != entries_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+            ++stats_.hits;
+            return it->second.clip;
+        }
+
+        ++stats_.misses;
+        if (loading_.count(key) || rejected_.count(key))
+            return nullptr;
+        if (misses_by_key_.size() >= kMaxTrackedMisses && !misses_by_key_.count(key))
+            misses_by_key_.clear();
+        if (++misses_by_key_[key] < options_.admit_after)
+            return nullptr;
+
+        misses_by_key_.erase(key);
+        loading_.insert(key);
+        schedule_([this, key, path]()
+                  { load(key, path); });
+        return nullptr;
+    }
+
+    void PcmCache::load(const PcmKey &key, const std::string &path)
+    {
+        std::string err;
+        std::shared_ptr<const DecodedClip> clip = DecodedClip::decode(path, options_.max_clip_bytes, err);
+
+        // The file may have been replaced between PcmKey::of and the decode
+        PcmKey decoded_key;
+        const bool unchanged = PcmKey::of(path, decoded_key) && decoded_key == key;
+
+        std::lock_guard<std::mutex> lock(mu_);
+        loading_.erase(key);
+        if (!unchanged)
+        {
+            LOG_DEBUG("pcm_cache.load_skipped").kv("path", path).kv("error", "file changed while decoding");
+            return;
+        }
+        if (!clip || clip->bytes() > options_.memory_bytes)
+        {
+            // Won't get better for this version of the file: don't decode it again
+            ++stats_.load_failures;
+            if (rejected_.size() >= kMaxRejected)
+                rejected_.clear();
+            rejected_.insert(key);
+            LOG_DEBUG("pcm_cache.load_skipped").kv("path", path).kv("error", clip ? "larger than cache" : err);
+            return;
+        }
+
+        while (bytes_ + clip->bytes() > options_.memory_bytes && !lru_.empty())
+        {
+            auto victim = entries_.find(lru_.back());
+            bytes_ -= victim->second.clip->bytes();
+            entries_.erase(victim);
+            lru_.pop_back();
+            ++stats_.evictions;
+        }
+        lru_.push_front(key);
+        entries_.emplace(key, Entry{clip, lru_.begin()});
+        bytes_ += clip->bytes();
+        ++stats_.loads;
+    }
+
+    PcmCache::Stats PcmCache::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        Stats s = stats_;
+        s.bytes = bytes_;
+        s.entries = entries_.size();
+        return s;
+    }
+
+}
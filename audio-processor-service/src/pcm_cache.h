@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "file_identity.h"
+
+struct AVBufferRef;
+struct AVFrame;
+
+namespace soundboard
+{
+
+    /**
+     * Whole-file decode of one clip: 44.1kHz float planar, in the source's channel
+     * layout. Each plane is a single read-only, ref-counted AVBuffer, so any number of
+     * streams can feed it to their graphs at once: frame() only adds references.
+     */
+    class DecodedClip
+    {
+    public:
+        static constexpr int kSampleRate = 44100;
+        static constexpr int kFrameSamples = 1152; // per frame(); an MP3 frame's worth
+
+        ~DecodedClip();
+
+        DecodedClip(const DecodedClip &) = delete;
+        DecodedClip &operator=(const DecodedClip &) = delete;
+
+        /**
+         * Demux, decode and resample path.
+         * @param max_bytes Give up once the PCM would be larger than this (0 = no limit)
+         * @return nullptr on failure (error_out says why)
+         */
+        static std::shared_ptr<const DecodedClip> decode(const std::string &path, size_t max_bytes,
+                                                         std::string &error_out);
+
+        /**
+         * Point out (which must be blank) at frame `index`: kFrameSamples per channel,
+         * the last one shorter. Nothing is copied.
+         * @return false past the end, or if a reference couldn't be allocated
+         */
+        bool frame(size_t index, AVFrame *out) const;
+
+        int channels() const { return static_cast<int>(planes_.size()); }
+        uint64_t channel_layout() const { return channel_layout_; }
+        int64_t samples() const { return samples_; }
+        size_t bytes() const { return static_cast<size_t>(samples_) * planes_.size() * sizeof(float); }
+
+    private:
+        DecodedClip() = default;
+
+        std::vector<AVBufferRef *> planes_;
+        uint64_t channel_layout_ = 0;
+        int64_t samples_ = 0;
+    };
+
+    // Decoded clips are keyed on their source file's identity
+    using PcmKey = FileIdentity;
+    using PcmKeyHash = FileIdentityHash;
+
+    /**
+     * Decoded PCM of the most-played clips, LRU-bounded by bytes, so effect requests
+     * for them skip demux and decode and feed their graphs from memory.
+     *
+     * Nothing is decoded on a request's critical path: a clip is admitted once it has
+     * missed admit_after times, by a background decode (on the DSP executor), and the
+     * requests after that hit. A clip that fails to decode or is too large is
+     * remembered (by file identity) and not tried again. Clips held by running streams
+     * stay alive after eviction until the last stream lets go.
+     */
+    class PcmCache
+    {
+    public:
+        struct Options
+        {
+            size_t memory_bytes = 0;          // 0 disables the cache
+            size_t max_clip_bytes = 32 << 20; // larger clips are never cached (~95 s of stereo)
+            int admit_after = 2;              // misses before a clip is decoded into the cache
+        };
+
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t loads = 0;
+            uint64_t load_failures = 0; // includes clips over max_clip_bytes
+            uint64_t evictions = 0;
+            size_t bytes = 0;
+            size_t entries = 0;
+        };
+
+        // Runs a decode off the caller's thread (e.g. on the DSP executor)
+        using Schedule = std::function<void(std::function<void()>)>;
+
+        PcmCache(const Options &options, Schedule schedule);
+
+        PcmCache(const PcmCache &) = delete;
+        PcmCache &operator=(const PcmCache &) = delete;
+
+        bool enabled() const { return options_.memory_bytes > 0; }
+
+        /**
+         * Cached PCM for path, or nullptr on a miss (which may schedule its decode).
+         */
+        std::shared_ptr<const DecodedClip> lookup(const std::string &path);
+
+        Stats stats() const;
+
+    private:
+        struct Entry
+        {
+            std::shared_ptr<const DecodedClip> clip;
+            std::list<PcmKey>::iterator lru_it;
+        };
+
+        void load(const PcmKey &key, const std::string &path);
+
+        Options options_;
+        Schedule schedule_;
+
+        mutable std::mutex mu_;
+        std::unordered_map<PcmKey, Entry, PcmKeyHash> entries_;
+        std::list<PcmKey> lru_; // front = most recently used
+        std::unordered_map<PcmKey, int, PcmKeyHash> misses_by_key_; // admission counts
+        std::unordered_set<PcmKey, PcmKeyHash> loading_;
+        std::unordered_set<PcmKey, PcmKeyHash> rejected_; // failed or too large; never re-admitted
+        size_t bytes_ = 0;
+        Stats stats_;
+    };
+
+}
@@ -0,0 +1,284 @@
+#include "pipeline_pool.h"
+#include "av_error.h"
+#include "file_identity.h"
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+}
+
+namespace soundboard
+{
+
+    // Largest MP3 frame is 1441 bytes (320kbps at 32kHz, padded); one per packet
+    static constexpr int kPacketBufferBytes = 4096;
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 134, 100)
+    // get_encode_buffer callback: hand the encoder a recycled buffer instead of a fresh
+    // allocation. Used by encoders with AV_CODEC_CAP_DR1 (libmp3lame since FFmpeg 4.4).
+    static int pooled_encode_buffer(AVCodecContext *ctx, AVPacket *pkt, int flags)
+    {
+        auto *pool = static_cast<AVBufferPool *>(ctx->opaque);
+        if (!pool || pkt->size > kPacketBufferBytes - AV_INPUT_BUFFER_PADDING_SIZE)
+            return avcodec_default_get_encode_buffer(ctx, pkt, flags);
+
+        pkt->buf = av_buffer_pool_get(pool);
+        if (!pkt->buf)
+            return AVERROR(ENOMEM);
+        pkt->data = pkt->buf->data;
+        memset(pkt->data + pkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        return 0;
+    }
+#endif
+
+    bool open_stream_pipeline(const AudioFormat &in, float speed, float pitch, const EffectsOptions &options,
+                              StreamPipeline &out, std::string &error_out)
+    {
+        const AVCodec *enc = avcodec_find_encoder(AV_CODEC_ID_MP3);
+        if (!enc)
+        {
+            error_out = "MP3 encoder not found";
+            return false;
+        }
+
+        AVCodecContext *enc_ctx = avcodec_alloc_context3(enc);
+        if (!enc_ctx)
+        {
+            error_out = "failed to alloc encoder";
+            return false;
+        }
+
+        // Configure encoder: 44.1kHz stereo, 192kbps MP3
+        enc_ctx->sample_rate = 44100;
+        enc_ctx->channel_layout = AV_CH_LAYOUT_STEREO;
+        enc_ctx->channels = 2;
+        // Use FLTP (float planar) which is well-supported by libmp3lame
+        enc_ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;
+        enc_ctx->bit_rate = 192000;
+
+        AVBufferPool *packet_pool = av_buffer_pool_init(kPacketBufferBytes, av_buffer_alloc);
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 134, 100)
+        enc_ctx->opaque = packet_pool;
+        enc_ctx->get_encode_buffer = pooled_encode_buffer;
+#endif
+
+        if (int ret = avcodec_open2(enc_ctx, enc, nullptr))
+        {
+            error_out = "avcodec_open2 (encoder): " + av_err_to_string(ret);
+            avcodec_free_context(&enc_ctx);
+            av_buffer_pool_uninit(&packet_pool);
+            return false;
+        }
+
+        EffectsGraph graph;
+        std::string graph_err;
+        if (!build_effects_graph(in, enc_ctx, speed, pitch, graph, graph_err, options))
+        {
+            error_out = "filter graph: " + graph_err;
+            avcodec_free_context(&enc_ctx);
+            av_buffer_pool_uninit(&packet_pool);
+            return false;
+        }
+
+        out.enc_ctx = enc_ctx;
+        out.packet_pool = packet_pool;
+        out.graph = graph;
+        return true;
+    }
+
+    void free_stream_pipeline(StreamPipeline &pipeline)
+    {
+        free_effects_graph(pipeline.graph);
+        if (pipeline.enc_ctx)
+            avcodec_free_context(&pipeline.enc_ctx);
+        // Buffers still referenced by packets are released when their last ref goes
+        if (pipeline.packet_pool)
+            av_buffer_pool_uninit(&pipeline.packet_pool);
+    }
+
+    // ============================================================================
+    // PipelineKey
+    // ============================================================================
+
+    PipelineKey PipelineKey::of(const AudioFormat &format, float speed, float pitch, const EffectsOptions &options)
+    {
+        PipelineKey key;
+        key.low_latency = options.low_latency;
+        key.native_pitch = options.native_pitch;
+        key.format = format;
+        key.speed_q = static_cast<int>(std::lround(speed * 100.0f));
+        key.pitch_q = static_cast<int>(std::lround(pitch * 100.0f));
+        return key;
+    }
+
+    EffectsOptions PipelineKey::options() const
+    {
+        EffectsOptions options;
+        options.low_latency = low_latency;
+        options.native_pitch = native_pitch;
+        return options;
+    }
+
+    size_t PipelineKeyHash::operator()(const PipelineKey &k) const
+    {
+        Fnv1a h;
+        h.mix(static_cast<uint64_t>(k.format.sample_rate) << 32 | static_cast<uint32_t>(k.format.sample_fmt));
+        h.mix(k.format.channel_layout);
+        h.mix(static_cast<uint64_t>(k.format.channels));
+        h.mix(static_cast<uint64_t>(k.speed_q) << 32 | static_cast<uint32_t>(k.pitch_q));
+        h.mix((k.low_latency ? 1 : 0) | (k.native_pitch ? 2 : 0));
+        return h.value();
+    }
+
+    // ============================================================================
+    // PipelinePool
+    // ============================================================================
+
+    PipelinePool::PipelinePool(const Options &options, Schedule schedule)
+        : options_(options), schedule_(std::move(schedule)) {}
+
+    PipelinePool::~PipelinePool()
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (auto &[key, slot] : slots_)
+            for (auto &p : slot.idle)
+                free_stream_pipeline(p);
+    }
+
+    PipelinePool::Slot &PipelinePool::slot_locked(const PipelineKey &key)
+    {
+        auto it = slots_.find(key);
+        if (it != slots_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+            return it->second;
+        }
+
+        // Forget the least recently used shape that isn't mid-refill
+        while (slots_.size() >= options_.max_keys)
+        {
+            auto victim = lru_.end();
+            for (auto rit = lru_.rbegin(); rit != lru_.rend(); ++rit)
+            {
+                if (!slots_.at(*rit).refilling)
+                {
+                    victim = std::prev(rit.base());
+                    break;
+                }
+            }
+            if (victim == lru_.end())
+                break;
+            Slot &old = slots_.at(*victim);
+            for (auto &p : old.idle)
+                free_stream_pipeline(p);
+            slots_.erase(*victim);
+            lru_.erase(victim);
+        }
+
+        lru_.push_front(key);
+        Slot &slot = slots_[key];
+        slot.lru_it = lru_.begin();
+        return slot;
+    }
+
+    void PipelinePool::schedule_refill_locked(const PipelineKey &key, Slot &slot)
+    {
+        if (slot.refilling || slot.idle.size() >= options_.max_idle_per_key || !schedule_)
+            return;
+        slot.refilling = true;
+        schedule_([this, key]()
+                  { refill(key); });
+    }
+
+    bool PipelinePool::acquire(const PipelineKey &key, StreamPipeline &out, bool &hit_out, std::string &error_out)
+    {
+        hit_out = false;
+        if (enabled())
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            Slot &slot = slot_locked(key);
+            if (!slot.idle.empty())
+            {
+                out = slot.idle.back();
+                slot.idle.pop_back();
+                hit_out = true;
+                ++stats_.hits;
+            }
+            else
+                ++stats_.misses;
+            // A shape's first request builds inline and pools nothing: one-off shapes
+            // (odd rates, rare speed/pitch) would otherwise cost max_idle_per_key
+            // extra builds each. From its second request on, keep it stocked.
+            if (hit_out || slot.requested)
+                schedule_refill_locked(key, slot);
+            slot.requested = true;
+        }
+        if (hit_out)
+            return true;
+
+        return open_stream_pipeline(key.format, key.speed(), key.pitch(), key.options(), out, error_out);
+    }
+
+    void PipelinePool::refill(const PipelineKey &key)
+    {
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                auto it = slots_.find(key);
+                if (it == slots_.end())
+                    return;
+                if (it->second.idle.size() >= options_.max_idle_per_key)
+                {
+                    it->second.refilling = false;
+                    return;
+                }
+            }
+
+            // Built without the lock; only this refill adds to the slot
+            StreamPipeline p;
+            std::string err;
+            bool ok = open_stream_pipeline(key.format, key.speed(), key.pitch(), key.options(), p, err);
+
+            std::lock_guard<std::mutex> lock(mu_);
+            auto it = slots_.find(key);
+            if (!ok || it == slots_.end())
+            {
+                if (ok)
+                    free_stream_pipeline(p);
+                if (it != slots_.end())
+                    it->second.refilling = false;
+                return;
+            }
+            it->second.idle.push_back(p);
+            ++stats_.built;
+        }
+    }
+
+    void PipelinePool::prewarm(const std::vector<PipelineKey> &keys)
+    {
+        if (!enabled())
+            return;
+        std::lock_guard<std::mutex> lock(mu_);
+        for (const auto &key : keys)
+            schedule_refill_locked(key, slot_locked(key));
+    }
+
+    PipelinePool::Stats PipelinePool::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        Stats s = stats_;
+        for (const auto &[key, slot] : slots_)
+            s.idle += slot.idle.size();
+        return s;
+    }
+
+}
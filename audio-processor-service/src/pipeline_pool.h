@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "effects_graph.h"
+
+struct AVCodecContext;
+struct AVBufferPool;
+
+namespace soundboard
+{
+
+    /**
+     * Encoder plus effects graph for one ApplyEffectsStream: MP3 192k, 44.1kHz
+     * stereo, with a graph shaped for that encoder and fed with `in` frames.
+     * Encoded packets are written into buffers recycled through packet_pool, so
+     * a running encoder doesn't allocate per packet.
+     */
+    struct StreamPipeline
+    {
+        AVCodecContext *enc_ctx = nullptr;
+        AVBufferPool *packet_pool = nullptr;
+        EffectsGraph graph;
+    };
+
+    /**
+     * Open the encoder and build the graph. Speed/pitch are expected to be clamped;
+     * options are passed through to build_effects_graph().
+     * @return false on failure (error_out says which step; nothing to free)
+     */
+    bool open_stream_pipeline(const AudioFormat &in, float speed, float pitch, const EffectsOptions &options,
+                              StreamPipeline &out, std::string &error_out);
+
+    void free_stream_pipeline(StreamPipeline &pipeline);
+
+    /**
+     * What a pooled pipeline was built for: the decoder's output format plus
+     * speed/pitch quantized to the 0.01 steps the graph uses, and the graph tuning
+     * (pooled pipelines never carry a trim).
+     */
+    struct PipelineKey
+    {
+        AudioFormat format;
+        int speed_q = 100;
+        int pitch_q = 100;
+        bool low_latency = false;
+        bool native_pitch = false;
+
+        static PipelineKey of(const AudioFormat &format, float speed, float pitch, const EffectsOptions &options = {});
+        float speed() const { return speed_q / 100.0f; }
+        float pitch() const { return pitch_q / 100.0f; }
+        EffectsOptions options() const;
+
+        bool operator==(const PipelineKey &o) const
+        {
+            return format == o.format && speed_q == o.speed_q && pitch_q == o.pitch_q &&
+                   low_latency == o.low_latency && native_pitch == o.native_pitch;
+        }
+    };
+
+    struct PipelineKeyHash
+    {
+        size_t operator()(const PipelineKey &k) const;
+    };
+
+    /**
+     * Pre-built stream pipelines, keyed by input format and speed/pitch, so a
+     * request skips encoder open and graph configuration on its critical path.
+     *
+     * Neither an FFmpeg filter graph nor libmp3lame can be rewound after they've
+     * been flushed, so a pipeline is used by exactly one stream: acquire() hands
+     * out an unused one and the caller frees it when done. Once a key has been
+     * asked for more than once (or prewarmed), each acquire() schedules a
+     * background refill for it, so the next request with the same shape finds
+     * one ready. Keys are forgotten least-recently-used first.
+     */
+    class PipelinePool
+    {
+    public:
+        struct Options
+        {
+            size_t max_idle_per_key = 2; // 0 disables pooling
+            size_t max_keys = 16;
+        };
+
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t built = 0; // by refills / prewarm
+            size_t idle = 0;
+        };
+
+        // Runs a refill off the caller's thread (e.g. on the DSP executor)
+        using Schedule = std::function<void(std::function<void()>)>;
+
+        PipelinePool(const Options &options, Schedule schedule);
+        ~PipelinePool();
+
+        PipelinePool(const PipelinePool &) = delete;
+        PipelinePool &operator=(const PipelinePool &) = delete;
+
+        bool enabled() const { return options_.max_idle_per_key > 0; }
+
+        /**
+         * Take a pipeline for key, building one inline on a miss.
+         * @param hit_out true if it came from the pool
+         * @return false if building failed (error_out says why)
+         */
+        bool acquire(const PipelineKey &key, StreamPipeline &out, bool &hit_out, std::string &error_out);
+
+        // Build pipelines for key until it holds max_idle_per_key (blocking)
+        void refill(const PipelineKey &key);
+
+        // Schedule a refill for each key (startup warm-up for common shapes)
+        void prewarm(const std::vector<PipelineKey> &keys);
+
+        Stats stats() const;
+
+    private:
+        struct Slot
+        {
+            std::vector<StreamPipeline> idle;
+            std::list<PipelineKey>::iterator lru_it;
+            bool refilling = false;
+            bool requested = false; // acquire() has seen this key before
+        };
+
+        void schedule_refill_locked(const PipelineKey &key, Slot &slot);
+        Slot &slot_locked(const PipelineKey &key);
+
+        Options options_;
+        Schedule schedule_;
+
+        mutable std::mutex mu_;
+        std::unordered_map<PipelineKey, Slot, PipelineKeyHash> slots_;
+        std::list<PipelineKey> lru_; // front = most recently used
+        Stats stats_;
+    };
+
+}
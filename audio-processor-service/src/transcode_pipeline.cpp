@@ -0,0 +1,637 @@
+#include "transcode_pipeline.h"
+#include "av_error.h"
+#include "dsp_executor.h"
+#include "effects_graph.h"
+#include "mapped_input.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// FFmpeg is a C library
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+}
+
+namespace soundboard
+{
+
+    // Decoded frames buffered per output before the decoder blocks on it
+    static constexpr size_t kMaxQueuedFrames = 64;
+
+    // Unique suffix for outputs being written (renamed over out_path when committed)
+    static std::atomic<uint64_t> g_tmp_counter{0};
+
+    static std::string tmp_suffix()
+    {
+        return ".tmp." + std::to_string(getpid()) + "." + std::to_string(g_tmp_counter.fetch_add(1));
+    }
+
+    static const AVCodec *find_output_encoder(const std::string &codec)
+    {
+        if (codec == "mp3")
+            return avcodec_find_encoder(AV_CODEC_ID_MP3);
+        if (codec == "opus")
+        {
+            // libopus is the production-quality encoder; the native one is experimental
+            if (const AVCodec *libopus = avcodec_find_encoder_by_name("libopus"))
+                return libopus;
+            return avcodec_find_encoder(AV_CODEC_ID_OPUS);
+        }
+        if (codec == "aac")
+            return avcodec_find_encoder(AV_CODEC_ID_AAC);
+        return nullptr;
+    }
+
+    static const char *default_container(const std::string &codec)
+    {
+        if (codec == "opus")
+            return "ogg";
+        if (codec == "aac")
+            return "adts";
+        return "mp3";
+    }
+
+    // Prefer planar float (what the effects filters produce), else the encoder's first format
+    static AVSampleFormat pick_sample_fmt(const AVCodec *enc)
+    {
+        if (!enc->sample_fmts)
+            return AV_SAMPLE_FMT_FLTP;
+        for (const AVSampleFormat *f = enc->sample_fmts; *f != AV_SAMPLE_FMT_NONE; ++f)
+        {
+            if (*f == AV_SAMPLE_FMT_FLTP)
+                return *f;
+        }
+        return enc->sample_fmts[0];
+    }
+
+    // Requested rate if the encoder supports it, otherwise its closest supported rate
+    static int pick_sample_rate(const AVCodec *enc, int requested)
+    {
+        if (!enc->supported_samplerates)
+            return requested;
+        int best = enc->supported_samplerates[0];
+        for (const int *r = enc->supported_samplerates; *r; ++r)
+        {
+            if (*r == requested)
+                return requested;
+            if (std::abs(*r - requested) < std::abs(best - requested))
+                best = *r;
+        }
+        return best;
+    }
+
+    /**
+     * One output of a transcode: effects graph -> encoder -> muxer, fed decoded frame
+     * references through a bounded queue. Tasks on the transcode's executor drain the
+     * queue; when none is running, a decoder finding the queue full (or join) drains
+     * it inline, so outputs keep moving while every worker is busy and without an
+     * executor at all. Tasks hold a reference, so a late one finds the output done.
+     */
+    class OutputWorker : public std::enable_shared_from_this<OutputWorker>
+    {
+    public:
+        OutputWorker(TranscodeOutput &spec, DspExecutor *executor) : spec_(spec), executor_(executor) {}
+        ~OutputWorker() { close(); }
+
+        // Set up graph/encoder/muxer; false leaves the output failed
+        bool start(const AVCodecContext *dec_ctx)
+        {
+            if (!open(dec_ctx))
+            {
+                done_ = true;
+                return false;
+            }
+            return true;
+        }
+
+        // Takes ownership of frame (a reference from av_frame_clone); while the queue is
+        // full, waits for the draining task or drains it here
+        void push(AVFrame *frame)
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            while (!done_ && queue_.size() >= kMaxQueuedFrames)
+            {
+                if (draining_)
+                    cv_.wait(lock);
+                else
+                    drain_locked(lock, true);
+            }
+            if (done_ || !frame)
+            {
+                if (!frame && !done_)
+                    fail_locked("out of memory cloning frame");
+                av_frame_free(&frame);
+                return;
+            }
+            queue_.push_back(frame);
+            schedule_locked();
+        }
+
+        void end_of_input()
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            eof_ = true;
+            schedule_locked();
+        }
+
+        // Wait until the output has finished or failed (after end_of_input) and nobody
+        // is still encoding into it
+        void join()
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            while (draining_ || !done_)
+            {
+                if (draining_)
+                    cv_.wait(lock);
+                else
+                    drain_locked(lock, false);
+            }
+        }
+
+        // Free everything; an output that didn't complete leaves no file behind, and a
+        // complete one waits at tmp_path for the caller to commit it
+        void close()
+        {
+            if (closed_)
+                return;
+            closed_ = true;
+            if (pkt_)
+                av_packet_free(&pkt_);
+            if (filtered_)
+                av_frame_free(&filtered_);
+            if (out_fmt_)
+            {
+                if (out_fmt_->pb)
+                    avio_closep(&out_fmt_->pb);
+                avformat_free_context(out_fmt_);
+                out_fmt_ = nullptr;
+            }
+            if (enc_ctx_)
+                avcodec_free_context(&enc_ctx_);
+            free_effects_graph(graph_);
+
+            // Only the temp file this output created is ever removed
+            if (!opened_)
+                return;
+            struct stat st;
+            if (spec_.ok && stat(tmp_path_.c_str(), &st) != 0)
+            {
+                spec_.ok = false;
+                spec_.error = std::string("stat: ") + strerror(errno);
+            }
+            if (spec_.ok)
+            {
+                spec_.bytes = static_cast<int64_t>(st.st_size);
+                spec_.tmp_path = tmp_path_;
+            }
+            else
+            {
+                std::remove(tmp_path_.c_str());
+            }
+        }
+
+    private:
+        bool open(const AVCodecContext *dec_ctx)
+        {
+            const AVCodec *enc = find_output_encoder(spec_.codec);
+            if (!enc)
+            {
+                spec_.error = "no encoder for codec '" + spec_.codec + "'";
+                return false;
+            }
+            if (spec_.out_path.empty())
+            {
+                spec_.error = "no output path";
+                return false;
+            }
+
+            const char *container = spec_.container.empty() ? default_container(spec_.codec) : spec_.container.c_str();
+            if (int ret = avformat_alloc_output_context2(&out_fmt_, nullptr, container, spec_.out_path.c_str()))
+            {
+                spec_.error = "avformat_alloc_output_context2: " + av_err_to_string(ret);
+                return false;
+            }
+            out_stream_ = avformat_new_stream(out_fmt_, nullptr);
+            enc_ctx_ = avcodec_alloc_context3(enc);
+            filtered_ = av_frame_alloc();
+            pkt_ = av_packet_alloc();
+            if (!out_stream_ || !enc_ctx_ || !filtered_ || !pkt_)
+            {
+                spec_.error = "allocation failed";
+                return false;
+            }
+
+            int channels = spec_.channels == 1 ? 1 : 2;
+            int sample_rate = spec_.sample_rate > 0 ? spec_.sample_rate : (spec_.codec == "opus" ? 48000 : 44100);
+            enc_ctx_->sample_rate = pick_sample_rate(enc, sample_rate);
+            enc_ctx_->channel_layout = av_get_default_channel_layout(channels);
+            enc_ctx_->channels = channels;
+            enc_ctx_->sample_fmt = pick_sample_fmt(enc);
+            enc_ctx_->bit_rate = static_cast<int64_t>(spec_.bitrate_kbps) * 1000;
+            enc_ctx_->time_base = AVRational{1, enc_ctx_->sample_rate};
+            if (enc->capabilities & AV_CODEC_CAP_EXPERIMENTAL)
+                enc_ctx_->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+
+            // Some containers (ogg) carry codec headers out-of-band
+            if (out_fmt_->oformat->flags & AVFMT_GLOBALHEADER)
+                enc_ctx_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+            if (int ret = avcodec_open2(enc_ctx_, enc, nullptr))
+            {
+                spec_.error = "avcodec_open2 (encoder): " + av_err_to_string(ret);
+                return false;
+            }
+            if (int ret = avcodec_parameters_from_context(out_stream_->codecpar, enc_ctx_))
+            {
+                spec_.error = "avcodec_parameters_from_context: " + av_err_to_string(ret);
+                return false;
+            }
+            out_stream_->time_base = enc_ctx_->time_base;
+
+            EffectsOptions effects;
+            effects.native_pitch = spec_.native_pitch;
+            if (!build_effects_graph(AudioFormat::of(dec_ctx), enc_ctx_, spec_.speed, spec_.pitch, graph_, spec_.error,
+                                     effects))
+                return false;
+
+            if (!(out_fmt_->oformat->flags & AVFMT_NOFILE))
+            {
+                tmp_path_ = spec_.out_path + tmp_suffix();
+                if (int ret = avio_open(&out_fmt_->pb, tmp_path_.c_str(), AVIO_FLAG_WRITE))
+                {
+                    spec_.error = "avio_open: " + av_err_to_string(ret);
+                    return false;
+                }
+                opened_ = true;
+            }
+            if (int ret = avformat_write_header(out_fmt_, nullptr))
+            {
+                spec_.error = "avformat_write_header: " + av_err_to_string(ret);
+                return false;
+            }
+            return true;
+        }
+
+        // Make sure a task will drain what is queued (mu_ held). Without an executor
+        // push() and join() drain inline.
+        void schedule_locked()
+        {
+            if (!executor_ || scheduled_ || draining_ || done_)
+                return;
+            scheduled_ = true;
+            executor_->submit([self = shared_from_this()]()
+                              { self->run_task(); });
+        }
+
+        void run_task()
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            scheduled_ = false;
+            if (!draining_ && !done_)
+                drain_locked(lock, false);
+        }
+
+        // Encode queued frames (and finish at end of input) until the queue is empty, or
+        // for until_room no longer full; mu_ is held on entry/exit and released per frame
+        void drain_locked(std::unique_lock<std::mutex> &lock, bool until_room)
+        {
+            draining_ = true;
+            while (!done_ && (!queue_.empty() || eof_))
+            {
+                if (until_room && queue_.size() < kMaxQueuedFrames)
+                    break;
+                AVFrame *frame = nullptr;
+                if (!queue_.empty())
+                {
+                    frame = queue_.front();
+                    queue_.pop_front();
+                }
+                lock.unlock();
+
+                bool ok = frame ? consume(frame) : finish();
+                av_frame_free(&frame);
+
+                lock.lock();
+                if (!ok)
+                    fail_locked(nullptr);
+                else if (spec_.ok)
+                    done_ = true;
+            }
+            draining_ = false;
+            cv_.notify_all();
+            schedule_locked(); // frames left behind by an inline drain
+        }
+
+        // Drop queued frames and unblock the decoder; error may already be in spec_.error
+        void fail_locked(const char *error)
+        {
+            if (error)
+                spec_.error = error;
+            done_ = true;
+            for (AVFrame *f : queue_)
+                av_frame_free(&f);
+            queue_.clear();
+            cv_.notify_all();
+        }
+
+        bool consume(AVFrame *frame)
+        {
+            // Without KEEP_REF the graph takes over this output's reference
+            if (int ret = push_effects_frame(graph_, frame))
+            {
+                spec_.error = "push_effects_frame: " + av_err_to_string(ret);
+                return false;
+            }
+            return drain_graph();
+        }
+
+        // Encode whatever the graph has ready
+        bool drain_graph()
+        {
+            while (av_buffersink_get_frame(graph_.sink, filtered_) >= 0)
+            {
+                filtered_->pts = pts_;
+                pts_ += filtered_->nb_samples;
+
+                int ret = avcodec_send_frame(enc_ctx_, filtered_);
+                av_frame_unref(filtered_);
+                if (ret < 0)
+                {
+                    spec_.error = "avcodec_send_frame: " + av_err_to_string(ret);
+                    return false;
+                }
+                if (!write_packets())
+                    return false;
+            }
+            return true;
+        }
+
+        // Mux every packet the encoder has ready
+        bool write_packets()
+        {
+            while (avcodec_receive_packet(enc_ctx_, pkt_) == 0)
+            {
+                pkt_->stream_index = out_stream_->index;
+                av_packet_rescale_ts(pkt_, enc_ctx_->time_base, out_stream_->time_base);
+                if (int ret = av_interleaved_write_frame(out_fmt_, pkt_))
+                {
+                    spec_.error = "av_interleaved_write_frame: " + av_err_to_string(ret);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // End of input: flush graph and encoder, write the trailer
+        bool finish()
+        {
+            push_effects_frame(graph_, nullptr);
+            if (!drain_graph())
+                return false;
+
+            avcodec_send_frame(enc_ctx_, nullptr);
+            if (!write_packets())
+                return false;
+
+            if (int ret = av_write_trailer(out_fmt_))
+            {
+                spec_.error = "av_write_trailer: " + av_err_to_string(ret);
+                return false;
+            }
+            spec_.duration_seconds = double(pts_) / enc_ctx_->sample_rate;
+            spec_.ok = true;
+            return true;
+        }
+
+        TranscodeOutput &spec_;
+        EffectsGraph graph_;
+        AVFormatContext *out_fmt_ = nullptr;
+        AVCodecContext *enc_ctx_ = nullptr;
+        AVStream *out_stream_ = nullptr;
+        AVFrame *filtered_ = nullptr;
+        AVPacket *pkt_ = nullptr;
+        int64_t pts_ = 0;
+        std::string tmp_path_;
+        bool opened_ = false; // tmp_path_ was created by avio_open
+        bool closed_ = false;
+
+        DspExecutor *executor_;
+        std::mutex mu_;
+        std::condition_variable cv_;
+        std::deque<AVFrame *> queue_;
+        bool eof_ = false;
+        bool scheduled_ = false; // a drain task is queued on executor_
+        bool draining_ = false;  // someone is encoding; only one at a time
+        bool done_ = false;      // finished or failed
+    };
+
+    static void reset_outputs(std::vector<TranscodeOutput> &outputs)
+    {
+        for (auto &o : outputs)
+        {
+            o.ok = false;
+            o.error.clear();
+            o.bytes = 0;
+            o.duration_seconds = 0.0;
+            o.tmp_path.clear();
+        }
+    }
+
+    // Everything after opening the input; closes in_fmt
+    static bool transcode_input(AVFormatContext *in_fmt, std::vector<TranscodeOutput> &outputs, DspExecutor *executor,
+                                std::string &error_out)
+    {
+        if (int ret = avformat_find_stream_info(in_fmt, nullptr))
+        {
+            error_out = "avformat_find_stream_info: " + av_err_to_string(ret);
+            close_format_input(&in_fmt);
+            return false;
+        }
+
+        int audio_stream_index = av_find_best_stream(in_fmt, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        if (audio_stream_index < 0)
+        {
+            error_out = "no audio stream found";
+            close_format_input(&in_fmt);
+            return false;
+        }
+
+        AVStream *in_stream = in_fmt->streams[audio_stream_index];
+        const AVCodec *dec = avcodec_find_decoder(in_stream->codecpar->codec_id);
+        if (!dec)
+        {
+            error_out = "decoder not found";
+            close_format_input(&in_fmt);
+            return false;
+        }
+
+        AVCodecContext *dec_ctx = avcodec_alloc_context3(dec);
+        if (!dec_ctx)
+        {
+            error_out = "failed to alloc decoder context";
+            close_format_input(&in_fmt);
+            return false;
+        }
+        if (int ret = avcodec_parameters_to_context(dec_ctx, in_stream->codecpar))
+        {
+            error_out = "avcodec_parameters_to_context: " + av_err_to_string(ret);
+            avcodec_free_context(&dec_ctx);
+            close_format_input(&in_fmt);
+            return false;
+        }
+        if (int ret = avcodec_open2(dec_ctx, dec, nullptr))
+        {
+            error_out = "avcodec_open2 (decoder): " + av_err_to_string(ret);
+            avcodec_free_context(&dec_ctx);
+            close_format_input(&in_fmt);
+            return false;
+        }
+
+        // Skip packets of every other stream (video, subtitles) at the demuxer
+        for (unsigned i = 0; i < in_fmt->nb_streams; ++i)
+        {
+            if (static_cast<int>(i) != audio_stream_index)
+                in_fmt->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        std::vector<std::shared_ptr<OutputWorker>> workers;
+        workers.reserve(outputs.size());
+        for (auto &o : outputs)
+        {
+            workers.push_back(std::make_shared<OutputWorker>(o, executor));
+            workers.back()->start(dec_ctx);
+        }
+
+        // Each output gets its own reference to the decoded samples
+        int64_t frames_decoded = 0;
+        auto fan_out = [&](AVFrame *frame)
+        {
+            frames_decoded++;
+            for (auto &w : workers)
+                w->push(av_frame_clone(frame));
+            av_frame_unref(frame);
+        };
+
+        AVPacket *pkt = av_packet_alloc();
+        AVFrame *frame = av_frame_alloc();
+        if (pkt && frame)
+        {
+            while (av_read_frame(in_fmt, pkt) >= 0)
+            {
+                // Corrupt packets are skipped, as a player would
+                if (pkt->stream_index == audio_stream_index && avcodec_send_packet(dec_ctx, pkt) == 0)
+                {
+                    while (avcodec_receive_frame(dec_ctx, frame) == 0)
+                        fan_out(frame);
+                }
+                av_packet_unref(pkt);
+            }
+
+            // Flush decoder
+            avcodec_send_packet(dec_ctx, nullptr);
+            while (avcodec_receive_frame(dec_ctx, frame) == 0)
+                fan_out(frame);
+        }
+        else
+        {
+            error_out = "failed to alloc packet/frame";
+        }
+
+        for (auto &w : workers)
+            w->end_of_input();
+        for (auto &w : workers)
+            w->join();
+
+        if (error_out.empty() && frames_decoded == 0)
+            error_out = "no audio frames decoded";
+        if (!error_out.empty())
+        {
+            // Input unusable: discard every output
+            for (auto &o : outputs)
+            {
+                o.ok = false;
+                if (o.error.empty())
+                    o.error = error_out;
+            }
+        }
+        for (auto &w : workers)
+            w->close(); // removes temp files of failed outputs
+        workers.clear();
+
+        if (pkt)
+            av_packet_free(&pkt);
+        if (frame)
+            av_frame_free(&frame);
+        avcodec_free_context(&dec_ctx);
+        close_format_input(&in_fmt);
+
+        return error_out.empty();
+    }
+
+    bool transcode(const std::string &in_path, std::vector<TranscodeOutput> &outputs, std::string &error_out,
+                   DspExecutor *executor)
+    {
+        reset_outputs(outputs);
+        AVFormatContext *in_fmt = nullptr;
+        // Read once (uploads are deleted right after): a private mapping, not the shared cache
+        if (int ret = open_format_input(&in_fmt, in_path, false))
+        {
+            error_out = "open_format_input: " + av_err_to_string(ret);
+            return false;
+        }
+        return transcode_input(in_fmt, outputs, executor, error_out);
+    }
+
+    bool transcode(std::shared_ptr<const std::string> in_bytes, const std::string &name,
+                   std::vector<TranscodeOutput> &outputs, std::string &error_out, DspExecutor *executor)
+    {
+        reset_outputs(outputs);
+        AVFormatContext *in_fmt = nullptr;
+        if (int ret = open_memory_input(&in_fmt, std::move(in_bytes), name))
+        {
+            error_out = "open_memory_input: " + av_err_to_string(ret);
+            return false;
+        }
+        return transcode_input(in_fmt, outputs, executor, error_out);
+    }
+
+    bool commit_transcode_output(TranscodeOutput &output)
+    {
+        if (!output.ok || output.tmp_path.empty())
+            return output.ok;
+        // Renamed over the old file, so a reader still mapping it keeps intact pages
+        if (std::rename(output.tmp_path.c_str(), output.out_path.c_str()) != 0)
+        {
+            output.ok = false;
+            output.error = std::string("rename: ") + strerror(errno);
+            std::remove(output.tmp_path.c_str());
+        }
+        output.tmp_path.clear();
+        return output.ok;
+    }
+
+    void discard_transcode_output(TranscodeOutput &output)
+    {
+        if (!output.tmp_path.empty())
+            std::remove(output.tmp_path.c_str());
+        output.tmp_path.clear();
+        output.ok = false;
+    }
+
+}
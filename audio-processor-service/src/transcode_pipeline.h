@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace soundboard
+{
+
+    class DspExecutor;
+
+    /**
+     * One encoded output of a transcode: codec and format, optional speed/pitch
+     * effects, and where to write it.
+     */
+    struct TranscodeOutput
+    {
+        std::string codec = "mp3"; // mp3, opus, aac
+        int bitrate_kbps = 192;
+        int sample_rate = 0;       // 0 = codec default (48kHz for Opus, 44.1kHz otherwise)
+        int channels = 2;
+        float speed = 1.0f;        // clamped effects, as for ApplyEffectsStream
+        float pitch = 1.0f;
+        bool native_pitch = false; // see EffectsOptions::native_pitch
+        std::string out_path;
+        std::string container;     // muxer name; empty = by codec (mp3, ogg, adts)
+
+        // Results
+        bool ok = false;
+        std::string error;
+        int64_t bytes = 0;
+        double duration_seconds = 0.0; // encoded audio, after effects
+        std::string tmp_path;          // the finished file until committed or discarded
+    };
+
+    /**
+     * Demux and decode in_path once, fanning every decoded frame out to all
+     * outputs. Each output gets its own reference to the frame (av_frame_clone,
+     * no sample copy) through a bounded queue, and filters/encodes/muxes in tasks
+     * on executor, so N outputs cost one decode plus N encodes running in parallel
+     * on as many workers as are free. A slow output applies backpressure to the
+     * decoder, which encodes for it when no worker does. With no executor every
+     * output is encoded on the calling thread.
+     *
+     * Each output is written to a temp file next to out_path (tmp_path) and left
+     * there: the caller moves it into place with commit_transcode_output(), or drops
+     * it with discard_transcode_output(), once it knows which outputs it wants (e.g.
+     * none if a required one failed). So out_path never holds a partial file, is
+     * never touched for an output that isn't kept, and readers of a previous version
+     * (e.g. through a cached mapping) are unaffected by the rename. An output that
+     * fails is dropped (its temp file removed) without affecting the others; check
+     * each output's ok/error.
+     *
+     * @param in_path Path to input media (anything FFmpeg can demux with an audio stream)
+     * @param outputs Outputs to produce; results are filled in
+     * @param error_out Reason if the input itself could not be read
+     * @param executor Workers for the encodes (the caller may be one of them), or nullptr
+     * @return false if the input could not be opened/decoded (no outputs are kept)
+     */
+    bool transcode(const std::string &in_path, std::vector<TranscodeOutput> &outputs, std::string &error_out,
+                   DspExecutor *executor = nullptr);
+
+    /**
+     * transcode() of media held in memory (e.g. streamed in by the client) instead of
+     * a file; name is a format-probing hint, as for open_memory_input.
+     */
+    bool transcode(std::shared_ptr<const std::string> in_bytes, const std::string &name,
+                   std::vector<TranscodeOutput> &outputs, std::string &error_out,
+                   DspExecutor *executor = nullptr);
+
+    /**
+     * Rename a finished output's temp file over its out_path. An output whose rename
+     * fails is marked failed and its temp file removed.
+     * @return output.ok afterwards
+     */
+    bool commit_transcode_output(TranscodeOutput &output);
+
+    /**
+     * Remove a finished output's temp file, leaving out_path as it was; the output is
+     * marked failed.
+     */
+    void discard_transcode_output(TranscodeOutput &output);
+
+}
@@ -0,0 +1,607 @@
+// Load generator for capacity planning: drives ApplyEffectsStream and ExtractAudio
+// against a running audio_server and reports tail latencies, rejections and the
+// server's CPU use, so AUDIO_PROC_MAX_CONCURRENCY and friends can be sized from data.
+//
+//   ./build/audio_loadgen --clips=/app/audio/a.mp3,/app/audio/b.mp3 --rate=20 --duration=60
+//
+// Clip and output paths are as the server sees them. Options (defaults in brackets):
+//
+//   --target=HOST:PORT      gRPC endpoint [localhost:50051]
+//   --metrics=HOST:PORT     server /metrics, scraped before and after for CPU; "" skips [localhost:9100]
+//   --clips=P1,P2,...       clips, picked uniformly per request (required)
+//   --presets=S:P,...       speed:pitch mix for streams, picked uniformly [1:1,1.5:1,0.75:1,1:1.2,1.5:1.2]
+//   --extract-fraction=F    share of requests that are ExtractAudio [0]
+//   --extract-dir=DIR       where ExtractAudio writes, on the server [/tmp/audio/loadgen]
+//   --concurrency=N         closed loop: N clients, each sending its next request when the last ends [4]
+//   --rate=R                open loop instead: Poisson arrivals at R requests/s
+//   --max-inflight=N        open loop: arrivals while N are outstanding are dropped, not queued [256]
+//   --duration=S            measured seconds [30]
+//   --warmup=S              seconds of load before measuring, not reported [5]
+//   --channels=N            gRPC connections to spread requests over [4]
+//   --deadline-ms=MS        per-request deadline [60000]
+//   --low-latency           ask for low-latency streams
+//   --seed=N                request mix seed [1]
+//
+// In open-loop mode latencies are measured from the scheduled arrival, not from when
+// a client thread got round to sending, so a backed-up server shows up in the tail
+// instead of silently lowering the offered rate.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <grpcpp/grpcpp.h>
+#include "audio_processor.grpc.pb.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions
+{
+    std::string target = "localhost:50051";
+    std::string metrics = "localhost:9100";
+    std::vector<std::string> clips;
+    std::vector<std::pair<float, float>> presets = {{1.0f, 1.0f}, {1.5f, 1.0f}, {0.75f, 1.0f}, {1.0f, 1.2f}, {1.5f, 1.2f}};
+    double extract_fraction = 0.0;
+    std::string extract_dir = "/tmp/audio/loadgen";
+    int concurrency = 4;
+    double rate = 0.0; // > 0 selects open loop
+    int max_inflight = 256;
+    double duration_s = 30.0;
+    double warmup_s = 5.0;
+    int channels = 4;
+    int deadline_ms = 60000;
+    bool low_latency = false;
+    uint32_t seed = 1;
+};
+
+enum class Kind
+{
+    STREAM,
+    EXTRACT
+};
+
+struct Sample
+{
+    Kind kind = Kind::STREAM;
+    bool ok = false;
+    std::string outcome; // status code name, or APP_ERROR for success=false
+    double first_chunk_ms = 0.0;
+    double total_ms = 0.0;
+    int64_t bytes = 0;
+};
+
+// ============================================================================
+// Options
+// ============================================================================
+
+static std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep))
+        if (!item.empty())
+            out.push_back(item);
+    return out;
+}
+
+static bool parse_options(int argc, char **argv, LoadOptions &opts, std::string &error_out)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        try
+        {
+            if (key == "--target")
+                opts.target = value;
+            else if (key == "--metrics")
+                opts.metrics = value;
+            else if (key == "--clips")
+                opts.clips = split(value, ',');
+            else if (key == "--presets")
+            {
+                opts.presets.clear();
+                for (const std::string &p : split(value, ','))
+                {
+                    size_t colon = p.find(':');
+                    if (colon == std::string::npos)
+                        throw std::invalid_argument(p);
+                    opts.presets.emplace_back(std::stof(p.substr(0, colon)), std::stof(p.substr(colon + 1)));
+                }
+            }
+            else if (key == "--extract-fraction")
+                opts.extract_fraction = std::clamp(std::stod(value), 0.0, 1.0);
+            else if (key == "--extract-dir")
+                opts.extract_dir = value;
+            else if (key == "--concurrency")
+                opts.concurrency = std::max(1, std::stoi(value));
+            else if (key == "--rate")
+                opts.rate = std::stod(value);
+            else if (key == "--max-inflight")
+                opts.max_inflight = std::max(1, std::stoi(value));
+            else if (key == "--duration")
+                opts.duration_s = std::stod(value);
+            else if (key == "--warmup")
+                opts.warmup_s = std::max(0.0, std::stod(value));
+            else if (key == "--channels")
+                opts.channels = std::max(1, std::stoi(value));
+            else if (key == "--deadline-ms")
+                opts.deadline_ms = std::max(1, std::stoi(value));
+            else if (key == "--low-latency")
+                opts.low_latency = true;
+            else if (key == "--seed")
+                opts.seed = static_cast<uint32_t>(std::stoul(value));
+            else
+            {
+                error_out = "unknown option " + arg;
+                return false;
+            }
+        }
+        catch (...)
+        {
+            error_out = "bad value for " + key + ": " + value;
+            return false;
+        }
+    }
+    if (opts.clips.empty())
+    {
+        error_out = "--clips is required";
+        return false;
+    }
+    if (opts.presets.empty() || opts.duration_s <= 0.0)
+    {
+        error_out = "need at least one preset and a positive duration";
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Server metrics
+// ============================================================================
+
+// Body of GET /metrics from host:port, or empty on failure
+static std::string fetch_metrics(const std::string &endpoint)
+{
+    size_t colon = endpoint.rfind(':');
+    if (endpoint.empty() || colon == std::string::npos)
+        return {};
+    std::string host = endpoint.substr(0, colon);
+    std::string port = endpoint.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+        return {};
+    int fd = -1;
+    for (addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        return {};
+
+    std::string request = "GET /metrics HTTP/1.0\r\nHost: " + host + "\r\n\r\n";
+    send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    std::string response;
+    char buf[16384];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+        response.append(buf, static_cast<size_t>(n));
+    close(fd);
+
+    size_t body = response.find("\r\n\r\n");
+    return body == std::string::npos ? std::string() : response.substr(body + 4);
+}
+
+// Sum of every series of a metric (all label sets)
+static double metric_value(const std::string &text, const std::string &name)
+{
+    double total = 0.0;
+    std::stringstream ss(text);
+    std::string line;
+    while (std::getline(ss, line))
+    {
+        if (line.rfind(name, 0) != 0 || line.size() <= name.size())
+            continue;
+        char next = line[name.size()];
+        if (next != ' ' && next != '{')
+            continue;
+        size_t space = line.rfind(' ');
+        try
+        {
+            total += std::stod(line.substr(space + 1));
+        }
+        catch (...)
+        {
+        }
+    }
+    return total;
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+class Recorder
+{
+public:
+    explicit Recorder(Clock::time_point measure_from) : measure_from_(measure_from) {}
+
+    // Requests scheduled during warmup are dropped
+    void add(Clock::time_point scheduled, Sample sample)
+    {
+        if (scheduled < measure_from_)
+            return;
+        std::lock_guard<std::mutex> lock(mu_);
+        samples_.push_back(std::move(sample));
+    }
+
+    void add_dropped(Clock::time_point scheduled)
+    {
+        if (scheduled >= measure_from_)
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::vector<Sample> samples() const
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        return samples_;
+    }
+    uint64_t dropped() const { return dropped_.load(); }
+
+private:
+    Clock::time_point measure_from_;
+    mutable std::mutex mu_;
+    std::vector<Sample> samples_;
+    std::atomic<uint64_t> dropped_{0};
+};
+
+static const char *status_name(grpc::StatusCode code)
+{
+    switch (code)
+    {
+    case grpc::StatusCode::OK:
+        return "OK";
+    case grpc::StatusCode::CANCELLED:
+        return "CANCELLED";
+    case grpc::StatusCode::INVALID_ARGUMENT:
+        return "INVALID_ARGUMENT";
+    case grpc::StatusCode::DEADLINE_EXCEEDED:
+        return "DEADLINE_EXCEEDED";
+    case grpc::StatusCode::NOT_FOUND:
+        return "NOT_FOUND";
+    case grpc::StatusCode::RESOURCE_EXHAUSTED:
+        return "RESOURCE_EXHAUSTED";
+    case grpc::StatusCode::INTERNAL:
+        return "INTERNAL";
+    case grpc::StatusCode::UNAVAILABLE:
+        return "UNAVAILABLE";
+    default:
+        return "OTHER";
+    }
+}
+
+static double ms_since(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// What one request does, chosen up front so the mix doesn't depend on thread timing
+struct Job
+{
+    Clock::time_point scheduled;
+    Kind kind = Kind::STREAM;
+    size_t clip = 0;
+    size_t preset = 0;
+    uint64_t id = 0;
+};
+
+class LoadGenerator
+{
+public:
+    explicit LoadGenerator(const LoadOptions &opts) : opts_(opts), rng_(opts.seed)
+    {
+        for (int i = 0; i < opts.channels; ++i)
+        {
+            // A local subchannel pool gives each channel its own connection
+            grpc::ChannelArguments args;
+            args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+            auto channel = grpc::CreateCustomChannel(opts.target, grpc::InsecureChannelCredentials(), args);
+            stubs_.push_back(soundboard::AudioProcessor::NewStub(channel));
+        }
+    }
+
+    Job next_job(Clock::time_point scheduled)
+    {
+        std::lock_guard<std::mutex> lock(rng_mu_);
+        Job job;
+        job.scheduled = scheduled;
+        job.kind = std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < opts_.extract_fraction ? Kind::EXTRACT
+                                                                                                    : Kind::STREAM;
+        job.clip = std::uniform_int_distribution<size_t>(0, opts_.clips.size() - 1)(rng_);
+        job.preset = std::uniform_int_distribution<size_t>(0, opts_.presets.size() - 1)(rng_);
+        job.id = next_id_++;
+        return job;
+    }
+
+    Sample run(const Job &job)
+    {
+        auto &stub = stubs_[job.id % stubs_.size()];
+        grpc::ClientContext ctx;
+        // gRPC deadlines are wall-clock; keep the budget relative to the scheduled arrival
+        ctx.set_deadline(std::chrono::system_clock::now() +
+                         (job.scheduled + std::chrono::milliseconds(opts_.deadline_ms) - Clock::now()));
+        Sample sample;
+        sample.kind = job.kind;
+
+        if (job.kind == Kind::STREAM)
+        {
+            soundboard::ApplyEffectsRequest request;
+            request.set_audio_path(opts_.clips[job.clip]);
+            request.set_speed_factor(opts_.presets[job.preset].first);
+            request.set_pitch_factor(opts_.presets[job.preset].second);
+            request.set_low_latency(opts_.low_latency);
+
+            auto reader = stub->ApplyEffectsStream(&ctx, request);
+            soundboard::AudioChunk chunk;
+            while (reader->Read(&chunk))
+            {
+                if (sample.bytes == 0)
+                    sample.first_chunk_ms = ms_since(job.scheduled);
+                sample.bytes += static_cast<int64_t>(chunk.data().size());
+            }
+            grpc::Status status = reader->Finish();
+            sample.ok = status.ok();
+            sample.outcome = status_name(status.error_code());
+        }
+        else
+        {
+            soundboard::ExtractAudioRequest request;
+            request.set_video_path(opts_.clips[job.clip]);
+            // Outputs are reused round-robin so a long run doesn't fill the server's disk
+            request.set_output_path(opts_.extract_dir + "/loadgen-" + std::to_string(job.id % 64) + ".mp3");
+            request.set_format("mp3");
+            request.set_bitrate_kbps(192);
+
+            soundboard::ExtractAudioResponse response;
+            grpc::Status status = stub->ExtractAudio(&ctx, request, &response);
+            sample.ok = status.ok() && response.success();
+            sample.outcome = !status.ok() ? status_name(status.error_code()) : response.success() ? "OK" : "APP_ERROR";
+            sample.bytes = response.file_size_bytes();
+        }
+        sample.total_ms = ms_since(job.scheduled);
+        return sample;
+    }
+
+    // N clients back to back until end
+    void run_closed(Recorder &recorder, Clock::time_point end)
+    {
+        std::vector<std::thread> clients;
+        for (int i = 0; i < opts_.concurrency; ++i)
+            clients.emplace_back([&]()
+                                 {
+                                     for (Clock::time_point now = Clock::now(); now < end; now = Clock::now())
+                                     {
+                                         Job job = next_job(now);
+                                         recorder.add(job.scheduled, run(job));
+                                     } });
+        for (auto &t : clients)
+            t.join();
+    }
+
+    // Poisson arrivals at opts_.rate until end, each served by an idle worker
+    void run_open(Recorder &recorder, Clock::time_point end)
+    {
+        std::mutex mu;
+        std::condition_variable cv;
+        std::deque<Job> queue;
+        int busy = 0;
+        bool done = false;
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < opts_.max_inflight; ++i)
+            workers.emplace_back([&]()
+                                 {
+                                     std::unique_lock<std::mutex> lock(mu);
+                                     while (true)
+                                     {
+                                         cv.wait(lock, [&]() { return done || !queue.empty(); });
+                                         if (queue.empty())
+                                             return;
+                                         Job job = queue.front();
+                                         queue.pop_front();
+                                         lock.unlock();
+                                         Sample sample = run(job);
+                                         recorder.add(job.scheduled, std::move(sample));
+                                         lock.lock();
+                                         --busy;
+                                     } });
+
+        std::exponential_distribution<double> gap(opts_.rate);
+        Clock::time_point at = Clock::now();
+        while (true)
+        {
+            at += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(rng_)));
+            if (at >= end)
+                break;
+            std::this_thread::sleep_until(at);
+            Job job = next_job(at);
+            std::lock_guard<std::mutex> lock(mu);
+            if (busy >= opts_.max_inflight)
+            {
+                recorder.add_dropped(at);
+                continue;
+            }
+            ++busy;
+            queue.push_back(job);
+            cv.notify_one();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            done = true;
+        }
+        cv.notify_all();
+        for (auto &t : workers)
+            t.join();
+    }
+
+private:
+    const LoadOptions &opts_;
+    std::vector<std::unique_ptr<soundboard::AudioProcessor::Stub>> stubs_;
+    std::mutex rng_mu_;
+    std::mt19937 rng_;
+    uint64_t next_id_ = 0;
+};
+
+// ============================================================================
+// Report
+// ============================================================================
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * double(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+static void print_latencies(const char *label, std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    printf("  %-16s p50 %8.1f ms   p99 %8.1f ms   p999 %8.1f ms   max %8.1f ms\n", label,
+           percentile(values, 50.0), percentile(values, 99.0), percentile(values, 99.9),
+           values.empty() ? 0.0 : values.back());
+}
+
+static void report(const char *title, Kind kind, const std::vector<Sample> &samples, double seconds)
+{
+    std::vector<double> first_chunk, total;
+    std::map<std::string, uint64_t> outcomes;
+    uint64_t n = 0, ok = 0;
+    int64_t bytes = 0;
+    for (const Sample &s : samples)
+    {
+        if (s.kind != kind)
+            continue;
+        ++n;
+        ++outcomes[s.outcome];
+        if (!s.ok)
+            continue;
+        ++ok;
+        bytes += s.bytes;
+        total.push_back(s.total_ms);
+        if (kind == Kind::STREAM)
+            first_chunk.push_back(s.first_chunk_ms);
+    }
+    if (n == 0)
+        return;
+
+    printf("%s: %llu requests, %.1f ok/s, %.2f MB/s\n", title, static_cast<unsigned long long>(n), ok / seconds,
+           bytes / seconds / 1e6);
+    for (const auto &[outcome, count] : outcomes)
+        printf("  %-20s %8llu  (%5.1f%%)\n", outcome.c_str(), static_cast<unsigned long long>(count),
+               100.0 * double(count) / double(n));
+    if (kind == Kind::STREAM)
+        print_latencies("first chunk", first_chunk);
+    print_latencies(kind == Kind::STREAM ? "full stream" : "latency", total);
+}
+
+int main(int argc, char **argv)
+{
+    LoadOptions opts;
+    std::string err;
+    if (!parse_options(argc, argv, opts, err))
+    {
+        fprintf(stderr, "audio_loadgen: %s (see the header of tools/audio_loadgen.cpp)\n", err.c_str());
+        return 2;
+    }
+
+    LoadGenerator gen(opts);
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point measure_from = start + std::chrono::duration_cast<Clock::duration>(
+                                                       std::chrono::duration<double>(opts.warmup_s));
+    const Clock::time_point end = measure_from + std::chrono::duration_cast<Clock::duration>(
+                                                     std::chrono::duration<double>(opts.duration_s));
+    Recorder recorder(measure_from);
+
+    // CPU is sampled on its own thread at the warmup boundary and at the end
+    std::string metrics_before, metrics_after;
+    Clock::time_point scraped_before, scraped_after;
+    std::thread scraper([&]()
+                        {
+                            std::this_thread::sleep_until(measure_from);
+                            scraped_before = Clock::now();
+                            metrics_before = fetch_metrics(opts.metrics);
+                            std::this_thread::sleep_until(end);
+                            scraped_after = Clock::now();
+                            metrics_after = fetch_metrics(opts.metrics); });
+
+    if (opts.rate > 0.0)
+    {
+        printf("open loop: %.1f req/s for %.0f s (+%.0f s warmup), max %d in flight\n", opts.rate, opts.duration_s,
+               opts.warmup_s, opts.max_inflight);
+        gen.run_open(recorder, end);
+    }
+    else
+    {
+        printf("closed loop: %d clients for %.0f s (+%.0f s warmup)\n", opts.concurrency, opts.duration_s,
+               opts.warmup_s);
+        gen.run_closed(recorder, end);
+    }
+    scraper.join();
+
+    std::vector<Sample> samples = recorder.samples();
+    uint64_t exhausted = 0;
+    for (const Sample &s : samples)
+        exhausted += s.outcome == "RESOURCE_EXHAUSTED";
+    printf("\n%zu requests measured, RESOURCE_EXHAUSTED %.2f%%", samples.size(),
+           samples.empty() ? 0.0 : 100.0 * double(exhausted) / double(samples.size()));
+    if (opts.rate > 0.0)
+        printf(", %llu arrivals dropped client-side", static_cast<unsigned long long>(recorder.dropped()));
+    printf("\n\n");
+    report("ApplyEffectsStream", Kind::STREAM, samples, opts.duration_s);
+    report("ExtractAudio", Kind::EXTRACT, samples, opts.duration_s);
+
+    if (!metrics_before.empty() && !metrics_after.empty())
+    {
+        double wall = std::chrono::duration<double>(scraped_after - scraped_before).count();
+        double cpu = metric_value(metrics_after, "process_cpu_seconds_total") -
+                     metric_value(metrics_before, "process_cpu_seconds_total");
+        double rejected = metric_value(metrics_after, "audio_admission_rejected_total") -
+                          metric_value(metrics_before, "audio_admission_rejected_total");
+        double timeouts = metric_value(metrics_after, "audio_admission_timeouts_total") -
+                          metric_value(metrics_before, "audio_admission_timeouts_total");
+        printf("\nserver: %.2f cores busy (%.1f CPU-s), RSS %.0f MB, admission rejected %.0f, timed out %.0f\n",
+               cpu / wall, cpu, metric_value(metrics_after, "process_resident_memory_bytes") / 1e6, rejected, timeouts);
+    }
+    else if (!opts.metrics.empty())
+        printf("\nserver: no metrics from %s\n", opts.metrics.c_str());
+    return 0;
+}
@@ -37,14 +37,24 @@ public class AudioStreamController {
      * Stream audio with optional speed and pitch modifications
      * Speed: 0.5 = half speed, 1.0 = normal, 2.0 = double speed
      * Pitch: 0.5 = half pitch (lower), 1.0 = normal, 2.0 = double pitch (higher)
+     * Start/End: optional range in seconds of the processed (post-speed) audio, for seeking
      */
     @GetMapping("/{id}")
     public ResponseEntity<StreamingResponseBody> streamAudio(
             @PathVariable Long id,
             @RequestParam(defaultValue = "1.0") double speed,
-            @RequestParam(defaultValue = "1.0") double pitch) throws IOException {
+            @RequestParam(defaultValue = "1.0") double pitch,
+            @RequestParam(required = false) Double start,
+            @RequestParam(required = false) Double end) throws IOException {
 
-        log.info("Streaming audio for clip {} with speed={}, pitch={}", id, speed, pitch);
+        log.info("Streaming audio for clip {} with speed={}, pitch={}, start={}, end={}", id, speed, pitch, start, end);
+
+        double startSeconds = start != null ? start : 0.0;
+        double endSeconds = end != null ? end : 0.0;
+        if (startSeconds < 0.0 || endSeconds < 0.0 || (endSeconds > 0.0 && endSeconds <= startSeconds)) {
+            return ResponseEntity.badRequest().build();
+        }
+        boolean hasRange = startSeconds > 0.0 || endSeconds > 0.0;
 
         // Get clip and audio file path
         var clipOpt = clipService.findById(id);
@@ -69,8 +79,8 @@ public class AudioStreamController {
             // Don't fail the request if Kafka is down
         }
 
-        // If no modifications, serve file directly
-        if (speed == 1.0 && pitch == 1.0) {
+        // If no modifications, serve file directly (a range needs the processor to cut it)
+        if (speed == 1.0 && pitch == 1.0 && !hasRange) {
             log.info("Serving original file: {}", audioFilePath);
             StreamingResponseBody responseBody = outputStream -> {
                 try (InputStream fileStream = Files.newInputStream(Paths.get(audioFilePath))) {
@@ -97,7 +107,8 @@ public class AudioStreamController {
             // Use direct stream method which handles async with proper waits
             StreamingResponseBody responseBody = outputStream -> {
                 try {
-                    audioProcessorService.applyEffectsStream(audioFilePath, (float) speed, (float) pitch, outputStream);
+                    audioProcessorService.applyEffectsStream(audioFilePath, (float) speed, (float) pitch,
+                            startSeconds, endSeconds, outputStream);
                 } catch (Exception e) {
                     log.error("Failed to apply audio effects for clip {}", id, e);
                     throw new IOException("Failed to process audio: " + e.getMessage(), e);
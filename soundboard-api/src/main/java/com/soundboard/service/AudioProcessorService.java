@@ -47,6 +47,14 @@ public class AudioProcessorService {
     @Value("${storage.audio-dir}")
     private String audioDir;
 
+    @Value("${grpc.audio-processor.prerender-presets:true}")
+    private boolean prerenderPresets;
+
+    // Ask the processor to optimise streams for time-to-first-sound, at some cost in
+    // pitch-shift quality; off by default so streams share the full-quality renders
+    @Value("${grpc.audio-processor.low-latency-stream:false}")
+    private boolean lowLatencyStream;
+
     private ManagedChannel channel;
     private AudioProcessorGrpc.AudioProcessorStub asyncStub;
 
@@ -133,6 +141,7 @@ public class AudioProcessorService {
             .setOutputPath(outputPath)
             .setFormat(safeFormat)
             .setBitrateKbps(bitrate)
+            .setPrerenderPresets(prerenderPresets)
             .build();
 
         CountDownLatch latch = new CountDownLatch(1);
@@ -174,10 +183,11 @@ public class AudioProcessorService {
             throw new Exception("Audio extraction failed: " + errorMsg);
         }
 
-        log.info("Audio extracted successfully: {} ({} bytes, {} seconds)",
+        log.info("Audio extracted successfully: {} ({} bytes, {} seconds, {} effect presets prerendered)",
                 response.getAudioPath(),
                 response.getFileSizeBytes(),
-                response.getDurationSeconds());
+                response.getDurationSeconds(),
+                response.getPrerenderedVariants());
 
         return response.getAudioPath();
     }
@@ -237,12 +247,26 @@ public class AudioProcessorService {
      */
     public void applyEffectsStream(String audioPath, float speedFactor, float pitchFactor, OutputStream outputStream)
             throws IOException, Exception {
-        log.info("Applying effects with streaming: speed={}, pitch={} for {}", speedFactor, pitchFactor, audioPath);
+        applyEffectsStream(audioPath, speedFactor, pitchFactor, 0.0, 0.0, outputStream);
+    }
+
+    /**
+     * Stream a range of the processed audio. Start/end are in output (post-speed) seconds;
+     * end = 0 streams to the end of the clip.
+     */
+    public void applyEffectsStream(String audioPath, float speedFactor, float pitchFactor,
+            double startSeconds, double endSeconds, OutputStream outputStream)
+            throws IOException, Exception {
+        log.info("Applying effects with streaming: speed={}, pitch={}, range={}-{} for {}",
+                speedFactor, pitchFactor, startSeconds, endSeconds, audioPath);
 
         AudioProcessorOuterClass.ApplyEffectsRequest request = AudioProcessorOuterClass.ApplyEffectsRequest.newBuilder()
                 .setAudioPath(audioPath)
                 .setSpeedFactor(speedFactor)
                 .setPitchFactor(pitchFactor)
+                .setStartSeconds(startSeconds)
+                .setEndSeconds(endSeconds)
+                .setLowLatency(lowLatencyStream)
                 .build();
 
         // Bounded queue provides backpressure toward the gRPC callback threads